@@ -11,9 +11,15 @@
 extern "C" {
 #endif
 
-#include "i2cs.h"
+#include "ssd1306_transport.h"
 #include "ssd1306_print.h"
 
+// USE_I2C_TRANSPORT makes the i2cs backend at OLED_ADDRESS the default transport,
+// without it ssd1306_set_transport has to be called before ssd1306_init.
+// SSD1306_HOST is set by the PC build (CMakeLists.txt), which has no i2cs driver
+#ifndef SSD1306_HOST
+#define USE_I2C_TRANSPORT
+#endif
 #define OLED_ADDRESS 0x3C
 #define SCREEN_HEIGHT 32
 #define SCREEN_WIDTH 128
@@ -24,29 +30,241 @@ extern "C" {
 // longer drawing times for large objects
 #define USE_QUICK_DISPLAY
 
+// USE_COMMAND_QUEUE makes settings functions (contrast, invert, flip, display on/off, rotation)
+// only queue their command bytes, the queue is sent in one transaction
+// together with the next ssd1306_display call or by ssd1306_flush_commands
+#define USE_COMMAND_QUEUE
+#define SSD1306_COMMAND_QUEUE_SIZE 16
+
+// times ssd1306_display tries a failed flush again, see ssd1306_set_retry_policy
+#define SSD1306_DEFAULT_RETRIES 2
+
+// USE_WARM_RESTART places the screen buffer and a CRC of the last sent frame
+// in the .noinit section (the linker script has to provide it), so that
+// ssd1306_init_warm can take over the panel content after a watchdog reset
+// without the init list, the clear and the redraw
+//#define USE_WARM_RESTART
+
+// USE_CHARACTER_MODE leaves out the screen buffer of the default panel, ssd1306_write
+// and ssd1306_printf send every changed character cell straight to the controller.
+// Cells are whole pages high and as wide as the widest glyph plus the letter spacing,
+// the cursor snaps to them; text scale and 90 degree rotation are not used.
+// Drawing functions need a panel with a buffer, see ssd1306_init_display
+//#define USE_CHARACTER_MODE
+// characters remembered to skip unchanged cells, further cells are always sent
+#define SSD1306_CHARACTER_CELLS ((SCREEN_WIDTH / 6) * (SCREEN_HEIGHT / 8))
+#define SSD1306_CHARACTER_MAX_WIDTH 32
+
+// USE_REFERENCE_RASTER draws every primitive pixel by pixel through ssd1306_draw_pixel
+// instead of the page and word kernels, slow but simple, the output of both has to be the same
+//#define USE_REFERENCE_RASTER
+// SSD1306_RASTER_SWITCH (a build flag of host builds) keeps both and ssd1306_reference_raster picks one
+// at run time instead, Test/raster_fuzz.c compares them in one program
+#ifdef SSD1306_RASTER_SWITCH
+  extern uint8_t ssd1306_reference_raster;
+#endif
+
+// USE_TRACE records the drawing, text, flush and settings calls into a ring buffer,
+// see ssd1306_trace.h
+//#define USE_TRACE
+
 #define SSD_COLOR_BLACK 0
 #define SSD_COLOR_WHITE 1
 #define SSD_COLOR_INVERSE 2
 
+#define SSD_FILL_EVEN_ODD 0
+#define SSD_FILL_NON_ZERO 1
+#define SSD1306_POLYGON_MAX_POINTS 16
+
+  typedef struct
+  {
+    int16_t x;
+    int16_t y;
+  } ssd1306_point_t;
+
+// raster operations of bitmap copies
+#define SSD_ROP_COPY 0 // destination pixels are replaced by the source
+#define SSD_ROP_OR 1 // set source pixels are drawn white
+#define SSD_ROP_CLEAR 2 // set source pixels are drawn black
+#define SSD_ROP_XOR 3 // set source pixels are inverted
+
+// hardware fade out and blinking, see ssd1306_set_fade
+#define SSD_FADE_OFF 0x00
+#define SSD_FADE_OUT 0x20 // contrast falls to 0 and stays there
+#define SSD_FADE_BLINK 0x30 // contrast falls to 0 and rises again, repeatedly
+
+#define SSD_ROTATION_0 0
+#define SSD_ROTATION_90 1
+#define SSD_ROTATION_180 2
+#define SSD_ROTATION_270 3
+
+  typedef struct
+  {
+    int16_t x0;
+    int16_t y0;
+    int16_t x1;
+    int16_t y1;
+  } ssd1306_clip_rect_t;
+
+  typedef struct
+  {
+    uint32_t failed_transfers; // bus transactions that reported an error
+    uint32_t retries;
+    uint32_t recoveries;       // calls of the transport recover hook
+    uint32_t retried_bytes;    // display data left to send when a retry started
+    uint32_t failed_flushes;   // given up after all retries, the unsent area stays changed
+  } ssd1306_error_counters_t;
+
+  // 1bpp surface composed over the screen buffer when the panel is flushed
+  typedef struct ssd1306_layer_t
+  {
+    uint8_t *buffer;       // SCREEN_BUFFER_SIZE bytes, same layout as the screen buffer, word aligned buffers compose fastest
+    const uint8_t *mask;   // SSD_ROP_COPY only, set bits take the layer pixel, 0 takes all of bounds
+    uint8_t rop;           // how the layer is combined with the pixels below
+    uint8_t visible;
+    uint8_t column_start, column_end, page_start, page_end; // bounds, panel coordinates
+    struct ssd1306_layer_t *above;
+  } ssd1306_layer_t;
+
+  typedef struct
+  {
+    uint8_t current;       // last contrast sent
+    uint8_t target;
+    uint8_t step;
+    uint8_t active;
+    uint32_t interval;
+    uint32_t due;
+  } ssd1306_contrast_ramp_t;
+
+  // panel scan settings, a frame takes divide_ratio * (phase1 + phase2 + 50) * multiplex oscillator clocks
+  typedef struct
+  {
+    uint8_t divide_ratio; // 1..16
+    uint8_t oscillator;   // 0..15
+    uint8_t multiplex;    // rows scanned, 16..64
+    uint8_t phase1;       // pre-charge periods 1..15
+    uint8_t phase2;
+  } ssd1306_timing_t;
+
+  // caller owned off-screen bitmap, page-major like the screen buffer: width bytes per page
+  typedef struct
+  {
+    uint8_t *buffer;  // width * ((height + 7) / 8) bytes
+    uint8_t width;    // up to SCREEN_WIDTH
+    uint8_t height;
+  } ssd1306_canvas_t;
+
+  // state of one panel, the library draws into and sends the selected one,
+  // fields are kept by the library and should not be changed directly
+  typedef struct
+  {
+    uint8_t *buffer; // page-major in panel orientation, buffer_width bytes per page, drawing target
+    uint8_t buffer_width; // size of the drawing target in panel orientation, the screen or a canvas
+    uint8_t buffer_height;
+    ssd1306_transport_t transport;
+    uint8_t rotation;
+    uint8_t zoom;
+    uint8_t screen_width;
+    uint8_t screen_height;
+    ssd1306_clip_rect_t clip_rect;
+    // area changed since the last display call, panel coordinates
+    uint8_t was_buffer_updated;
+    uint16_t updated_pixel_min_x, updated_pixel_min_y, updated_pixel_max_x, updated_pixel_max_y;
+    // window of the running resumable flush, see ssd1306_flush_begin
+    uint8_t flush_active;
+    uint8_t flush_column_start, flush_column_end, flush_page_end;
+    uint8_t flush_column, flush_page;
+    ssd1306_error_counters_t error_counters;
+    // bottom of the picture, buffer points to a layer while ssd1306_draw_to_layer is active
+    uint8_t *base_buffer;
+    ssd1306_layer_t *layers; // lowest first
+    // drawing target, rotation and clipping of the screen while a canvas is drawn to
+    ssd1306_canvas_t *canvas;
+    uint8_t *saved_buffer;
+    uint8_t saved_rotation;
+    ssd1306_clip_rect_t saved_clip_rect;
+    ssd1306_contrast_ramp_t contrast;
+    ssd1306_timing_t timing;
+#ifdef USE_COMMAND_QUEUE
+    uint8_t command_queue[SSD1306_COMMAND_QUEUE_SIZE];
+    uint8_t command_queue_length;
+#endif
+  } ssd1306_display_t;
+
+#define SCREEN_BUFFER_SIZE (SCREEN_WIDTH * ((SCREEN_HEIGHT + 7) / 8))
+
 #define SSD1306_SUCCESS 0
 #define SSD1306_ERROR_COMMUNICATION -1
+#define SSD1306_ERROR_INVALID_ARGUMENT -2
+#define SSD1306_ERROR_QUEUE_FULL -3
+#define SSD1306_FLUSH_IN_PROGRESS 1
 
+  void ssd1306_set_transport(const ssd1306_transport_t *transport);
+  // prepares another panel, buffer has SCREEN_BUFFER_SIZE bytes,
+  // select it and call ssd1306_init to start it
+  void ssd1306_init_display(ssd1306_display_t *display, uint8_t *buffer, const ssd1306_transport_t *transport);
+  void ssd1306_select_display(ssd1306_display_t *display);
+  ssd1306_display_t *ssd1306_get_display(void);
   int ssd1306_init(void);
+#ifdef USE_WARM_RESTART
+  int ssd1306_init_warm(void);
+  uint8_t ssd1306_is_warm_started(void);
+#endif
 
   void ssd1306_display_full(void);
   void ssd1306_display_empty(void);
 
-  void set_contrast(uint8_t contrast_value);
-
   //display functions
   int ssd1306_display(void);
+  // resumable display: begin takes the changed area, every step sends up to
+  // max_bytes of it and returns SSD1306_FLUSH_IN_PROGRESS until all is sent
+  int ssd1306_flush_begin(void);
+  int ssd1306_flush_step(uint16_t max_bytes);
+  uint8_t ssd1306_is_flush_active(void);
+  void ssd1306_mark_updated_window(uint8_t column_start, uint8_t column_end, uint8_t page_start, uint8_t page_end);
+  void ssd1306_set_retry_policy(uint8_t retries, uint16_t backoff_first, uint16_t backoff_max, void (*delay)(uint16_t time));
+  const ssd1306_error_counters_t *ssd1306_get_error_counters(void);
+  void ssd1306_reset_error_counters(void);
+  int ssd1306_send_window(const uint8_t *buffer, uint16_t stride,
+			  uint8_t column_start, uint8_t column_end,
+			  uint8_t page_start, uint8_t page_end);
+  int ssd1306_set_window(uint8_t column_start, uint8_t column_end, uint8_t page_start, uint8_t page_end);
+  uint8_t ssd1306_take_updated_window(uint8_t *column_start, uint8_t *column_end, uint8_t *page_start, uint8_t *page_end);
   void ssd1306_clear_display(void);
+  // layers: buffer is cleared, the layer starts hidden with bounds of the whole screen
+  void ssd1306_layer_init(ssd1306_layer_t *layer, uint8_t *buffer, const uint8_t *mask, uint8_t rop);
+  // puts the layer on top of the layers of the selected display
+  void ssd1306_add_layer(ssd1306_layer_t *layer);
+  void ssd1306_remove_layer(ssd1306_layer_t *layer);
+  // only the bounds are composed and marked changed by show and hide, screen coordinates
+  void ssd1306_set_layer_bounds(ssd1306_layer_t *layer, int16_t x, int16_t y, int16_t width, int16_t height);
+  void ssd1306_show_layer(ssd1306_layer_t *layer, uint8_t visible);
+  // drawing functions draw into the layer, NULL draws into the screen buffer again
+  void ssd1306_draw_to_layer(ssd1306_layer_t *layer);
+  // clears the buffer, returns SSD1306_ERROR_INVALID_ARGUMENT for a size the buffer kernels can not take
+  int ssd1306_canvas_init(ssd1306_canvas_t *canvas, uint8_t *buffer, uint8_t width, uint8_t height);
+  // drawing and text functions draw into the canvas until it is called with NULL,
+  // the canvas is not rotated, the panel is not marked as changed;
+  // rotation and zoom must not be changed meanwhile
+  void ssd1306_draw_to_canvas(ssd1306_canvas_t *canvas);
+  // copies the canvas to x, y of the drawing target (the screen or another canvas)
+  void ssd1306_draw_canvas(const ssd1306_canvas_t *canvas, int16_t x, int16_t y, uint8_t rop);
   void ssd1306_draw_pixel(int16_t x, int16_t y, uint8_t color);
+  uint8_t ssd1306_get_pixel(int16_t x, int16_t y);
+  const uint8_t *ssd1306_get_buffer(void);
   //draw functions
-  void ssd1306_draw_line(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t color);
+  void ssd1306_draw_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t color);
+  void ssd1306_draw_line_thick(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t thickness, uint8_t color);
+  void ssd1306_set_line_pattern(uint32_t pattern, uint8_t length);
+  void ssd1306_set_clip_rect(int16_t x, int16_t y, int16_t width, int16_t height);
+  void ssd1306_reset_clip_rect(void);
   void ssd1306_draw_h_line(int16_t x0, int16_t y0, int16_t x1, uint8_t color);
   void ssd1306_draw_v_line(int16_t x0, int16_t y0, int16_t y1, uint8_t color);
   void ssd1306_fill_rect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t color);
+  void ssd1306_copy_rect(int16_t x, int16_t y, int16_t width, int16_t height, int16_t to_x, int16_t to_y);
+  // copies the rectangle from source, a buffer laid out like the drawing target, to the same place
+  void ssd1306_restore_rect(const uint8_t *source, int16_t x, int16_t y, int16_t width, int16_t height);
+  void ssd1306_scroll_rect(int16_t x, int16_t y, int16_t width, int16_t height, int16_t dx, int16_t dy, uint8_t color);
   void ssd1306_fill_rect_round(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t cornerRadius, uint8_t color);
   void ssd1306_fill_circle(uint8_t midX, uint8_t midY, uint8_t radius, uint8_t color);
   void ssd1306_fill_circle_quarter(uint8_t midX, uint8_t midY, uint8_t radius, uint8_t quarter, uint8_t color);
@@ -54,12 +272,24 @@ extern "C" {
   void ssd1306_draw_rect_round(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t cornerRadius, uint8_t color);
   void ssd1306_draw_circle(uint8_t midX, uint8_t midY, uint8_t radius, uint8_t color);
   void ssd1306_draw_circle_quarter(uint8_t midX, uint8_t midY, uint8_t radius, uint8_t quarter, uint8_t color);
+  void ssd1306_fill_ellipse(int16_t midX, int16_t midY, uint8_t radiusX, uint8_t radiusY, uint8_t color);
+  void ssd1306_draw_ellipse(int16_t midX, int16_t midY, uint8_t radiusX, uint8_t radiusY, uint8_t color);
+  void ssd1306_fill_arc(int16_t midX, int16_t midY, uint8_t radius, uint8_t innerRadius,
+			int16_t startAngle, int16_t endAngle, uint8_t color);
+  void ssd1306_draw_arc(int16_t midX, int16_t midY, uint8_t radius, int16_t startAngle, int16_t endAngle, uint8_t color);
+  void ssd1306_fill_triangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t color);
+  void ssd1306_fill_polygon(const ssd1306_point_t *points, uint8_t count, uint8_t fill_rule, uint8_t color);
   void ssd1306_draw_XBM(const uint8_t *bitmap, uint8_t width, uint8_t height, uint8_t x0, uint8_t y0, uint8_t color);
+  void ssd1306_draw_page_bitmap(const uint8_t *bitmap, uint8_t width, uint8_t height, int16_t x, int16_t y, uint8_t rop);
   // Text functions
   void ssd1306_set_font(const unsigned char *fonts);
   int ssd1306_write(uint8_t c);
+  uint8_t ssd1306_draw_glyph(const unsigned char *font, uint8_t c, int16_t x, int16_t y, uint8_t scale, uint8_t color);
+  uint8_t ssd1306_get_glyph_width(const unsigned char *font, uint8_t c);
   void ssd1306_set_cursor(uint8_t column, uint8_t row);
   void ssd1306_set_cursor_coord(uint8_t coord_x, uint8_t coord_y);
+  uint8_t ssd1306_get_cursor_x(void);
+  uint8_t ssd1306_get_cursor_y(void);
   void ssd1306_set_cursor_column(uint8_t column);
   void ssd1306_set_cursor_row(uint8_t row);
   void ssd1306_advance_cursor_row(uint8_t row_count, uint8_t column);
@@ -68,15 +298,43 @@ extern "C" {
   uint16_t ssd1306_get_text_width(const char text[]);
   void ssd1306_set_text_offset(uint8_t offsetX, uint8_t offsetY) ;
   void ssd1306_set_text_scale(uint8_t textScale);
+  void ssd1306_set_text_color(uint8_t color);
+  uint8_t ssd1306_get_text_color(void);
   void ssd1306_set_text_line_spacing(uint8_t lineSpacing);
   void ssd1306_set_text_letter_spacing(uint8_t letterSpacing);
   // Display command functions
-  int sd1306_send_command(uint8_t command);
+  int ssd1306_send_command(uint8_t command);
   int ssd1306_send_command_with_value(uint8_t command, uint8_t value);
-  void ssd1306_set_contrast(uint8_t contrast_value);
-  void ssd1306_set_display_on(uint8_t display_on);
-  void ssd1306_invert_display(uint8_t invert);
-  void ssd1306_flip_vertically(uint8_t flip);
+  int ssd1306_flush_commands(void);
+  int ssd1306_set_contrast(uint8_t contrast_value);
+  int ssd1306_set_clock_div(uint8_t divide_ratio, uint8_t oscillator_frequency);
+  int ssd1306_set_multiplex_ratio(uint8_t rows);
+  int ssd1306_set_pre_charge(uint8_t phase1, uint8_t phase2);
+  // scan period and rate from the timing settings, the oscillator frequency is the typical one
+  uint32_t ssd1306_get_frame_period(void); // microseconds
+  uint16_t ssd1306_get_frame_rate(void);   // Hz
+  // ssd1306_display waits with its transfer for the next start of a frame period counted
+  // from now + phase, so the tear line stays in one place instead of crawling over the panel.
+  // clock returns microseconds, wait waits for the given microseconds (a timer),
+  // a NULL clock turns pacing off
+  void ssd1306_set_flush_pacing(uint32_t (*clock)(void), void (*wait)(uint32_t microseconds), uint32_t phase);
+  // microseconds a paced flush started at now would wait, to schedule flushes from a timer
+  uint32_t ssd1306_get_flush_delay(uint32_t now);
+  int ssd1306_set_display_on(uint8_t display_on);
+  int ssd1306_invert_display(uint8_t invert);
+  int ssd1306_flip_vertically(uint8_t flip);
+  // fade mode SSD_FADE_*, the contrast changes one step every frames frames (8..128, in steps of 8)
+  int ssd1306_set_fade(uint8_t mode, uint8_t frames);
+  // every row is shown twice, only the upper half of the screen is drawn and shown,
+  // the panel has to use the alternative COM pin configuration (128x64 modules)
+  int ssd1306_set_zoom(uint8_t zoom);
+  // changes the contrast by step every interval (any time unit, the one of now),
+  // ssd1306_contrast_ramp_tick sends one contrast command when a step is due
+  int ssd1306_start_contrast_ramp(uint8_t target, uint8_t step, uint32_t interval, uint32_t now);
+  int ssd1306_contrast_ramp_tick(uint32_t now);
+  uint8_t ssd1306_is_contrast_ramp_active(void);
+  int ssd1306_set_rotation(uint8_t rotation);
+  uint8_t ssd1306_get_rotation();
 
   uint8_t ssd1306_get_screen_height();
   uint8_t ssd1306_get_screen_width();
@@ -0,0 +1,36 @@
+/*
+ * ssd1306_dither.h
+ *
+ * Streaming conversion of 8-bit grayscale images into the screen buffer.
+ * Source rows are consumed one at a time (or eight at a time), the whole
+ * image never has to be in RAM. Floyd-Steinberg keeps two rows of error.
+ */
+
+#ifndef __SSD1306_DITHER_H_
+#define __SSD1306_DITHER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define SSD_DITHER_THRESHOLD 0
+#define SSD_DITHER_BAYER 1
+#define SSD_DITHER_FLOYD_STEINBERG 2
+
+  // returns the grayscale row (width bytes, 0 is black) of the given index
+  typedef const uint8_t *(*ssd1306_dither_source_t)(void *context, uint16_t row);
+
+  // width is at most SCREEN_WIDTH
+  int ssd1306_dither_begin(int16_t x, int16_t y, uint8_t width, uint8_t height, uint8_t mode);
+  int ssd1306_dither_row(const uint8_t *gray_row);
+  // eight consecutive rows, row_stride bytes apart, written as whole page bytes
+  int ssd1306_dither_rows8(const uint8_t *gray_rows, uint16_t row_stride);
+  int ssd1306_dither_image(int16_t x, int16_t y, uint8_t width, uint8_t height, uint8_t mode,
+			   ssd1306_dither_source_t source, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __SSD1306_DITHER_H_ */
@@ -0,0 +1,53 @@
+/*
+ * ssd1306_field.h
+ *
+ * Numeric read-outs (counters, clocks, measurements) at a fixed place.
+ * Every character has a cell of the same width, the field remembers what it shows
+ * and an update redraws and marks dirty only the cells whose character changed.
+ */
+
+#ifndef __SSD1306_FIELD_H_
+#define __SSD1306_FIELD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define SSD1306_FIELD_MAX_CELLS 12
+
+#define SSD_ALIGN_LEFT 0
+#define SSD_ALIGN_RIGHT 1
+
+  typedef struct
+  {
+    const unsigned char *font;
+    char *format;     // ssd1306_printf format used by ssd1306_field_update
+    uint8_t x;
+    uint8_t y;
+    uint8_t cells;
+    uint8_t cell_width;
+    uint8_t cell_height;
+    uint8_t scale;
+    uint8_t align;
+    uint8_t color;    // text color, the cells are cleared with the other one
+    uint8_t valid;    // 0 until the first update and after ssd1306_field_invalidate
+    char shown[SSD1306_FIELD_MAX_CELLS];
+  } ssd1306_field_t;
+
+  // the cell width is the widest of the digits and signs of the font,
+  // color is SSD_COLOR_WHITE or SSD_COLOR_BLACK
+  int ssd1306_field_init(ssd1306_field_t *field, uint8_t x, uint8_t y, uint8_t cells,
+			 const unsigned char *font, uint8_t scale, char *format, uint8_t align, uint8_t color);
+  // text longer than the field is shown as all '#', returns the number of redrawn cells
+  int ssd1306_field_set_text(ssd1306_field_t *field, const char *text);
+  // formats the arguments with the field format and shows the result
+  int ssd1306_field_update(ssd1306_field_t *field, ...);
+  // the next update redraws every cell, e.g. after the screen was cleared
+  void ssd1306_field_invalidate(ssd1306_field_t *field);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __SSD1306_FIELD_H_ */
@@ -0,0 +1,41 @@
+/*
+ * ssd1306_gray.h
+ *
+ * 4 level grayscale in a region of the panel, made by showing two bitplanes
+ * as weighted subframes: the high plane for two subframes, the low plane for one.
+ * ssd1306_gray_tick has to be called at a steady subframe rate (timer callback
+ * or frame scheduler), the region bytes sent per subframe are limited by the bus budget.
+ * Coordinates are panel coordinates, screen rotation is not applied.
+ */
+
+#ifndef __SSD1306_GRAY_H_
+#define __SSD1306_GRAY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// bytes reserved for each bitplane, the region width times its pages must fit
+#define SSD1306_GRAY_PLANE_SIZE 256
+
+#define SSD_GRAY_BLACK 0
+#define SSD_GRAY_DARK 1
+#define SSD_GRAY_LIGHT 2
+#define SSD_GRAY_WHITE 3
+
+  // y and height are extended to whole pages
+  int ssd1306_gray_set_region(uint8_t x, uint8_t y, uint8_t width, uint8_t height);
+  // largest number of bytes one subframe is allowed to send
+  void ssd1306_gray_set_bus_budget(uint16_t bytes_per_subframe);
+  void ssd1306_gray_clear(void);
+  void ssd1306_gray_draw_pixel(int16_t x, int16_t y, uint8_t level);
+  void ssd1306_gray_fill_rect(int16_t x, int16_t y, int16_t width, int16_t height, uint8_t level);
+  int ssd1306_gray_tick(void);
+  uint8_t ssd1306_gray_get_subframe(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __SSD1306_GRAY_H_ */
@@ -0,0 +1,58 @@
+/*
+ * ssd1306_list.h
+ *
+ * Scrolling list or menu of any length. Entry texts come from a callback and only
+ * rows that become visible are drawn, the selection is an inverted bar that is
+ * moved with two XOR fills and scrolling moves the pixels already drawn.
+ */
+
+#ifndef __SSD1306_LIST_H_
+#define __SSD1306_LIST_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define SSD1306_LIST_MAX_TEXT 24
+
+  // writes the text of the entry into text, at most size - 1 characters and the terminator
+  typedef void (*ssd1306_list_text_t)(void *context, uint16_t index, char *text, uint8_t size);
+
+  typedef struct
+  {
+    ssd1306_list_text_t get_text;
+    void *context;
+    const unsigned char *font;
+    uint8_t x;
+    uint8_t y;
+    uint8_t width;
+    uint8_t height;
+    uint8_t row_height;
+    uint8_t speed;       // pixels scrolled by one update, 0 jumps at once
+    uint8_t valid;       // 0 until the first update and after ssd1306_list_invalidate
+    uint16_t count;
+    uint16_t selected;
+    int32_t offset;      // list pixel row shown at the top of the area
+    int32_t target;      // offset the scrolling moves to
+  } ssd1306_list_t;
+
+  // rows are the font height plus two pixels high, scrolling moves speed 2 pixels per update
+  int ssd1306_list_init(ssd1306_list_t *list, uint8_t x, uint8_t y, uint8_t width, uint8_t height,
+			const unsigned char *font, uint16_t count, ssd1306_list_text_t get_text, void *context);
+  void ssd1306_list_set_count(ssd1306_list_t *list, uint16_t count);
+  void ssd1306_list_set_scroll_speed(ssd1306_list_t *list, uint8_t speed);
+  // moves the selection bar and scrolls until the entry is visible
+  void ssd1306_list_select(ssd1306_list_t *list, uint16_t index);
+  // moves the selection by delta entries, stops at the first and last one
+  void ssd1306_list_move(ssd1306_list_t *list, int16_t delta);
+  // draws one scroll step, returns 1 while the list is still scrolling
+  int ssd1306_list_update(ssd1306_list_t *list);
+  // the next update draws the whole area again, e.g. after the screen was cleared
+  void ssd1306_list_invalidate(ssd1306_list_t *list);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __SSD1306_LIST_H_ */
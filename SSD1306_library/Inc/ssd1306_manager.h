@@ -0,0 +1,81 @@
+/*
+ * ssd1306_manager.h
+ *
+ * Flushes the changed areas of several panels. Panels on different buses are sent
+ * at the same time when their transports send in background (SPI with spi_write_async,
+ * I2C with a ssd1306_i2c_bus_t that has write_async), panels sharing a bus
+ * are sent one after another, highest priority first, then the longest waiting one.
+ * ssd1306_manager_poll has to be called from the main loop with a time in any unit
+ * (ms, timer ticks), the statistics are in the same unit.
+ * A blocking transfer ends inside the poll that started it, its end time is read
+ * from the clock given to ssd1306_manager_set_clock, without one busy_time stays 0
+ * and latencies end at the poll time.
+ */
+
+#ifndef __SSD1306_MANAGER_H_
+#define __SSD1306_MANAGER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "ssd1306.h"
+
+#define SSD1306_MANAGER_MAX_DISPLAYS 4
+
+  typedef struct
+  {
+    uint32_t frames;        // completed flushes
+    uint32_t errors;        // failed flushes
+    uint32_t bytes;         // display data bytes sent
+    uint32_t busy_time;     // time spent in transfers, see ssd1306_manager_get_throughput
+    uint32_t last_latency;  // from the poll that first saw a change until its flush ended
+    uint32_t max_latency;
+    uint32_t total_latency; // average latency is total_latency / frames
+  } ssd1306_display_stats_t;
+
+  typedef struct
+  {
+    ssd1306_display_t *display;
+    uint8_t bus;
+    uint8_t priority;
+    uint8_t state;
+    volatile uint8_t transfer_done;
+    volatile int8_t transfer_result;
+    uint8_t column_start, column_end, page, page_end;
+    uint8_t transfer_pages;
+    uint16_t transfer_bytes;
+    uint32_t dirty_since;
+    uint32_t flush_started;
+    ssd1306_display_stats_t stats;
+  } ssd1306_manager_slot_t;
+
+  typedef struct
+  {
+    ssd1306_manager_slot_t slots[SSD1306_MANAGER_MAX_DISPLAYS];
+    uint8_t count;
+    uint32_t (*clock)(void);
+  } ssd1306_manager_t;
+
+  void ssd1306_manager_init(ssd1306_manager_t *manager);
+  // display has to be prepared by ssd1306_init_display, bus is any id shared by
+  // the panels on the same bus, higher priority panels are sent first,
+  // returns the slot index or SSD1306_ERROR_INVALID_ARGUMENT
+  int ssd1306_manager_add(ssd1306_manager_t *manager, ssd1306_display_t *display, uint8_t bus, uint8_t priority);
+  // clock returns the time in the unit of ssd1306_manager_poll, NULL to use the poll time only
+  void ssd1306_manager_set_clock(ssd1306_manager_t *manager, uint32_t (*clock)(void));
+  // starts flushes on idle buses and advances running ones,
+  // returns SSD1306_ERROR_COMMUNICATION when a flush failed during this call
+  int ssd1306_manager_poll(ssd1306_manager_t *manager, uint32_t now);
+  // 1 when no flush is running or waiting
+  uint8_t ssd1306_manager_is_idle(const ssd1306_manager_t *manager);
+  const ssd1306_display_stats_t *ssd1306_manager_get_stats(const ssd1306_manager_t *manager, uint8_t index);
+  // bytes per 1000 time units (bytes/s with ms), 0 while no busy time was measured
+  uint32_t ssd1306_manager_get_throughput(const ssd1306_manager_t *manager, uint8_t index);
+  void ssd1306_manager_reset_stats(ssd1306_manager_t *manager);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __SSD1306_MANAGER_H_ */
@@ -13,6 +13,8 @@ extern "C" {
 
 
 size_t ssd1306_printf(char *str, ...);
+size_t ssd1306_snprintf(char *buffer, size_t size, char *str, ...);
+size_t ssd1306_vsnprintf(char *buffer, size_t size, char *str, va_list args);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,87 @@
+/*
+ * ssd1306_queue.h
+ *
+ * Lock-free ring of draw commands with many producers and one consumer.
+ * Interrupt handlers and tasks post commands without blocking, the render task
+ * drains them into the selected screen buffer and then displays it.
+ * Posting uses the GCC __atomic builtins (LDREX/STREX on Cortex-M3).
+ */
+
+#ifndef __SSD1306_QUEUE_H_
+#define __SSD1306_QUEUE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// commands in the ring, has to be a power of two
+#define SSD1306_QUEUE_SIZE 32
+// characters of a text run kept in the command itself
+#define SSD1306_QUEUE_TEXT_LENGTH 8
+
+#define SSD_QUEUE_PIXEL 0
+#define SSD_QUEUE_SPAN 1
+#define SSD_QUEUE_RECT 2
+#define SSD_QUEUE_TEXT 3
+#define SSD_QUEUE_BITMAP 4
+
+  typedef struct
+  {
+    uint8_t type;
+    uint8_t color; // SSD_COLOR_*, SSD_ROP_* for bitmaps
+    // 0 or a widget id, a waiting command is dropped when a newer one with
+    // the same tag is posted, so every part of a widget needs its own tag
+    uint16_t tag;
+    int16_t x;
+    int16_t y;
+    union
+    {
+      int16_t x1;                 // span end column
+      struct
+      {
+	int16_t width;
+	int16_t height;
+      } size;                     // rect
+      char text[SSD1306_QUEUE_TEXT_LENGTH]; // not terminated when full
+      struct
+      {
+	const uint8_t *bitmap;    // page-major, has to stay valid until drained
+	uint8_t width;
+	uint8_t height;
+      } bitmap;
+    } data;
+  } ssd1306_draw_command_t;
+
+  typedef struct
+  {
+    volatile uint32_t sequence;
+    ssd1306_draw_command_t command;
+  } ssd1306_queue_cell_t;
+
+  typedef struct
+  {
+    ssd1306_queue_cell_t cells[SSD1306_QUEUE_SIZE];
+    uint32_t post_position;
+    uint32_t drain_position;
+    uint32_t overflows; // commands lost to a full ring
+    uint32_t coalesced; // commands dropped for a newer one with the same tag
+  } ssd1306_queue_t;
+
+  void ssd1306_queue_init(ssd1306_queue_t *queue);
+  // returns SSD1306_ERROR_QUEUE_FULL when the ring is full
+  int ssd1306_queue_post(ssd1306_queue_t *queue, const ssd1306_draw_command_t *command);
+  int ssd1306_queue_pixel(ssd1306_queue_t *queue, uint16_t tag, int16_t x, int16_t y, uint8_t color);
+  int ssd1306_queue_span(ssd1306_queue_t *queue, uint16_t tag, int16_t x0, int16_t y, int16_t x1, uint8_t color);
+  int ssd1306_queue_rect(ssd1306_queue_t *queue, uint16_t tag, int16_t x, int16_t y, int16_t width, int16_t height, uint8_t color);
+  int ssd1306_queue_text(ssd1306_queue_t *queue, uint16_t tag, int16_t x, int16_t y, const char *text, uint8_t color);
+  int ssd1306_queue_bitmap(ssd1306_queue_t *queue, uint16_t tag, const uint8_t *bitmap, uint8_t width, uint8_t height,
+			   int16_t x, int16_t y, uint8_t rop);
+  // consumer side, draws up to max_commands and returns how many were taken
+  uint16_t ssd1306_queue_drain(ssd1306_queue_t *queue, uint16_t max_commands);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __SSD1306_QUEUE_H_ */
@@ -0,0 +1,81 @@
+/*
+ * ssd1306_sprite.h
+ *
+ * Animated sprites kept in the page-major layout of the screen buffer.
+ * Every update erases the moved or changed sprites, either by inverting them again
+ * or by restoring a copy of the background, and draws them at the new place,
+ * so only the old and new footprints are changed and sent.
+ */
+
+#ifndef __SSD1306_SPRITE_H_
+#define __SSD1306_SPRITE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define SSD1306_SPRITE_MAX 16
+
+// bytes of the pre-shifted copies of a sheet: every frame for each of the 8 row offsets,
+// with one more page than the frame
+#define SSD1306_SPRITE_SHIFTED_SIZE(width, height, frames) \
+  ((frames) * 8 * (width) * ((((height) + 7) >> 3) + 1))
+
+  typedef struct
+  {
+    const uint8_t *frames;  // page-major frames one after another, width bytes per page
+    const uint8_t *shifted; // set by ssd1306_sprite_preshift, 0 shifts while drawing
+    uint8_t width;
+    uint8_t height;
+    uint8_t frame_count;
+  } ssd1306_sprite_sheet_t;
+
+  typedef struct
+  {
+    const ssd1306_sprite_sheet_t *sheet;
+    int16_t x;
+    int16_t y;
+    int8_t velocity_x;      // pixels per update
+    int8_t velocity_y;
+    uint8_t frame;
+    uint8_t frame_ticks;    // updates per animation frame, 0 stops the animation
+    uint8_t tick;
+    uint8_t visible;
+    // what is on the screen now
+    uint8_t drawn;
+    uint8_t erased;
+    uint8_t drawn_frame;
+    int16_t drawn_x;
+    int16_t drawn_y;
+  } ssd1306_sprite_t;
+
+  typedef struct
+  {
+    ssd1306_sprite_t sprites[SSD1306_SPRITE_MAX];
+    uint8_t count;
+    // copy of the scene without sprites laid out like the drawing target (the screen buffer
+    // or the canvas the sprites are drawn to), sprites are drawn with SSD_ROP_OR and
+    // erased from it, without one they are drawn and erased with SSD_ROP_XOR
+    const uint8_t *background;
+  } ssd1306_sprite_engine_t;
+
+  // fills buffer of SSD1306_SPRITE_SHIFTED_SIZE bytes, the sheet then draws without shifting
+  void ssd1306_sprite_preshift(ssd1306_sprite_sheet_t *sheet, uint8_t *buffer);
+  void ssd1306_sprite_engine_init(ssd1306_sprite_engine_t *engine, const uint8_t *background);
+  // returns the sprite index or SSD1306_ERROR_INVALID_ARGUMENT
+  int ssd1306_sprite_add(ssd1306_sprite_engine_t *engine, const ssd1306_sprite_sheet_t *sheet, int16_t x, int16_t y);
+  void ssd1306_sprite_move(ssd1306_sprite_engine_t *engine, uint8_t index, int16_t x, int16_t y);
+  void ssd1306_sprite_set_velocity(ssd1306_sprite_engine_t *engine, uint8_t index, int8_t velocity_x, int8_t velocity_y);
+  void ssd1306_sprite_set_animation(ssd1306_sprite_engine_t *engine, uint8_t index, uint8_t frame, uint8_t frame_ticks);
+  void ssd1306_sprite_show(ssd1306_sprite_engine_t *engine, uint8_t index, uint8_t visible);
+  // advances every sprite by its velocity and animation, erases and draws the changed ones
+  void ssd1306_sprite_update(ssd1306_sprite_engine_t *engine);
+  // the screen was redrawn without the sprites, the next update draws all of them
+  void ssd1306_sprite_invalidate(ssd1306_sprite_engine_t *engine);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __SSD1306_SPRITE_H_ */
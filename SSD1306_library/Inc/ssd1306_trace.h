@@ -0,0 +1,175 @@
+/*
+ * ssd1306_trace.h
+ *
+ * Records the calls of the drawing, text, flush and settings functions with their
+ * arguments, a timestamp and the address they were called from into a ring buffer
+ * that can be dumped over any serial link. ssd1306_trace_replay runs a dump again,
+ * e.g. on a PC with the host transport, and sums up the rendering time and bus bytes
+ * of every call site. Only the outermost call is recorded, calls made by the library
+ * itself are part of it.
+ *
+ * Record: call id, argument count, time since the previous record, call site and
+ * the arguments, all but the first two bytes as LEB128 varints, arguments zigzag encoded.
+ * Fonts, bitmaps, layers, canvases, displays and buffers are recorded as their addresses on the device.
+ * Only the address of a bitmap is kept, not its content: a bitmap built in RAM between
+ * calls (the page columns of ssd1306_dither.c, pre-shifted sprite frames, grayscale
+ * planes) is replayed with whatever the host has at the resolved address.
+ */
+
+#ifndef __SSD1306_TRACE_H_
+#define __SSD1306_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define SSD_TRACE_DISPLAY 1
+#define SSD_TRACE_FLUSH_BEGIN 2
+#define SSD_TRACE_FLUSH_STEP 3
+#define SSD_TRACE_CLEAR_DISPLAY 4
+#define SSD_TRACE_DRAW_PIXEL 5
+#define SSD_TRACE_DRAW_LINE 6
+#define SSD_TRACE_DRAW_LINE_THICK 7
+#define SSD_TRACE_SET_LINE_PATTERN 8
+#define SSD_TRACE_SET_CLIP_RECT 9
+#define SSD_TRACE_RESET_CLIP_RECT 10
+#define SSD_TRACE_DRAW_H_LINE 11
+#define SSD_TRACE_DRAW_V_LINE 12
+#define SSD_TRACE_FILL_RECT 13
+#define SSD_TRACE_COPY_RECT 14
+#define SSD_TRACE_SCROLL_RECT 15
+#define SSD_TRACE_FILL_RECT_ROUND 16
+#define SSD_TRACE_FILL_CIRCLE 17
+#define SSD_TRACE_FILL_CIRCLE_QUARTER 18
+#define SSD_TRACE_DRAW_RECT 19
+#define SSD_TRACE_DRAW_RECT_ROUND 20
+#define SSD_TRACE_DRAW_CIRCLE 21
+#define SSD_TRACE_DRAW_CIRCLE_QUARTER 22
+#define SSD_TRACE_FILL_ELLIPSE 23
+#define SSD_TRACE_DRAW_ELLIPSE 24
+#define SSD_TRACE_FILL_ARC 25
+#define SSD_TRACE_DRAW_ARC 26
+#define SSD_TRACE_FILL_TRIANGLE 27
+#define SSD_TRACE_FILL_POLYGON 28 // count, fill rule, color, then the coordinates
+#define SSD_TRACE_DRAW_XBM 29
+#define SSD_TRACE_DRAW_PAGE_BITMAP 30
+#define SSD_TRACE_SET_FONT 31
+#define SSD_TRACE_WRITE 32 // ssd1306_printf records its characters with its own call site
+#define SSD_TRACE_DRAW_GLYPH 33
+#define SSD_TRACE_SET_CURSOR 34
+#define SSD_TRACE_SET_CURSOR_COORD 35
+#define SSD_TRACE_SET_CURSOR_COLUMN 36
+#define SSD_TRACE_SET_CURSOR_ROW 37
+#define SSD_TRACE_ADVANCE_CURSOR_ROW 38
+#define SSD_TRACE_SET_TEXT_OFFSET 39
+#define SSD_TRACE_SET_TEXT_SCALE 40
+#define SSD_TRACE_SET_TEXT_COLOR 41
+#define SSD_TRACE_SET_TEXT_LINE_SPACING 42
+#define SSD_TRACE_SET_TEXT_LETTER_SPACING 43
+#define SSD_TRACE_SET_CONTRAST 44
+#define SSD_TRACE_SET_DISPLAY_ON 45
+#define SSD_TRACE_INVERT_DISPLAY 46
+#define SSD_TRACE_FLIP_VERTICALLY 47
+#define SSD_TRACE_SET_ROTATION 48
+#define SSD_TRACE_FLUSH_COMMANDS 49
+#define SSD_TRACE_SET_FADE 50
+#define SSD_TRACE_SET_ZOOM 51
+#define SSD_TRACE_SEND_COMMAND 52
+#define SSD_TRACE_SEND_COMMAND_WITH_VALUE 53
+#define SSD_TRACE_MARK_UPDATED_WINDOW 54
+#define SSD_TRACE_SET_CLOCK_DIV 55
+#define SSD_TRACE_SET_MULTIPLEX_RATIO 56
+#define SSD_TRACE_SET_PRE_CHARGE 57
+#define SSD_TRACE_SELECT_DISPLAY 58
+#define SSD_TRACE_INIT 59
+#define SSD_TRACE_INIT_WARM 60
+#define SSD_TRACE_SET_WINDOW 61
+#define SSD_TRACE_TAKE_UPDATED_WINDOW 62
+#define SSD_TRACE_SEND_WINDOW 63
+#define SSD_TRACE_DISPLAY_EMPTY 64
+#define SSD_TRACE_DISPLAY_FULL 65
+#define SSD_TRACE_START_CONTRAST_RAMP 66
+#define SSD_TRACE_CONTRAST_RAMP_TICK 67
+#define SSD_TRACE_LAYER_INIT 68
+#define SSD_TRACE_ADD_LAYER 69
+#define SSD_TRACE_REMOVE_LAYER 70
+#define SSD_TRACE_SET_LAYER_BOUNDS 71
+#define SSD_TRACE_SHOW_LAYER 72
+#define SSD_TRACE_DRAW_TO_LAYER 73
+#define SSD_TRACE_CANVAS_INIT 74
+#define SSD_TRACE_DRAW_TO_CANVAS 75
+#define SSD_TRACE_DRAW_CANVAS 76
+#define SSD_TRACE_RESTORE_RECT 77
+
+#ifdef USE_TRACE
+
+  typedef struct
+  {
+    uint32_t site;      // address the call was made from on the device
+    uint8_t call;       // SSD_TRACE_*
+    uint32_t calls;
+    uint32_t bus_bytes; // command and data bytes sent by the calls
+    uint32_t time;      // in the unit of the replay clock
+  } ssd1306_trace_site_t;
+
+  typedef struct
+  {
+    // host copy of a font or bitmap at a device address, calls it returns NULL for are skipped,
+    // layers, canvases, displays and buffers (also addresses inside a buffer) resolve to host objects
+    // the replay writes to, the same object for every call with the address,
+    // a display has to be set up with its own transport, selecting the default display
+    // goes back to the display the replay started on
+    const void *(*resolve)(uint32_t address);
+    uint32_t (*clock)(void);            // may be NULL
+    void (*on_flush)(uint32_t time);    // after every replayed display or flush step, device time
+    ssd1306_trace_site_t *sites;        // filled by the replay
+    uint16_t site_capacity;
+    uint16_t site_count;
+    uint32_t calls;
+    uint32_t skipped;
+  } ssd1306_trace_replay_t;
+
+  // clock gives the timestamps in any unit, recording starts at once
+  void ssd1306_trace_start(uint8_t *buffer, uint16_t size, uint32_t (*clock)(void));
+  void ssd1306_trace_stop(void);
+  // records dropped to make room for newer ones since the start
+  uint32_t ssd1306_trace_dropped(void);
+  // writes the time of the first record (4 bytes, little endian) and the records, then empties the ring
+  uint32_t ssd1306_trace_dump(void (*write)(const uint8_t *bytes, uint16_t count));
+  // runs a dump against the selected display, returns SSD1306_ERROR_INVALID_ARGUMENT for a broken dump
+  int ssd1306_trace_replay(const uint8_t *dump, uint32_t length, ssd1306_trace_replay_t *replay);
+
+  uint8_t ssd1306_trace_enter(uint8_t call, void *site, const int32_t *arguments, uint8_t count);
+  void ssd1306_trace_leave(uint8_t *scope);
+  void ssd1306_trace_set_site(void *site);
+
+#define SSD1306_TRACE(call, ...) \
+  uint8_t trace_scope __attribute__((cleanup(ssd1306_trace_leave))) = \
+      ssd1306_trace_enter(call, __builtin_return_address(0), (const int32_t[]){__VA_ARGS__}, \
+			  sizeof((const int32_t[]){__VA_ARGS__}) / sizeof(int32_t))
+#define SSD1306_TRACE_ARRAY(call, arguments, count) \
+  uint8_t trace_scope __attribute__((cleanup(ssd1306_trace_leave))) = \
+      ssd1306_trace_enter(call, __builtin_return_address(0), arguments, count)
+#define SSD1306_TRACE_NO_ARGUMENTS(call) \
+  uint8_t trace_scope __attribute__((cleanup(ssd1306_trace_leave))) = \
+      ssd1306_trace_enter(call, __builtin_return_address(0), 0, 0)
+// calls made until SSD1306_TRACE_SITE_END are recorded with the site of the caller
+#define SSD1306_TRACE_SITE_BEGIN() ssd1306_trace_set_site(__builtin_return_address(0))
+#define SSD1306_TRACE_SITE_END() ssd1306_trace_set_site(0)
+#define SSD1306_TRACE_POINTER(pointer) ((int32_t)(uintptr_t)(pointer))
+
+#else
+#define SSD1306_TRACE(call, ...)
+#define SSD1306_TRACE_ARRAY(call, arguments, count)
+#define SSD1306_TRACE_NO_ARGUMENTS(call)
+#define SSD1306_TRACE_SITE_BEGIN()
+#define SSD1306_TRACE_SITE_END()
+#define SSD1306_TRACE_POINTER(pointer)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __SSD1306_TRACE_H_ */
@@ -0,0 +1,104 @@
+/*
+ * ssd1306_transport.h
+ *
+ * Bus backends used by the ssd1306 library to send command and data bytes.
+ */
+
+#ifndef __SSD1306_TRANSPORT_H_
+#define __SSD1306_TRANSPORT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define SSD1306_TRANSFER_COMMAND 0
+#define SSD1306_TRANSFER_DATA 1
+
+  typedef void (*ssd1306_transfer_done_t)(void *done_context, int result);
+
+  typedef struct
+  {
+    // opens a command or data transfer (SSD1306_TRANSFER_COMMAND/SSD1306_TRANSFER_DATA)
+    int (*begin)(void *context, uint8_t transfer_type);
+    // may be called several times between begin and end
+    int (*write)(void *context, const uint8_t *bytes, uint16_t count);
+    int (*end)(void *context);
+    // optional, starts a whole data transfer that completes in background (DMA),
+    // done is called with the result when the bus is free again, NULL if not supported
+    int (*write_data_async)(void *context, const uint8_t *bytes, uint16_t count,
+			    ssd1306_transfer_done_t done, void *done_context);
+    // optional, brings a stuck bus back (clock pulses, peripheral reset) before a retry,
+    // NULL if not supported
+    int (*recover)(void *context);
+  } ssd1306_transport_ops_t;
+
+  typedef struct
+  {
+    const ssd1306_transport_ops_t *ops;
+    void *context;
+  } ssd1306_transport_t;
+
+  // one I2C peripheral, handle (the peripheral instance) is passed to every function,
+  // write_async can be NULL when the bus has no DMA or interrupt driven transfers
+  typedef struct
+  {
+    void *handle;
+    int (*start)(void *handle, uint8_t address);
+    int (*write)(void *handle, const uint8_t *bytes, uint16_t count);
+    int (*stop)(void *handle);
+    // sends control and then bytes in one transaction in background,
+    // done is called with the result when the bus is free again
+    int (*write_async)(void *handle, uint8_t address, uint8_t control, const uint8_t *bytes, uint16_t count,
+		       ssd1306_transfer_done_t done, void *done_context);
+  } ssd1306_i2c_bus_t;
+
+  // I2C backend, context is ssd1306_i2c_t,
+  // bus NULL uses the i2cs driver, panels on other buses need their own ssd1306_i2c_bus_t
+  typedef struct
+  {
+    uint8_t address;
+    const ssd1306_i2c_bus_t *bus;
+  } ssd1306_i2c_t;
+  extern const ssd1306_transport_ops_t ssd1306_i2c_ops;
+
+  // 4-wire SPI backend, context is ssd1306_spi_t
+  // set_cs can be NULL when CS is tied low, spi_write_async can be NULL without DMA
+  typedef struct
+  {
+    int (*spi_write)(const uint8_t *bytes, uint16_t count);
+    int (*spi_write_async)(const uint8_t *bytes, uint16_t count, ssd1306_transfer_done_t done, void *done_context);
+    void (*set_dc)(uint8_t level);
+    void (*set_cs)(uint8_t level);
+    // filled by the backend while an async transfer is running
+    ssd1306_transfer_done_t pending_done;
+    void *pending_done_context;
+  } ssd1306_spi_t;
+  extern const ssd1306_transport_ops_t ssd1306_spi_ops;
+
+  // host stand-in backend, context is ssd1306_host_t
+  // decodes the command stream and keeps a copy of the controller GDDRAM,
+  // so the library can be run and checked on a PC
+  typedef struct
+  {
+    uint8_t gddram[8 * 128];
+    uint8_t column_start, column_end, page_start, page_end;
+    uint8_t column, page;
+    uint8_t transfer_type;
+    uint8_t pending_command;
+    uint8_t pending_arguments;
+    uint8_t argument_index;
+    uint8_t fail;                // when not 0 every call reports a communication error
+    uint32_t transfers;
+    uint32_t command_bytes;
+    uint32_t data_bytes;
+    uint32_t recoveries;
+  } ssd1306_host_t;
+  extern const ssd1306_transport_ops_t ssd1306_host_ops;
+  void ssd1306_host_reset(ssd1306_host_t *host);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __SSD1306_TRANSPORT_H_ */
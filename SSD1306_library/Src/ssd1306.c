@@ -3,6 +3,7 @@
  */
 
 #include <ssd1306.h>
+#include <ssd1306_trace.h>
 
 
 //////////////////////////////////////////////////////
@@ -26,13 +27,13 @@
 #define SSD_COMMAND_DEACTIVATE_SCROLL 0x2E
 #define SSD_COMMAND_SET_COLUMN_ADDRESS 0x21
 #define SSD_COMMAND_SET_PAGE_ADDRESS 0x22
+#define SSD_COMMAND_FADE_BLINK 0x23
+#define SSD_COMMAND_ZOOM_IN 0xD6
 
-#define SSD_DISPLAY_FLIP_HORIZONTALLY 0x1
-
+#define SSD_INIT_CONTRAST 0xF7
 
+#define SSD_DISPLAY_FLIP_HORIZONTALLY 0x1
 
-#define SSD_commandByte 0x00
-#define SSD_dataByte 0x40
 
 /////////////////////////////////////////////////////////
 
@@ -59,6 +60,9 @@ typedef struct
   uint8_t char_height;
 } font_parameters_t;
 static font_parameters_t font_parameters;
+static void read_font_parameters(const unsigned char *fonts, font_parameters_t *parameters);
+static uint8_t draw_glyph(const font_parameters_t *font, uint8_t c, int16_t x, int16_t y, uint8_t scale, uint8_t color);
+static uint8_t text_line_height(void);
 
 typedef struct
 {
@@ -67,245 +71,636 @@ typedef struct
 } cursor_coords_t;
 cursor_coords_t cursor_coords = {0, 0};
 
-static uint8_t screen_width = SCREEN_WIDTH;
-static uint8_t screen_height = SCREEN_HEIGHT;
+typedef struct
+{
+  uint32_t pattern;
+  uint8_t length;
+} line_pattern_t;
+static line_pattern_t line_pattern = {0xFFFFFFFF, 0};
+
+//rows of a circle or an axis aligned ellipse, see conic_begin
+typedef struct
+{
+  int64_t x_weight;
+  int64_t y_weight;
+  int64_t limit;
+  int16_t half_width;
+} conic_t;
+
+//angular range of arcs, directions are 2.14 fixed point with y up
+typedef struct
+{
+  int32_t start_x, start_y;
+  int32_t end_x, end_y;
+  uint8_t reflex; //more than a half turn
+  uint8_t full;
+} arc_sector_t;
 
 static int abs(int i);
-static void swap_uint8_t(uint8_t *a, uint8_t *b);
+static int32_t floor_div(int64_t numerator, int32_t divisor);
 static void swap_int16_t(int16_t *a, int16_t *b);
+static void draw_line_runs(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t thickness, uint8_t color);
+static void buffer_fill_rect(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t color);
+static void fill_rect_clipped(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t color);
+static void fill_span(uint8_t *ptr, uint16_t count, uint8_t mask, uint8_t color);
+static void buffer_copy_rect(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t dx, int16_t dy);
+static void buffer_restore_rect(const uint8_t *source, int16_t x0, int16_t y0, int16_t x1, int16_t y1);
+static void shift_span(uint8_t *destination, const uint8_t *upper, const uint8_t *lower, uint16_t count, uint8_t offset);
+static void mark_updated_area(int16_t x0, int16_t y0, int16_t x1, int16_t y1);
+static uint8_t page_clip_mask(int16_t page, int16_t y0, int16_t y1);
+static void apply_rop(uint8_t *destination, uint8_t bits, uint8_t mask, uint8_t rop);
+static void conic_begin(conic_t *conic, int16_t radius_x, int16_t radius_y);
+static int16_t conic_half_width(conic_t *conic, int16_t row);
+static void conic_draw_outline(conic_t *conic, int16_t mid_x, int16_t mid_y, const arc_sector_t *sector, uint8_t color);
+static void angle_direction(int16_t angle, int32_t *x, int32_t *y);
+static uint8_t arc_sector_begin(arc_sector_t *sector, int16_t start_angle, int16_t end_angle);
+static void half_plane_row(int32_t a, int32_t b, int32_t *x_min, int32_t *x_max);
+static void arc_fill_row(const arc_sector_t *sector, int16_t mid_x, int16_t mid_y, int16_t dy,
+			 int16_t x0, int16_t x1, uint8_t color);
+static uint8_t conic_inside(int16_t radius_x, int16_t radius_y, int32_t x, int32_t y);
+static uint8_t conic_outline_inside(int16_t radius_x, int16_t radius_y, int32_t x, int32_t y);
+static uint8_t arc_sector_inside(const arc_sector_t *sector, int32_t x, int32_t dy);
+
+#ifdef USE_CHARACTER_MODE
+#ifdef USE_WARM_RESTART
+#error "USE_WARM_RESTART retains the screen buffer USE_CHARACTER_MODE leaves out"
+#endif
+//what the panel shows in every character cell of the panel without a screen buffer
+static struct
+{
+  uint8_t codes[SSD1306_CHARACTER_CELLS]; // 0 for an empty cell
+  uint8_t known[(SSD1306_CHARACTER_CELLS + 7) / 8];
+  //cells are known for this font, width and color only
+  const unsigned char *font;
+  uint8_t glyph_width;  // widest glyph of the font
+  uint8_t cell_width;
+  uint8_t color;
+} character_cells;
+static int character_write(uint8_t c);
+static void character_fill(uint8_t color);
+#define screen_buffer 0
+#elif defined(USE_WARM_RESTART)
+//screen buffer and the signature of the last sent frame survive a reset,
+//so the panel content can be taken over without a clear and redraw
+#define RETAINED_FRAME_MAGIC 0x55D13060
+typedef struct
+{
+  uint32_t magic;
+  uint32_t frame_crc;
+  uint8_t rotation;
+} retained_frame_t;
+static retained_frame_t retained_frame __attribute__((section(".noinit")));
+static uint8_t screen_buffer[SCREEN_BUFFER_SIZE] __attribute__((section(".noinit"), aligned(4)));
+static uint8_t warm_started = 0;
+static uint32_t crc32_buffer(const uint8_t *data, uint16_t length);
+static void retain_frame(void);
+#else
+static uint8_t screen_buffer[SCREEN_BUFFER_SIZE] __attribute__((aligned(4))) = {0};
+#endif
 
-static uint8_t screen_buffer[(SCREEN_WIDTH * ((SCREEN_HEIGHT + 7) / 8))] = {0};
-static uint8_t was_buffer_updated = 0;
-static uint16_t updated_pixel_min_x = 255, updated_pixel_min_y = 255, updated_pixel_max_x = 0, updated_pixel_max_y = 0;
-
-static const uint8_t addr_res_cmd_list[] = {
-    SSD_commandByte,
-    SSD_COMMAND_SET_PAGE_ADDRESS,
-    0x00, SCREEN_HEIGHT - 1,
-    SSD_COMMAND_SET_COLUMN_ADDRESS,
-    0x00, (SCREEN_WIDTH - 1)
+#ifdef USE_I2C_TRANSPORT
+static ssd1306_i2c_t default_i2c = {OLED_ADDRESS, 0};
+#define DEFAULT_TRANSPORT {&ssd1306_i2c_ops, &default_i2c}
+#else
+#define DEFAULT_TRANSPORT {0, 0}
+#endif
+//panel used until ssd1306_select_display picks another one
+static ssd1306_display_t default_display = {
+    screen_buffer,
+    SCREEN_WIDTH,
+    SCREEN_HEIGHT,
+    DEFAULT_TRANSPORT,
+    SSD_ROTATION_0,
+    0,
+    SCREEN_WIDTH,
+    SCREEN_HEIGHT,
+    {0, 0, SCREEN_WIDTH - 1, SCREEN_HEIGHT - 1},
+    0,
+    255, 255, 0, 0,
+    0,
+    0, 0, 0,
+    0, 0,
+    {0, 0, 0, 0, 0},
+    screen_buffer,
+    0,
+    0,
+    0,
+    0,
+    {0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0},
+    {1, 8, SCREEN_HEIGHT, 2, 2},
+#ifdef USE_COMMAND_QUEUE
+    {0},
+    0
+#endif
 };
+//every drawing and display function works on this panel
+static ssd1306_display_t *display = &default_display;
+static int ssd1306_send_command_list(const uint8_t *commands, uint8_t count);
+static int ssd1306_send_command_frame(const uint8_t *commands, uint8_t count);
+static void flush_cancel(void);
+static int flush_run(void);
+static uint16_t flush_remaining_bytes(void);
+static int transfer_abort(void);
+static void update_screen_size(void);
+static int flush_write(uint8_t page, uint8_t column, uint16_t count);
+static int flush_write_composed(uint8_t page, uint8_t column, uint16_t count);
+static void compose_span(uint8_t *destination, const uint8_t *source, const uint8_t *mask, uint16_t count, uint8_t rop);
+
+//word access to byte buffers, the compiler may not assume it does not alias them
+typedef uint32_t __attribute__((may_alias)) buffer_word_t;
+
+//the kernels below take their plain per-pixel path, see USE_REFERENCE_RASTER
+#ifdef SSD1306_RASTER_SWITCH
+uint8_t ssd1306_reference_raster;
+#define REFERENCE_RASTER ssd1306_reference_raster
+#elif defined(USE_REFERENCE_RASTER)
+#define REFERENCE_RASTER 1
+#else
+#define REFERENCE_RASTER 0
+#endif
+static void buffer_put_pixel(int16_t x, int16_t y, uint8_t color);
+
+typedef struct
+{
+  uint8_t retries;
+  uint16_t backoff_first;
+  uint16_t backoff_max;
+  void (*delay)(uint16_t time);
+} retry_policy_t;
+static retry_policy_t retry_policy = {SSD1306_DEFAULT_RETRIES, 1, 16, 0};
+
+static struct
+{
+  uint32_t (*clock)(void);
+  void (*wait)(uint32_t microseconds);
+  uint32_t origin;
+} flush_pacing;
+
+
+
+
+void ssd1306_set_transport(const ssd1306_transport_t *new_transport)
+{
+  display->transport = *new_transport;
+}
+
+void ssd1306_init_display(ssd1306_display_t *new_display, uint8_t *buffer, const ssd1306_transport_t *transport)
+{
+  uint8_t *ptr = (uint8_t *)new_display;
+  uint16_t size = sizeof(ssd1306_display_t);
+  while(size--) *ptr++ = 0;
+  new_display->buffer = buffer;
+  new_display->base_buffer = buffer;
+  new_display->buffer_width = SCREEN_WIDTH;
+  new_display->buffer_height = SCREEN_HEIGHT;
+  new_display->transport = *transport;
+  new_display->rotation = SSD_ROTATION_0;
+  new_display->screen_width = SCREEN_WIDTH;
+  new_display->screen_height = SCREEN_HEIGHT;
+  new_display->clip_rect.x1 = SCREEN_WIDTH - 1;
+  new_display->clip_rect.y1 = SCREEN_HEIGHT - 1;
+  new_display->updated_pixel_min_x = 255;
+  new_display->updated_pixel_min_y = 255;
+  new_display->timing = default_display.timing;
+  for(uint16_t i = 0; i < SCREEN_BUFFER_SIZE; i++) buffer[i] = 0;
+}
 
+void ssd1306_select_display(ssd1306_display_t *new_display)
+{
+  SSD1306_TRACE(SSD_TRACE_SELECT_DISPLAY, SSD1306_TRACE_POINTER(new_display));
+  display = new_display ? new_display : &default_display;
+}
 
+ssd1306_display_t *ssd1306_get_display(void)
+{
+  return display;
+}
 
 int ssd1306_init(void)
 {
+  SSD1306_TRACE_NO_ARGUMENTS(SSD_TRACE_INIT);
+#ifdef USE_WARM_RESTART
+  if(display == &default_display)
+    {
+      warm_started = 0;
+      retained_frame.magic = 0;
+    }
+#endif
   return ssd1306_send_init_sequence();
 }
 
+#ifdef USE_WARM_RESTART
+//takes over the panel content left from before the reset when the retained
+//screen buffer still matches the last sent frame, otherwise does a full init,
+//only the default panel is retained
+int ssd1306_init_warm(void)
+{
+  SSD1306_TRACE_NO_ARGUMENTS(SSD_TRACE_INIT_WARM);
+  display = &default_display;
+  if(retained_frame.magic != RETAINED_FRAME_MAGIC
+      || retained_frame.frame_crc != crc32_buffer(display->base_buffer, SCREEN_BUFFER_SIZE))
+    {
+      return ssd1306_init();
+    }
+  //the panel keeps its configuration through an MCU reset,
+  //only the addressing mode and display on are sent again
+  const uint8_t commands[] = {
+      SSD_COMMAND_MEMORY_ADDRESSING_MODE,
+      0x00,
+      SSD_COMMAND_DISPLAY_ON
+  };
+  display->rotation = retained_frame.rotation & 0b11;
+  update_screen_size();
+  if(ssd1306_send_command_frame(commands, sizeof(commands)) != SSD1306_SUCCESS) return ssd1306_init();
+  warm_started = 1;
+  return SSD1306_SUCCESS;
+}
+
+uint8_t ssd1306_is_warm_started(void)
+{
+  return warm_started;
+}
+#endif
+
 //put pixel in buffer
 void ssd1306_draw_pixel(int16_t x, int16_t y, uint8_t color)
 {
-  if(x >= screen_width || y >= screen_height || x < 0 || y < 0) return;
+  SSD1306_TRACE(SSD_TRACE_DRAW_PIXEL, x, y, color);
+  if(x > display->clip_rect.x1 || y > display->clip_rect.y1 || x < display->clip_rect.x0 || y < display->clip_rect.y0) return;
+  if(display->rotation & SSD_ROTATION_90)
+    {
+      int16_t temp = x;
+      x = (SCREEN_WIDTH - 1) - y;
+      y = temp;
+    }
 #ifdef USE_QUICK_DISPLAY
-  was_buffer_updated = 1;
-  if(updated_pixel_min_x > x) updated_pixel_min_x = x;
-  if(updated_pixel_max_x < x) updated_pixel_max_x = x;
-  if(updated_pixel_min_y > y) updated_pixel_min_y = y;
-  if(updated_pixel_max_y < y) updated_pixel_max_y = y;
+  if(!display->canvas)
+    {
+      display->was_buffer_updated = 1;
+      if(display->updated_pixel_min_x > x) display->updated_pixel_min_x = x;
+      if(display->updated_pixel_max_x < x) display->updated_pixel_max_x = x;
+      if(display->updated_pixel_min_y > y) display->updated_pixel_min_y = y;
+      if(display->updated_pixel_max_y < y) display->updated_pixel_max_y = y;
+    }
 #endif
   switch (color) {
     case SSD_COLOR_BLACK:
-      screen_buffer[((int)((y >> 3) * (screen_width)) + x)] &= ~(1 << (y & 0b111));
+      display->buffer[((int)((y >> 3) * display->buffer_width) + x)] &= ~(1 << (y & 0b111));
       break;
     case SSD_COLOR_WHITE:
-      screen_buffer[((int)((y >> 3) * (screen_width)) + x)] |= (1 << (y & 0b111));
+      display->buffer[((int)((y >> 3) * display->buffer_width) + x)] |= (1 << (y & 0b111));
       break;
     default:
-      screen_buffer[((int)((y >> 3) * (screen_width)) + x)] ^= (1 << (y & 0b111));
+      display->buffer[((int)((y >> 3) * display->buffer_width) + x)] ^= (1 << (y & 0b111));
       break;
   }
 }
 
-//draw line function
-void ssd1306_draw_line(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t color)
+//read back a pixel from the buffer, returns SSD_COLOR_BLACK outside of the screen
+uint8_t ssd1306_get_pixel(int16_t x, int16_t y)
 {
-  x0 = (x0 < screen_width) ? x0 : (screen_width - 1);
-  y0 = (y0 < screen_height) ? y0 : (screen_height - 1);
-  x1 = (x1 < screen_width) ? x1 : (screen_width - 1);
-  y1 = (y1 < screen_height) ? y1 : (screen_height - 1);
-  int16_t slopeDirection = 1;
-  uint8_t swapped = 0;
-
-  if (y1 == y0)
-    {
-      ssd1306_draw_h_line(x0, y0, x1, color);
-      return;
-    }
-  else if (x0 == x1)
+  if(x >= display->screen_width || y >= display->screen_height || x < 0 || y < 0) return SSD_COLOR_BLACK;
+  if(display->rotation & SSD_ROTATION_90)
     {
-      ssd1306_draw_v_line(x0, y0, y1, color);
-      return;
+      int16_t temp = x;
+      x = (SCREEN_WIDTH - 1) - y;
+      y = temp;
     }
+  return (display->buffer[((int)((y >> 3) * display->buffer_width) + x)] >> (y & 0b111)) & 1;
+}
 
-  if (abs(x1 - x0) < abs(y1 - y0))
-    {
-      swapped = 1;
-      swap_uint8_t(&x0, &y0);
-      swap_uint8_t(&x1, &y1);
-    }
+//page-major drawing target, SCREEN_WIDTH bytes per page in panel orientation, the canvas while one is drawn to
+const uint8_t *ssd1306_get_buffer(void)
+{
+  return display->buffer;
+}
 
-  if (x0 > x1)
-    {
-      swap_uint8_t(&x0, &x1);
-      swap_uint8_t(&y0, &y1);
-    }
+//draw line function
+void ssd1306_draw_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t color)
+{
+  SSD1306_TRACE(SSD_TRACE_DRAW_LINE, x0, y0, x1, y1, color);
+  draw_line_runs(x0, y0, x1, y1, 1, color);
+}
 
-  if (y1 < y0) slopeDirection = -1;
+//thickness grows the line across its major axis, centred on the thin line
+void ssd1306_draw_line_thick(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t thickness, uint8_t color)
+{
+  SSD1306_TRACE(SSD_TRACE_DRAW_LINE_THICK, x0, y0, x1, y1, thickness, color);
+  if(thickness < 1) return;
+  draw_line_runs(x0, y0, x1, y1, thickness, color);
+}
 
-  uint8_t dx = x1 - x0;
-  uint8_t dy = abs(y1 - y0);
+//pattern bit n (from bit 0) tells if pixel n of a line is drawn, repeats every length pixels,
+//length 0 draws solid lines
+void ssd1306_set_line_pattern(uint32_t pattern, uint8_t length)
+{
+  SSD1306_TRACE(SSD_TRACE_SET_LINE_PATTERN, pattern, length);
+  line_pattern.pattern = pattern;
+  line_pattern.length = length > 32 ? 32 : length;
+}
 
-  int16_t err = dx >> 1;
+//drawing is limited to the rectangle, it is reset by rotation changes
+void ssd1306_set_clip_rect(int16_t x, int16_t y, int16_t width, int16_t height)
+{
+  SSD1306_TRACE(SSD_TRACE_SET_CLIP_RECT, x, y, width, height);
+  display->clip_rect.x0 = x < 0 ? 0 : x;
+  display->clip_rect.y0 = y < 0 ? 0 : y;
+  display->clip_rect.x1 = x + width - 1 >= display->screen_width ? display->screen_width - 1 : x + width - 1;
+  display->clip_rect.y1 = y + height - 1 >= display->screen_height ? display->screen_height - 1 : y + height - 1;
+}
 
-  for (; x0 <= x1; x0++)
-    {
-      ssd1306_draw_pixel(swapped ? y0 : x0, swapped ? x0 : y0, color);
-      err -= dy;
-      if (err < 0)
-	{
-	  err += dx;
-	  y0 += slopeDirection;
-	}
-    }
+void ssd1306_reset_clip_rect(void)
+{
+  SSD1306_TRACE_NO_ARGUMENTS(SSD_TRACE_RESET_CLIP_RECT);
+  display->clip_rect.x0 = 0;
+  display->clip_rect.y0 = 0;
+  display->clip_rect.x1 = display->screen_width - 1;
+  display->clip_rect.y1 = display->screen_height - 1;
 }
 
 void ssd1306_draw_h_line(int16_t x0, int16_t y0, int16_t x1, uint8_t color)
 {
-  y0 = (y0 < screen_height) ? y0 : (screen_height - 1);
-  x0 = (x0 < screen_width) ? x0 : (screen_width - 1);
-  x1 = (x1 < screen_width) ? x1 : (screen_width - 1);
-  y0 = (y0 >= 0) ? y0 : (0);
-  x0 = (x0 >= 0) ? x0 : (0);
-  x1 = (x1 >= 0) ? x1 : (0);
+  SSD1306_TRACE(SSD_TRACE_DRAW_H_LINE, x0, y0, x1, color);
+  fill_rect_clipped(x0, y0, x1, y0, color);
+}
 
-  if (x0 > x1) swap_int16_t(&x0, &x1);
+void ssd1306_draw_v_line(int16_t x0, int16_t y0, int16_t y1, uint8_t color)
+{
+  SSD1306_TRACE(SSD_TRACE_DRAW_V_LINE, x0, y0, y1, color);
+  fill_rect_clipped(x0, y0, x0, y1, color);
+}
+
+void ssd1306_fill_rect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t color)
+{
+  SSD1306_TRACE(SSD_TRACE_FILL_RECT, x, y, width, height, color);
+  if(width < 1 || height < 1) return;
+  fill_rect_clipped(x, y, x + width - 1, y + height - 1, color);
+}
 
-  for (; x0 <= x1; x0++)
+//copies a rectangle of the screen to to_x, to_y, the rectangles may overlap,
+//destination pixels whose source is outside of the screen are left as they are
+void ssd1306_copy_rect(int16_t x, int16_t y, int16_t width, int16_t height, int16_t to_x, int16_t to_y)
+{
+  SSD1306_TRACE(SSD_TRACE_COPY_RECT, x, y, width, height, to_x, to_y);
+  if(width < 1 || height < 1) return;
+  int16_t dx = to_x - x, dy = to_y - y, temp;
+  int16_t x0 = to_x, y0 = to_y, x1 = to_x + width - 1, y1 = to_y + height - 1;
+  if(x0 < display->clip_rect.x0) x0 = display->clip_rect.x0;
+  if(y0 < display->clip_rect.y0) y0 = display->clip_rect.y0;
+  if(x1 > display->clip_rect.x1) x1 = display->clip_rect.x1;
+  if(y1 > display->clip_rect.y1) y1 = display->clip_rect.y1;
+  if(x0 < dx) x0 = dx;
+  if(y0 < dy) y0 = dy;
+  if(x1 > display->screen_width - 1 + dx) x1 = display->screen_width - 1 + dx;
+  if(y1 > display->screen_height - 1 + dy) y1 = display->screen_height - 1 + dy;
+  if(x0 > x1 || y0 > y1) return;
+  if(display->rotation & SSD_ROTATION_90)
     {
-      ssd1306_draw_pixel(x0, y0, color);
+      temp = x0;
+      x0 = (SCREEN_WIDTH - 1) - y1;
+      y1 = x1;
+      x1 = (SCREEN_WIDTH - 1) - y0;
+      y0 = temp;
+      temp = dx;
+      dx = -dy;
+      dy = temp;
     }
+  buffer_copy_rect(x0 - dx, y0 - dy, x1 - dx, y1 - dy, dx, dy);
 }
 
-void ssd1306_draw_v_line(int16_t x0, int16_t y0, int16_t y1, uint8_t color)
+//copies a rectangle from source, a buffer with the layout of the drawing target
+//(a copy of the screen buffer or of the canvas), to the same place of the target
+void ssd1306_restore_rect(const uint8_t *source, int16_t x, int16_t y, int16_t width, int16_t height)
 {
-  y0 = (y0 < screen_height) ? y0 : (screen_height - 1);
-  x0 = (x0 < screen_width) ? x0 : (screen_width - 1);
-  y1 = (y1 < screen_height) ? y1 : (screen_height - 1);
-  y0 = (y0 >= 0) ? y0 : (0);
-  x0 = (x0 >= 0) ? x0 : (0);
-  y1 = (y1 >= 0) ? y1 : (0);
-
-  if (y0 > y1) swap_int16_t(&y0, &y1);
-
-  for (; y0 <= y1; y0++)
+  SSD1306_TRACE(SSD_TRACE_RESTORE_RECT, SSD1306_TRACE_POINTER(source), x, y, width, height);
+  if(!source || width < 1 || height < 1) return;
+  int16_t x0 = x, y0 = y, x1 = x + width - 1, y1 = y + height - 1, temp;
+  if(x0 < display->clip_rect.x0) x0 = display->clip_rect.x0;
+  if(y0 < display->clip_rect.y0) y0 = display->clip_rect.y0;
+  if(x1 > display->clip_rect.x1) x1 = display->clip_rect.x1;
+  if(y1 > display->clip_rect.y1) y1 = display->clip_rect.y1;
+  if(x0 > x1 || y0 > y1) return;
+  if(display->rotation & SSD_ROTATION_90)
     {
-      ssd1306_draw_pixel(x0, y0, color);
+      temp = x0;
+      x0 = (display->buffer_width - 1) - y1;
+      y1 = x1;
+      x1 = (display->buffer_width - 1) - y0;
+      y0 = temp;
     }
+  if(x1 > display->buffer_width - 1) x1 = display->buffer_width - 1;
+  if(y1 > display->buffer_height - 1) y1 = display->buffer_height - 1;
+  if(x0 > x1 || y0 > y1) return;
+  buffer_restore_rect(source, x0, y0, x1, y1);
 }
 
-void ssd1306_fill_rect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t color)
+//moves the content of a rectangle by dx, dy, the uncovered part is filled with color
+void ssd1306_scroll_rect(int16_t x, int16_t y, int16_t width, int16_t height, int16_t dx, int16_t dy, uint8_t color)
 {
-  width--;
-  for(uint8_t i = 0; i < height; i++)
+  SSD1306_TRACE(SSD_TRACE_SCROLL_RECT, x, y, width, height, dx, dy, color);
+  if(width < 1 || height < 1) return;
+  int16_t x1 = x + width - 1, y1 = y + height - 1;
+  if(dx >= width || dx <= -width || dy >= height || dy <= -height)
     {
-      ssd1306_draw_h_line(x, y + i, x + width, color);
+      fill_rect_clipped(x, y, x1, y1, color);
+      return;
     }
+  ssd1306_copy_rect(dx < 0 ? x - dx : x, dy < 0 ? y - dy : y,
+		    width - (dx < 0 ? -dx : dx), height - (dy < 0 ? -dy : dy),
+		    dx > 0 ? x + dx : x, dy > 0 ? y + dy : y);
+  if(dy > 0) fill_rect_clipped(x, y, x1, y + dy - 1, color);
+  else if(dy < 0) fill_rect_clipped(x, y1 + dy + 1, x1, y1, color);
+  //the side strip leaves out the corner filled already, SSD_COLOR_INVERSE would undo it
+  if(dy > 0) y += dy;
+  else y1 += dy;
+  if(dx > 0) fill_rect_clipped(x, y, x + dx - 1, y1, color);
+  else if(dx < 0) fill_rect_clipped(x1 + dx + 1, y, x1, y1, color);
 }
 
 void ssd1306_fill_rect_round(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t cornerRadius, uint8_t color)
 {
+  SSD1306_TRACE(SSD_TRACE_FILL_RECT_ROUND, x, y, width, height, cornerRadius, color);
   if(width < 1 || height < 1) return;
   width--;
   height--;
+  //the corners may not overlap
+  if(cornerRadius > width / 2) cornerRadius = width / 2;
+  if(cornerRadius > height / 2) cornerRadius = height / 2;
 
-  ssd1306_fill_circle_quarter(x + width - cornerRadius, y + cornerRadius, cornerRadius, 0, color);
-  ssd1306_fill_circle_quarter(x + cornerRadius, y + cornerRadius, cornerRadius, 1, color);
-  ssd1306_fill_circle_quarter(x + cornerRadius, y + height - cornerRadius, cornerRadius, 2, color);
-  ssd1306_fill_circle_quarter(x + width - cornerRadius, y + height - cornerRadius, cornerRadius, 3, color);
-
-  for(uint8_t i = 0; i < height + 1; i++)
+  if(REFERENCE_RASTER)
+    {
+      for(int16_t py = y; py <= y + height; py++)
+	for(int16_t px = x; px <= x + width; px++)
+	  {
+	    //distance to the nearest corner centre, 0 between the corners
+	    int16_t dx = 0, dy = 0;
+	    if(px < x + cornerRadius) dx = x + cornerRadius - px;
+	    else if(px > x + width - cornerRadius) dx = px - (x + width - cornerRadius);
+	    if(py < y + cornerRadius) dy = y + cornerRadius - py;
+	    else if(py > y + height - cornerRadius) dy = py - (y + height - cornerRadius);
+	    if(conic_inside(cornerRadius, cornerRadius, dx, dy)) ssd1306_draw_pixel(px, py, color);
+	  }
+      return;
+    }
+  conic_t corner;
+  conic_begin(&corner, cornerRadius, cornerRadius);
+  for(int16_t row = 0; row <= cornerRadius; row++)
     {
-      if(cornerRadius >= i || height - cornerRadius <= i) ssd1306_draw_h_line(x + cornerRadius + 1 , y + i , x + width- cornerRadius - 1, color);
-      else ssd1306_draw_h_line(x, y + i, x + width, color);
+      int16_t half_width = conic_half_width(&corner, row);
+      fill_rect_clipped(x + cornerRadius - half_width, y + cornerRadius - row,
+			x + width - cornerRadius + half_width, y + cornerRadius - row, color);
+      //the centre rows of both corners are the same row when height is 2 * cornerRadius
+      if(row == 0 && height == 2 * cornerRadius) continue;
+      fill_rect_clipped(x + cornerRadius - half_width, y + height - cornerRadius + row,
+			x + width - cornerRadius + half_width, y + height - cornerRadius + row, color);
     }
+  if(height > 2 * cornerRadius + 1)
+    fill_rect_clipped(x, y + cornerRadius + 1, x + width, y + height - cornerRadius - 1, color);
 }
 
 void ssd1306_fill_circle(uint8_t midX, uint8_t midY, uint8_t radius, uint8_t color)
 {
-  uint32_t x = radius, y = 0, radiusThreshold = radius * radius + radius;
-  ssd1306_draw_h_line(midX - x, midY, midX + x, color);
-
-  while (x > y) {
-      y++;
-
-      if (radiusThreshold < (x * x + y * y)) {
-
-	  ssd1306_draw_h_line(midX - y + 1, midY - x, midX + y - 1, color);
-	  ssd1306_draw_h_line(midX - y + 1, midY + x, midX + y - 1, color);
-
-	  x--;
-      }
-      if(x < y) break;
-
-      ssd1306_draw_h_line(midX - x, midY + y, midX + x, color);
-      ssd1306_draw_h_line(midX - x, midY - y, midX + x, color);
-  }
+  SSD1306_TRACE(SSD_TRACE_FILL_CIRCLE, midX, midY, radius, color);
+  ssd1306_fill_ellipse(midX, midY, radius, radius, color);
 }
 
 void ssd1306_fill_circle_quarter(uint8_t midX, uint8_t midY, uint8_t radius, uint8_t quarter, uint8_t color)
 {
-  uint32_t x = radius, y = 0, radiusThreshold = radius * radius + radius;
-  if(quarter == 0 || quarter == 3) ssd1306_draw_h_line(midX, midY, midX + x, color);
-  else ssd1306_draw_h_line(midX - x, midY, midX, color);
-
-  while (x > y) {
-      y++;
-
-      if (radiusThreshold < (x * x + y * y)) {
-	  switch (quarter)
+  SSD1306_TRACE(SSD_TRACE_FILL_CIRCLE_QUARTER, midX, midY, radius, quarter, color);
+  if(REFERENCE_RASTER)
+    {
+      if(quarter > 3) return;
+      for(int16_t dy = -radius; dy <= radius; dy++)
+	for(int16_t dx = -radius; dx <= radius; dx++)
 	  {
-	    case 0:
-	      ssd1306_draw_h_line(midX, midY - x, midX + y - 1, color);
-	      break;
-	    case 1:
-	      ssd1306_draw_h_line(midX - y + 1, midY - x, midX, color);
-	      break;
-	    case 2:
-	      ssd1306_draw_h_line(midX - y + 1, midY + x, midX, color);
-	      break;
-	    case 3:
-	      ssd1306_draw_h_line(midX, midY + x, midX + y - 1, color);
-	      break;
-	    default:
-	      break;
+	    //both quarters next to a centre line include it
+	    if((quarter == 0 || quarter == 3) ? dx < 0 : dx > 0) continue;
+	    if(quarter < 2 ? dy > 0 : dy < 0) continue;
+	    if(conic_inside(radius, radius, dx, dy)) ssd1306_draw_pixel(midX + dx, midY + dy, color);
 	  }
-	  x--;
-      }
-      if(x < y) break;
-
+      return;
+    }
+  conic_t circle;
+  conic_begin(&circle, radius, radius);
+  for(int16_t row = 0; row <= radius; row++)
+    {
+      int16_t half_width = conic_half_width(&circle, row);
       switch (quarter)
       {
 	case 0:
-	  ssd1306_draw_h_line(midX, midY - y, midX + x, color);
+	  fill_rect_clipped(midX, midY - row, midX + half_width, midY - row, color);
 	  break;
 	case 1:
-	  ssd1306_draw_h_line(midX - x, midY - y, midX, color);
+	  fill_rect_clipped(midX - half_width, midY - row, midX, midY - row, color);
 	  break;
 	case 2:
-	  ssd1306_draw_h_line(midX - x, midY + y, midX, color);
+	  fill_rect_clipped(midX - half_width, midY + row, midX, midY + row, color);
 	  break;
 	case 3:
-	  ssd1306_draw_h_line(midX, midY + y, midX + x, color);
+	  fill_rect_clipped(midX, midY + row, midX + half_width, midY + row, color);
 	  break;
 	default:
 	  break;
       }
-  }
+    }
+}
+
+void ssd1306_fill_ellipse(int16_t midX, int16_t midY, uint8_t radiusX, uint8_t radiusY, uint8_t color)
+{
+  SSD1306_TRACE(SSD_TRACE_FILL_ELLIPSE, midX, midY, radiusX, radiusY, color);
+  if(REFERENCE_RASTER)
+    {
+      for(int16_t dy = -radiusY; dy <= radiusY; dy++)
+	for(int16_t dx = -radiusX; dx <= radiusX; dx++)
+	  if(conic_inside(radiusX, radiusY, dx, dy)) ssd1306_draw_pixel(midX + dx, midY + dy, color);
+      return;
+    }
+  conic_t ellipse;
+  conic_begin(&ellipse, radiusX, radiusY);
+  for(int16_t row = 0; row <= radiusY; row++)
+    {
+      int16_t half_width = conic_half_width(&ellipse, row);
+      fill_rect_clipped(midX - half_width, midY - row, midX + half_width, midY - row, color);
+      if(row != 0) fill_rect_clipped(midX - half_width, midY + row, midX + half_width, midY + row, color);
+    }
+}
+
+void ssd1306_draw_ellipse(int16_t midX, int16_t midY, uint8_t radiusX, uint8_t radiusY, uint8_t color)
+{
+  SSD1306_TRACE(SSD_TRACE_DRAW_ELLIPSE, midX, midY, radiusX, radiusY, color);
+  if(REFERENCE_RASTER)
+    {
+      for(int16_t dy = -radiusY; dy <= radiusY; dy++)
+	for(int16_t dx = -radiusX; dx <= radiusX; dx++)
+	  if(conic_outline_inside(radiusX, radiusY, dx, dy)) ssd1306_draw_pixel(midX + dx, midY + dy, color);
+      return;
+    }
+  conic_t ellipse;
+  conic_begin(&ellipse, radiusX, radiusY);
+  conic_draw_outline(&ellipse, midX, midY, 0, color);
+}
+
+//pie slice (innerRadius 0) or ring segment from startAngle counter-clockwise to endAngle,
+//angles are in degrees with 0 at 3 o'clock, the ring keeps pixels from innerRadius to radius
+void ssd1306_fill_arc(int16_t midX, int16_t midY, uint8_t radius, uint8_t innerRadius,
+		      int16_t startAngle, int16_t endAngle, uint8_t color)
+{
+  SSD1306_TRACE(SSD_TRACE_FILL_ARC, midX, midY, radius, innerRadius, startAngle, endAngle, color);
+  arc_sector_t sector;
+  conic_t outer, inner;
+  if(!arc_sector_begin(&sector, startAngle, endAngle)) return;
+  if(REFERENCE_RASTER)
+    {
+      for(int16_t dy = -radius; dy <= radius; dy++)
+	for(int16_t dx = -radius; dx <= radius; dx++)
+	  if(conic_inside(radius, radius, dx, dy) && !conic_inside(innerRadius - 1, innerRadius - 1, dx, dy) &&
+	     arc_sector_inside(&sector, dx, dy))
+	    ssd1306_draw_pixel(midX + dx, midY + dy, color);
+      return;
+    }
+  conic_begin(&outer, radius, radius);
+  //the ring leaves out the disc of innerRadius - 1
+  conic_begin(&inner, innerRadius - 1, innerRadius - 1);
+  for(int16_t row = 0; row <= radius; row++)
+    {
+      int16_t outer_width = conic_half_width(&outer, row);
+      int16_t inner_width = conic_half_width(&inner, row);
+      for(int16_t side = -1; side <= 1; side += 2)
+	{
+	  if(row == 0 && side > 0) break;
+	  if(inner_width < 0) arc_fill_row(&sector, midX, midY, side * row, -outer_width, outer_width, color);
+	  else
+	    {
+	      arc_fill_row(&sector, midX, midY, side * row, -outer_width, -inner_width - 1, color);
+	      arc_fill_row(&sector, midX, midY, side * row, inner_width + 1, outer_width, color);
+	    }
+	}
+    }
+}
+
+//outline of a circle from startAngle counter-clockwise to endAngle, see ssd1306_fill_arc
+void ssd1306_draw_arc(int16_t midX, int16_t midY, uint8_t radius, int16_t startAngle, int16_t endAngle, uint8_t color)
+{
+  SSD1306_TRACE(SSD_TRACE_DRAW_ARC, midX, midY, radius, startAngle, endAngle, color);
+  arc_sector_t sector;
+  conic_t circle;
+  if(!arc_sector_begin(&sector, startAngle, endAngle)) return;
+  if(REFERENCE_RASTER)
+    {
+      for(int16_t dy = -radius; dy <= radius; dy++)
+	for(int16_t dx = -radius; dx <= radius; dx++)
+	  if(conic_outline_inside(radius, radius, dx, dy) && arc_sector_inside(&sector, dx, dy))
+	    ssd1306_draw_pixel(midX + dx, midY + dy, color);
+      return;
+    }
+  conic_begin(&circle, radius, radius);
+  conic_draw_outline(&circle, midX, midY, &sector, color);
 }
 
 void ssd1306_draw_rect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t color)
 {
+  SSD1306_TRACE(SSD_TRACE_DRAW_RECT, x, y, width, height, color);
   ssd1306_draw_h_line(x, y, x + width - 1, color);
   ssd1306_draw_v_line(x + width - 1, y + 1, y + height - 1, color);
   ssd1306_draw_h_line(x, y + height - 1, x + width - 2, color);
@@ -314,6 +709,7 @@ void ssd1306_draw_rect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint
 
 void ssd1306_draw_rect_round(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t cornerRadius, uint8_t color)
 {
+  SSD1306_TRACE(SSD_TRACE_DRAW_RECT_ROUND, x, y, width, height, cornerRadius, color);
   if(width < 1 || height < 1) return;
   width--;
   height--;
@@ -331,40 +727,8 @@ void ssd1306_draw_rect_round(uint8_t x, uint8_t y, uint8_t width, uint8_t height
 
 void ssd1306_draw_circle(uint8_t midX, uint8_t midY, uint8_t radius, uint8_t color)
 {
-  //calculating only one quarter of the circle until x is y
-  //decreasing x every time if x^2 + y^2 > r^2 + r
-  //r^2 + r will be a 'radiusThreshold' for now, I don't know how to call it properly, cause I've come up with the formula
-  //it might be similar to mid point circle drawing algorithm
-  uint32_t x = radius, y = 0, radiusThreshold = radius * radius + radius;
-  ssd1306_draw_pixel(midX + radius, midY, color);
-  if (radius != 0) {
-      ssd1306_draw_pixel(midX, midY + radius, color);
-      ssd1306_draw_pixel(midX, midY - radius, color);
-      ssd1306_draw_pixel(midX - radius, midY, color);
-  }
-
-  while (x > y)
-    {
-      y++;
-
-      if (radiusThreshold < (x * x + y * y))
-	{
-	  x--;
-	}
-      if(x < y) break;
-
-      ssd1306_draw_pixel(midX + x, midY + y, color);
-      ssd1306_draw_pixel(midX + x, midY - y, color);
-      ssd1306_draw_pixel(midX - x, midY + y, color);
-      ssd1306_draw_pixel(midX - x, midY - y, color);
-      if (x != y)
-	{
-	  ssd1306_draw_pixel(midX + y, midY + x, color);
-	  ssd1306_draw_pixel(midX + y, midY - x, color);
-	  ssd1306_draw_pixel(midX - y, midY + x, color);
-	  ssd1306_draw_pixel(midX - y, midY - x, color);
-	}
-    }
+  SSD1306_TRACE(SSD_TRACE_DRAW_CIRCLE, midX, midY, radius, color);
+  ssd1306_draw_ellipse(midX, midY, radius, radius, color);
 }
 
 /*circle quarters:
@@ -376,6 +740,7 @@ void ssd1306_draw_circle(uint8_t midX, uint8_t midY, uint8_t radius, uint8_t col
  */
 void ssd1306_draw_circle_quarter(uint8_t midX, uint8_t midY, uint8_t radius, uint8_t quarter, uint8_t color)
 {
+  SSD1306_TRACE(SSD_TRACE_DRAW_CIRCLE_QUARTER, midX, midY, radius, quarter, color);
   uint32_t x = radius, y = 0, radiusThreshold = radius * radius + radius;
 
   if (radius != 0) {
@@ -436,16 +801,243 @@ void ssd1306_draw_circle_quarter(uint8_t midX, uint8_t midY, uint8_t radius, uin
   }
 }
 
+void ssd1306_fill_triangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t color)
+{
+  SSD1306_TRACE(SSD_TRACE_FILL_TRIANGLE, x0, y0, x1, y1, x2, y2, color);
+  ssd1306_point_t points[] = {{x0, y0}, {x1, y1}, {x2, y2}};
+  ssd1306_fill_polygon(points, 3, SSD_FILL_NON_ZERO, color);
+}
+
+//scanline fill, a pixel is inside when its centre is inside the polygon.
+//Every row gives disjoint spans, so each pixel is written at most once.
+void ssd1306_fill_polygon(const ssd1306_point_t *points, uint8_t count, uint8_t fill_rule, uint8_t color)
+{
+#ifdef USE_TRACE
+  int32_t trace_arguments[3 + 2 * SSD1306_POLYGON_MAX_POINTS] = {count, fill_rule, color};
+  uint8_t traced_points = (count < SSD1306_POLYGON_MAX_POINTS) ? count : SSD1306_POLYGON_MAX_POINTS;
+  for(uint8_t i = 0; i < traced_points; i++)
+    {
+      trace_arguments[3 + 2 * i] = points[i].x;
+      trace_arguments[4 + 2 * i] = points[i].y;
+    }
+  SSD1306_TRACE_ARRAY(SSD_TRACE_FILL_POLYGON, trace_arguments, 3 + 2 * traced_points);
+#endif
+  //an edge crosses the centre of row y at x = x_top + (2 * (y - y_top) + 1) * dx / (2 * dy),
+  //the first pixel centre right of the crossing is kept exactly as quotient and remainder
+  typedef struct
+  {
+    int32_t pixel;     //first pixel with its centre at or right of the crossing
+    int32_t remainder; //0 when the crossing is exactly at (pixel - 0.5)
+    int32_t step_pixel;
+    int32_t step_remainder;
+    int32_t divisor;
+    int16_t y_top;
+    int16_t y_bottom; //first row below the edge
+    int8_t winding;
+  } polygon_edge_t;
+  polygon_edge_t edges[SSD1306_POLYGON_MAX_POINTS];
+  int32_t crossings[SSD1306_POLYGON_MAX_POINTS];
+  int8_t windings[SSD1306_POLYGON_MAX_POINTS];
+  uint8_t edges_count = 0, crossings_count;
+  int16_t y_min = INT16_MAX, y_max = INT16_MIN;
+
+  if(count < 3 || count > SSD1306_POLYGON_MAX_POINTS) return;
+  if(REFERENCE_RASTER)
+    {
+      //every pixel of the clipped bounding box, the edges crossing its row left of its centre
+      //add up to its winding number
+      int16_t x_min = INT16_MAX, x_max = INT16_MIN;
+      for(uint8_t i = 0; i < count; i++)
+	{
+	  if(x_min > points[i].x) x_min = points[i].x;
+	  if(x_max < points[i].x) x_max = points[i].x;
+	  if(y_min > points[i].y) y_min = points[i].y;
+	  if(y_max < points[i].y) y_max = points[i].y;
+	}
+      if(x_min < display->clip_rect.x0) x_min = display->clip_rect.x0;
+      if(x_max > display->clip_rect.x1) x_max = display->clip_rect.x1;
+      if(y_min < display->clip_rect.y0) y_min = display->clip_rect.y0;
+      if(y_max > display->clip_rect.y1) y_max = display->clip_rect.y1;
+      for(int16_t y = y_min; y <= y_max; y++)
+	for(int16_t x = x_min; x <= x_max; x++)
+	  {
+	    int16_t winding = 0;
+	    for(uint8_t i = 0; i < count; i++)
+	      {
+		const ssd1306_point_t *a = &points[i], *b = &points[(i + 1) == count ? 0 : i + 1];
+		const ssd1306_point_t *top = a->y < b->y ? a : b, *bottom = a->y < b->y ? b : a;
+		if(y < top->y || y >= bottom->y) continue;
+		int64_t dx = bottom->x - top->x, dy = bottom->y - top->y;
+		//crossing <= x + 0.5
+		if(2 * dy * (top->x - x) + (2 * (y - top->y) + 1) * dx - dy <= 0) winding += a->y < b->y ? 1 : -1;
+	      }
+	    if((fill_rule == SSD_FILL_EVEN_ODD) ? (winding & 1) : (winding != 0)) ssd1306_draw_pixel(x, y, color);
+	  }
+      return;
+    }
+  //edge table, horizontal edges never cross a row centre
+  for(uint8_t i = 0; i < count; i++)
+    {
+      const ssd1306_point_t *a = &points[i], *b = &points[(i + 1) == count ? 0 : i + 1];
+      if(a->y == b->y) continue;
+      polygon_edge_t *edge = &edges[edges_count++];
+      edge->winding = a->y < b->y ? 1 : -1;
+      if(a->y > b->y)
+	{
+	  const ssd1306_point_t *temp = a;
+	  a = b;
+	  b = temp;
+	}
+      int32_t dx = b->x - a->x, dy = b->y - a->y;
+      int16_t first_row = a->y < display->clip_rect.y0 ? display->clip_rect.y0 : a->y;
+      //pixel = ceil(crossing - 0.5) = ceil((2 * x_top * dy + (2 * (y - y_top) + 1) * dx - dy) / (2 * dy))
+      int64_t numerator = (int64_t)2 * a->x * dy + (int64_t)(2 * (first_row - a->y) + 1) * dx - dy;
+      edge->divisor = 2 * dy;
+      edge->pixel = floor_div(numerator, edge->divisor);
+      edge->remainder = numerator - (int64_t)edge->pixel * edge->divisor;
+      edge->step_pixel = floor_div(2 * (int64_t)dx, edge->divisor);
+      edge->step_remainder = 2 * dx - edge->step_pixel * edge->divisor;
+      edge->y_top = a->y;
+      edge->y_bottom = b->y;
+      if(y_min > a->y) y_min = a->y;
+      if(y_max < b->y - 1) y_max = b->y - 1;
+    }
+  if(y_min < display->clip_rect.y0) y_min = display->clip_rect.y0;
+  if(y_max > display->clip_rect.y1) y_max = display->clip_rect.y1;
+
+  for(int16_t y = y_min; y <= y_max; y++)
+    {
+      crossings_count = 0;
+      for(uint8_t i = 0; i < edges_count; i++)
+	{
+	  polygon_edge_t *edge = &edges[i];
+	  if(y < edge->y_top || y >= edge->y_bottom) continue;
+	  int32_t pixel = edge->pixel + (edge->remainder != 0);
+	  //insertion sort by x
+	  uint8_t j = crossings_count++;
+	  while(j > 0 && crossings[j - 1] > pixel)
+	    {
+	      crossings[j] = crossings[j - 1];
+	      windings[j] = windings[j - 1];
+	      j--;
+	    }
+	  crossings[j] = pixel;
+	  windings[j] = edge->winding;
+	  edge->pixel += edge->step_pixel;
+	  edge->remainder += edge->step_remainder;
+	  if(edge->remainder >= edge->divisor)
+	    {
+	      edge->remainder -= edge->divisor;
+	      edge->pixel++;
+	    }
+	}
+      int16_t winding = 0;
+      for(uint8_t i = 0; i + 1 < crossings_count; i++)
+	{
+	  winding += (fill_rule == SSD_FILL_EVEN_ODD) ? 1 : windings[i];
+	  uint8_t inside = (fill_rule == SSD_FILL_EVEN_ODD) ? (winding & 1) : (winding != 0);
+	  if(!inside) continue;
+	  //pixels with centres in [crossing i, crossing i + 1)
+	  int32_t x_first = crossings[i], x_last = crossings[i + 1] - 1;
+	  //spans of one row are merged while the inside state holds
+	  while(i + 2 < crossings_count)
+	    {
+	      int16_t next_winding = winding + ((fill_rule == SSD_FILL_EVEN_ODD) ? 1 : windings[i + 1]);
+	      uint8_t next_inside = (fill_rule == SSD_FILL_EVEN_ODD) ? (next_winding & 1) : (next_winding != 0);
+	      if(!next_inside) break;
+	      winding = next_winding;
+	      i++;
+	      x_last = crossings[i + 1] - 1;
+	    }
+	  if(x_first > display->clip_rect.x1 || x_last < display->clip_rect.x0 || x_first > x_last) continue;
+	  fill_rect_clipped(x_first < display->clip_rect.x0 ? display->clip_rect.x0 : x_first, y,
+			    x_last > display->clip_rect.x1 ? display->clip_rect.x1 : x_last, y, color);
+	}
+    }
+}
+
 void ssd1306_draw_XBM(const uint8_t *bitmap, uint8_t width, uint8_t height, uint8_t x0, uint8_t y0, uint8_t color)
 {
-  height = height + y0 <= screen_height ?  height : screen_height - y0;
-  uint8_t bmpByte, widthInBytes = (width + 7) >> 3;
+  SSD1306_TRACE(SSD_TRACE_DRAW_XBM, SSD1306_TRACE_POINTER(bitmap), width, height, x0, y0, color);
+  uint8_t bmpByte = 0, widthInBytes = (width + 7) >> 3;
+  int16_t runStart;
   for(uint8_t y = 0; y < height; y++)
     {
+      //set bits are collected into runs, so the span kernel
+      //writes them whatever the screen rotation is
+      runStart = -1;
       for(uint8_t x = 0; x < width; x++)
 	{
 	  if((x & 0b111) == 0) bmpByte = (bitmap[y * widthInBytes + (x >> 3)]);
-	  if((bmpByte >> (x & 0b111)) & 1) ssd1306_draw_pixel(x0 + x, y0 + y, color);
+	  if((bmpByte >> (x & 0b111)) & 1)
+	    {
+	      if(runStart < 0) runStart = x;
+	    }
+	  else if(runStart >= 0)
+	    {
+	      fill_rect_clipped(x0 + runStart, y0 + y, x0 + x - 1, y0 + y, color);
+	      runStart = -1;
+	    }
+	}
+      if(runStart >= 0) fill_rect_clipped(x0 + runStart, y0 + y, x0 + width - 1, y0 + y, color);
+    }
+}
+
+//draws a page-major bitmap, the same layout as the screen buffer:
+//width bytes per page, bit 0 is the top row of the page
+void ssd1306_draw_page_bitmap(const uint8_t *bitmap, uint8_t width, uint8_t height, int16_t x, int16_t y, uint8_t rop)
+{
+  SSD1306_TRACE(SSD_TRACE_DRAW_PAGE_BITMAP, SSD1306_TRACE_POINTER(bitmap), width, height, x, y, rop);
+  if(width < 1 || height < 1) return;
+  int16_t x0 = x < display->clip_rect.x0 ? display->clip_rect.x0 : x, x1 = x + width - 1;
+  int16_t y0 = y < display->clip_rect.y0 ? display->clip_rect.y0 : y, y1 = y + height - 1;
+  if(x1 > display->clip_rect.x1) x1 = display->clip_rect.x1;
+  if(y1 > display->clip_rect.y1) y1 = display->clip_rect.y1;
+  if(x0 > x1 || y0 > y1) return;
+  if(REFERENCE_RASTER || (display->rotation & SSD_ROTATION_90))
+    {
+      //columns of the bitmap are not columns of the panel, goes pixel by pixel,
+      //the whole rectangle counts as changed like with the page kernel
+      static const uint8_t rop_colors[] = {SSD_COLOR_WHITE, SSD_COLOR_WHITE, SSD_COLOR_BLACK, SSD_COLOR_INVERSE};
+      uint8_t bit;
+      if(display->rotation & SSD_ROTATION_90) mark_updated_area((SCREEN_WIDTH - 1) - y1, x0, (SCREEN_WIDTH - 1) - y0, x1);
+      else mark_updated_area(x0, y0, x1, y1);
+      for(uint8_t row = 0; row < height; row++)
+	for(uint8_t column = 0; column < width; column++)
+	  {
+	    bit = (bitmap[(row >> 3) * width + column] >> (row & 0b111)) & 1;
+	    if(rop == SSD_ROP_COPY) ssd1306_draw_pixel(x + column, y + row, bit ? SSD_COLOR_WHITE : SSD_COLOR_BLACK);
+	    else if(bit) ssd1306_draw_pixel(x + column, y + row, rop_colors[rop & 0b11]);
+	  }
+      return;
+    }
+  mark_updated_area(x0, y0, x1, y1);
+
+  uint8_t pages = (height + 7) >> 3, shift = y & 0b111;
+  int16_t page = y >> 3;
+  uint8_t columns = x1 - x0 + 1, columns_count, row_mask, bits_mask;
+  const uint8_t *src;
+  uint8_t *dst;
+  for(uint8_t src_page = 0; src_page < pages; src_page++, page++)
+    {
+      row_mask = 0xFF;
+      if(src_page == pages - 1 && (height & 0b111)) row_mask = 0xFF >> (8 - (height & 0b111));
+      //lower part of the source page lands in this page, the rest in the next one
+      if(page >= (y0 >> 3) && page <= (y1 >> 3))
+	{
+	  src = bitmap + src_page * width + (x0 - x);
+	  dst = display->buffer + page * display->buffer_width + x0;
+	  bits_mask = (row_mask << shift) & page_clip_mask(page, y0, y1);
+	  columns_count = columns;
+	  while(columns_count--) apply_rop(dst++, (*src++ & row_mask) << shift, bits_mask, rop);
+	}
+      if(shift && page + 1 >= (y0 >> 3) && page + 1 <= (y1 >> 3))
+	{
+	  src = bitmap + src_page * width + (x0 - x);
+	  dst = display->buffer + (page + 1) * display->buffer_width + x0;
+	  bits_mask = (row_mask >> (8 - shift)) & page_clip_mask(page + 1, y0, y1);
+	  columns_count = columns;
+	  while(columns_count--) apply_rop(dst++, (*src++ & row_mask) >> (8 - shift), bits_mask, rop);
 	}
     }
 }
@@ -455,69 +1047,90 @@ void ssd1306_draw_XBM(const uint8_t *bitmap, uint8_t width, uint8_t height, uint
 //Used format for fonts: http://ww1.microchip.com/downloads/en/AppNotes/01182b.pdf
 void ssd1306_set_font(const unsigned char *fonts)
 {
-  font_parameters.font_family = fonts;
-  font_parameters.first_char_index = (font_parameters.font_family[0x03]) << 8 | (font_parameters.font_family[0x02]);
-  font_parameters.last_char_index = (font_parameters.font_family[0x05]) << 8 | (font_parameters.font_family[0x04]);
-  font_parameters.char_height = (font_parameters.font_family[0x06]);
+  SSD1306_TRACE(SSD_TRACE_SET_FONT, SSD1306_TRACE_POINTER(fonts));
+  read_font_parameters(fonts, &font_parameters);
 }
 
 int ssd1306_write(uint8_t c)
 {
-  uint8_t charBitmapByte, bitsLeft;
+  SSD1306_TRACE(SSD_TRACE_WRITE, c);
   if(c == '\n'){ //transfer to new line
       cursor_coords.x = 0;
-      cursor_coords.y += font_parameters.char_height * text_parameters.text_scale + text_parameters.line_spacing;
+      cursor_coords.y += text_line_height();
       return 1;
   }
   else if(c == '\r') return 1; //ignoring carriage return
+#ifdef USE_CHARACTER_MODE
+  else if(!display->buffer) return character_write(c);
+#endif
   else if (c == ' ')
     {
       cursor_coords.x += text_parameters.text_scale + text_parameters.line_spacing;
       return 1;
     }
-  else if(c < font_parameters.first_char_index || c > font_parameters.last_char_index) return 1;
-  uint16_t charHeadIndex =  (((int)c - font_parameters.first_char_index) << 2) + 8 ;
-  uint8_t charWidth = (font_parameters.font_family[charHeadIndex]);
-  uint32_t charOffset =
-      (((uint32_t)(font_parameters.font_family[charHeadIndex + 3])) << 16)
-      | (((uint16_t)(font_parameters.font_family[charHeadIndex + 2])) << 8)
-      | (font_parameters.font_family[charHeadIndex+1]);
-  for(uint8_t clmnByte = 0; clmnByte < ((charWidth + 7) >> 3); clmnByte++)
-    {
-      for(uint8_t y = 0; y < font_parameters.char_height; y++)
-	{
-	  charBitmapByte = (font_parameters.font_family[charOffset + y * ((charWidth + 7) >> 3) + clmnByte]);
-	  bitsLeft = charWidth < (1 + clmnByte) << 3 ? (charWidth & 0b111) : 8;
-	  for(uint8_t x = 0; x < bitsLeft; x++)
-	    {
-	      if((charBitmapByte >> x) & 1)
-		for(uint8_t sX = 0; sX < text_parameters.text_scale; sX++)
-		  for(uint8_t sY = 0; sY < text_parameters.text_scale; sY++)
-		    ssd1306_draw_pixel(text_parameters.offset_x + cursor_coords.x + (clmnByte << 3) + x * text_parameters.text_scale + sX,
-				       text_parameters.offset_y + cursor_coords.y + y * text_parameters.text_scale + sY,
-				       text_parameters.text_color);
-	    }
-	}
-    }
-  cursor_coords.x += charWidth * text_parameters.text_scale + text_parameters.letter_spacing;
+  uint8_t charWidth = draw_glyph(&font_parameters, c,
+				 text_parameters.offset_x + cursor_coords.x, text_parameters.offset_y + cursor_coords.y,
+				 text_parameters.text_scale, text_parameters.text_color);
+  if(charWidth) cursor_coords.x += charWidth * text_parameters.text_scale + text_parameters.letter_spacing;
   return 1;
 }
 
+//draws a glyph of any font at x, y without using the text cursor and settings,
+//returns the glyph width in font pixels, 0 when the font has no such glyph
+uint8_t ssd1306_draw_glyph(const unsigned char *font, uint8_t c, int16_t x, int16_t y, uint8_t scale, uint8_t color)
+{
+  SSD1306_TRACE(SSD_TRACE_DRAW_GLYPH, SSD1306_TRACE_POINTER(font), c, x, y, scale, color);
+  font_parameters_t parameters;
+  read_font_parameters(font, &parameters);
+  return draw_glyph(&parameters, c, x, y, scale, color);
+}
+
+//width of the glyph in font pixels, 0 when the font has no such glyph
+uint8_t ssd1306_get_glyph_width(const unsigned char *font, uint8_t c)
+{
+  font_parameters_t parameters;
+  read_font_parameters(font, &parameters);
+  if(c < parameters.first_char_index || c > parameters.last_char_index) return 0;
+  return font[(((int)c - parameters.first_char_index) << 2) + 8];
+}
+
+//distance of text lines, whole character cells without a screen buffer
+static uint8_t text_line_height(void)
+{
+#ifdef USE_CHARACTER_MODE
+  if(!display->buffer) return (font_parameters.char_height + 7) & ~7;
+#endif
+  return font_parameters.char_height * text_parameters.text_scale + text_parameters.line_spacing;
+}
+
 void ssd1306_set_cursor(uint8_t column, uint8_t row)
 {
+  SSD1306_TRACE(SSD_TRACE_SET_CURSOR, column, row);
   cursor_coords.x = column;
-  cursor_coords.y = (font_parameters.char_height * text_parameters.text_scale * row) + (text_parameters.line_spacing * row);
+  cursor_coords.y = text_line_height() * row;
 }
 
 void ssd1306_set_cursor_coord(uint8_t coord_x, uint8_t coord_y)
 {
+  SSD1306_TRACE(SSD_TRACE_SET_CURSOR_COORD, coord_x, coord_y);
   cursor_coords.x = coord_x;
   cursor_coords.y = coord_y;
 }
 
+uint8_t ssd1306_get_cursor_x(void)
+{
+  return cursor_coords.x;
+}
+
+uint8_t ssd1306_get_cursor_y(void)
+{
+  return cursor_coords.y;
+}
+
 void ssd1306_advance_cursor_row(uint8_t row_count, uint8_t column)
 {
-  cursor_coords.y += (font_parameters.char_height * text_parameters.text_scale * row_count) + (text_parameters.line_spacing * row_count);
+  SSD1306_TRACE(SSD_TRACE_ADVANCE_CURSOR_ROW, row_count, column);
+  cursor_coords.y += text_line_height() * row_count;
   cursor_coords.x = column;
 }
 
@@ -526,6 +1139,7 @@ uint8_t ssd1306_get_font_height()
   return font_parameters.char_height * text_parameters.text_scale;
 }
 
+//horizontal advance of the character with the current font and text settings
 uint16_t ssd1306_get_char_width(uint8_t c)
 {
   if (c == ' ')
@@ -539,8 +1153,7 @@ uint16_t ssd1306_get_char_width(uint8_t c)
   uint16_t charHeadIndex =  (((int)c - font_parameters.first_char_index) << 2) + 8 ;
   uint8_t charWidth = (font_parameters.font_family[charHeadIndex]);
 
-  cursor_coords.x += charWidth * text_parameters.text_scale + text_parameters.letter_spacing;
-  return 1;
+  return charWidth * text_parameters.text_scale + text_parameters.letter_spacing;
 }
 
 uint16_t ssd1306_get_text_width(const char text[])
@@ -572,30 +1185,47 @@ uint16_t ssd1306_get_text_width(const char text[])
 
 void ssd1306_set_text_offset(uint8_t offset_x, uint8_t offset_y)
 {
+  SSD1306_TRACE(SSD_TRACE_SET_TEXT_OFFSET, offset_x, offset_y);
   text_parameters.offset_x = offset_x;
   text_parameters.offset_y = offset_y;
 }
 
 void ssd1306_set_text_scale(uint8_t text_scale)
 {
+  SSD1306_TRACE(SSD_TRACE_SET_TEXT_SCALE, text_scale);
   text_parameters.text_scale = text_scale;
 }
+void ssd1306_set_text_color(uint8_t color)
+{
+  SSD1306_TRACE(SSD_TRACE_SET_TEXT_COLOR, color);
+  text_parameters.text_color = color;
+}
+
+uint8_t ssd1306_get_text_color(void)
+{
+  return text_parameters.text_color;
+}
+
 void ssd1306_set_text_line_spacing(uint8_t line_spacing)
 {
+  SSD1306_TRACE(SSD_TRACE_SET_TEXT_LINE_SPACING, line_spacing);
   text_parameters.line_spacing = line_spacing;
 }
 void ssd1306_set_text_letter_spacing(uint8_t letter_spacing)
 {
+  SSD1306_TRACE(SSD_TRACE_SET_TEXT_LETTER_SPACING, letter_spacing);
   text_parameters.letter_spacing = letter_spacing;
 }
 void ssd1306_set_cursor_column(uint8_t column)
 {
+  SSD1306_TRACE(SSD_TRACE_SET_CURSOR_COLUMN, column);
   cursor_coords.x = column;
 }
 
 void ssd1306_set_cursor_row(uint8_t row)
 {
-  cursor_coords.y = (font_parameters.char_height * text_parameters.text_scale * row) + (text_parameters.line_spacing * row);
+  SSD1306_TRACE(SSD_TRACE_SET_CURSOR_ROW, row);
+  cursor_coords.y = text_line_height() * row;
 }
 
 ///////////////// TEXT END ////////////////
@@ -604,215 +1234,1507 @@ void ssd1306_set_cursor_row(uint8_t row)
 
 int ssd1306_send_command(uint8_t command)
 {
-  if(i2cs_start_transmission(OLED_ADDRESS, 0) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  if(i2cs_send_byte(SSD_commandByte) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  if(i2cs_send_byte(command) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  if(i2cs_end_transmission() != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+  SSD1306_TRACE(SSD_TRACE_SEND_COMMAND, command);
+  if(display->transport.ops->begin(display->transport.context, SSD1306_TRANSFER_COMMAND) != SSD1306_SUCCESS) return transfer_abort();
+  if(display->transport.ops->write(display->transport.context, &command, 1) != SSD1306_SUCCESS) return transfer_abort();
+  if(display->transport.ops->end(display->transport.context) != SSD1306_SUCCESS) return transfer_abort();
   return SSD1306_SUCCESS;
 }
 
 int ssd1306_send_command_with_value(uint8_t command, uint8_t value)
 {
-  if(i2cs_start_transmission(OLED_ADDRESS, 0) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  if(i2cs_send_byte(SSD_commandByte) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  if(i2cs_send_byte(command) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  if(i2cs_send_byte(value) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  if(i2cs_end_transmission() != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+  SSD1306_TRACE(SSD_TRACE_SEND_COMMAND_WITH_VALUE, command, value);
+  uint8_t commands[] = {command, value};
+  if(display->transport.ops->begin(display->transport.context, SSD1306_TRANSFER_COMMAND) != SSD1306_SUCCESS) return transfer_abort();
+  if(display->transport.ops->write(display->transport.context, commands, sizeof(commands)) != SSD1306_SUCCESS) return transfer_abort();
+  if(display->transport.ops->end(display->transport.context) != SSD1306_SUCCESS) return transfer_abort();
   return SSD1306_SUCCESS;
 }
 
-void ssd1306_set_contrast(uint8_t contrast_value)
+//settings commands go through the command queue when USE_COMMAND_QUEUE is defined,
+//they are sent on the next ssd1306_display or ssd1306_flush_commands call
+static int ssd1306_send_command_list(const uint8_t *commands, uint8_t count)
 {
-  ssd1306_send_command_with_value(SSD_COMMAND_CONTRAST, contrast_value);
+#ifdef USE_COMMAND_QUEUE
+  if(display->command_queue_length + count > SSD1306_COMMAND_QUEUE_SIZE)
+    {
+      if(ssd1306_flush_commands() != SSD1306_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+    }
+  while(count--) display->command_queue[display->command_queue_length++] = *commands++;
+  return SSD1306_SUCCESS;
+#else
+  return ssd1306_send_command_frame(commands, count);
+#endif
 }
 
-void ssd1306_set_display_on(uint8_t display_on)
+//sends queued commands followed by the given ones in a single command transaction
+static int ssd1306_send_command_frame(const uint8_t *commands, uint8_t count)
 {
-  if(display_on) ssd1306_send_command(SSD_COMMAND_DISPLAY_ON);
-  else ssd1306_send_command(SSD_COMMAND_DISPLAY_OFF);
+  if(display->transport.ops->begin(display->transport.context, SSD1306_TRANSFER_COMMAND) != SSD1306_SUCCESS) return transfer_abort();
+#ifdef USE_COMMAND_QUEUE
+  if(display->command_queue_length && display->transport.ops->write(display->transport.context, display->command_queue, display->command_queue_length) != SSD1306_SUCCESS) return transfer_abort();
+#endif
+  if(count && display->transport.ops->write(display->transport.context, commands, count) != SSD1306_SUCCESS) return transfer_abort();
+  if(display->transport.ops->end(display->transport.context) != SSD1306_SUCCESS) return transfer_abort();
+#ifdef USE_COMMAND_QUEUE
+  //queue is kept on failure, settings commands are safe to send again
+  display->command_queue_length = 0;
+#endif
+  return SSD1306_SUCCESS;
 }
 
-void ssd1306_invert_display(uint8_t invert)
+int ssd1306_flush_commands(void)
 {
-  if(invert) ssd1306_send_command(SSD_COMMAND_SET_DISPLAY_INVERSE);
-  else ssd1306_send_command(SSD_COMMAND_SET_DISPLAY_NORMAL);
+  SSD1306_TRACE_NO_ARGUMENTS(SSD_TRACE_FLUSH_COMMANDS);
+#ifdef USE_COMMAND_QUEUE
+  if(!display->command_queue_length) return SSD1306_SUCCESS;
+#endif
+  return ssd1306_send_command_frame(0, 0);
 }
 
-void ssd1306_flip_vertically(uint8_t flip)
+int ssd1306_set_contrast(uint8_t contrast_value)
 {
-  if(flip)
-    {
-      ssd1306_send_command(SSD_COMMAND_SET_COM_OUTPUT_SCAN_DIRECTION_INVERSE);
-    }else{
-	ssd1306_send_command(SSD_COMMAND_SET_COM_OUTPUT_SCAN_DIRECTION_NORMAL);
-    }
+  SSD1306_TRACE(SSD_TRACE_SET_CONTRAST, contrast_value);
+  uint8_t commands[] = {SSD_COMMAND_CONTRAST, contrast_value};
+  display->contrast.current = contrast_value;
+  display->contrast.active = 0;
+  return ssd1306_send_command_list(commands, sizeof(commands));
+}
+
+//divide_ratio 1..16, oscillator_frequency 0..15 (0x8 after reset)
+int ssd1306_set_clock_div(uint8_t divide_ratio, uint8_t oscillator_frequency)
+{
+  SSD1306_TRACE(SSD_TRACE_SET_CLOCK_DIV, divide_ratio, oscillator_frequency);
+  if(divide_ratio < 1) divide_ratio = 1;
+  if(divide_ratio > 16) divide_ratio = 16;
+  uint8_t commands[] = {SSD_COMMAND_SET_CLOCK_DIV, ((oscillator_frequency & 0x0F) << 4) | (divide_ratio - 1)};
+  display->timing.divide_ratio = divide_ratio;
+  display->timing.oscillator = oscillator_frequency & 0x0F;
+  return ssd1306_send_command_list(commands, sizeof(commands));
 }
 
-uint8_t ssd1306_get_screen_height() {return screen_height;}
-uint8_t ssd1306_get_screen_width() {return screen_width;}
+//rows 16..64, fewer rows than the panel has leave the bottom ones dark and give a higher frame rate
+int ssd1306_set_multiplex_ratio(uint8_t rows)
+{
+  SSD1306_TRACE(SSD_TRACE_SET_MULTIPLEX_RATIO, rows);
+  if(rows < 16 || rows > 64) return SSD1306_ERROR_INVALID_ARGUMENT;
+  uint8_t commands[] = {SSD_COMMAND_MUX_RATIO, rows - 1};
+  display->timing.multiplex = rows;
+  return ssd1306_send_command_list(commands, sizeof(commands));
+}
+
+//phases in DCLKs 1..15, 2 and 2 after reset, longer phases give a brighter but slower scan
+int ssd1306_set_pre_charge(uint8_t phase1, uint8_t phase2)
+{
+  SSD1306_TRACE(SSD_TRACE_SET_PRE_CHARGE, phase1, phase2);
+  if(phase1 < 1 || phase1 > 15 || phase2 < 1 || phase2 > 15) return SSD1306_ERROR_INVALID_ARGUMENT;
+  uint8_t commands[] = {SSD_COMMAND_PRE_CHARGE, (phase2 << 4) | phase1};
+  display->timing.phase1 = phase1;
+  display->timing.phase2 = phase2;
+  return ssd1306_send_command_list(commands, sizeof(commands));
+}
+
+//the datasheet gives 370 kHz for the reset setting 8, the steps are about 24 kHz
+static uint32_t oscillator_frequency(void)
+{
+  return 175000 + 24375 * (uint32_t)display->timing.oscillator;
+}
+
+static uint32_t frame_clocks(void)
+{
+  const ssd1306_timing_t *timing = &display->timing;
+  return (uint32_t)timing->divide_ratio * (timing->phase1 + timing->phase2 + 50) * timing->multiplex;
+}
+
+uint32_t ssd1306_get_frame_period(void)
+{
+  return ((uint64_t)frame_clocks() * 1000000 + oscillator_frequency() / 2) / oscillator_frequency();
+}
+
+uint16_t ssd1306_get_frame_rate(void)
+{
+  return (oscillator_frequency() + frame_clocks() / 2) / frame_clocks();
+}
+
+int ssd1306_set_display_on(uint8_t display_on)
+{
+  SSD1306_TRACE(SSD_TRACE_SET_DISPLAY_ON, display_on);
+  uint8_t command = display_on ? SSD_COMMAND_DISPLAY_ON : SSD_COMMAND_DISPLAY_OFF;
+  return ssd1306_send_command_list(&command, 1);
+}
+
+int ssd1306_invert_display(uint8_t invert)
+{
+  SSD1306_TRACE(SSD_TRACE_INVERT_DISPLAY, invert);
+  uint8_t command = invert ? SSD_COMMAND_SET_DISPLAY_INVERSE : SSD_COMMAND_SET_DISPLAY_NORMAL;
+  return ssd1306_send_command_list(&command, 1);
+}
+
+int ssd1306_set_fade(uint8_t mode, uint8_t frames)
+{
+  SSD1306_TRACE(SSD_TRACE_SET_FADE, mode, frames);
+  uint8_t interval = frames < 8 ? 0 : ((frames >> 3) - 1) & 0x0F;
+  uint8_t commands[] = {SSD_COMMAND_FADE_BLINK, (mode & 0x30) | interval};
+  return ssd1306_send_command_list(commands, sizeof(commands));
+}
+
+int ssd1306_set_zoom(uint8_t zoom)
+{
+  SSD1306_TRACE(SSD_TRACE_SET_ZOOM, zoom);
+  uint8_t commands[] = {SSD_COMMAND_ZOOM_IN, zoom ? 0x01 : 0x00};
+  display->zoom = zoom ? 1 : 0;
+  update_screen_size();
+  return ssd1306_send_command_list(commands, sizeof(commands));
+}
+
+int ssd1306_start_contrast_ramp(uint8_t target, uint8_t step, uint32_t interval, uint32_t now)
+{
+  SSD1306_TRACE(SSD_TRACE_START_CONTRAST_RAMP, target, step, interval, now);
+  if(step == 0) return SSD1306_ERROR_INVALID_ARGUMENT;
+  display->contrast.target = target;
+  display->contrast.step = step;
+  display->contrast.interval = interval;
+  display->contrast.due = now;
+  display->contrast.active = (display->contrast.current != target);
+  return SSD1306_SUCCESS;
+}
+
+//the contrast command is sent at once, with the queued commands, a ramp has no use for the queue
+int ssd1306_contrast_ramp_tick(uint32_t now)
+{
+  SSD1306_TRACE(SSD_TRACE_CONTRAST_RAMP_TICK, now);
+  ssd1306_contrast_ramp_t *ramp = &display->contrast;
+  if(!ramp->active || (int32_t)(now - ramp->due) < 0) return SSD1306_SUCCESS;
+  uint8_t value = ramp->current;
+  if(value < ramp->target) value = (ramp->target - value > ramp->step) ? value + ramp->step : ramp->target;
+  else value = (value - ramp->target > ramp->step) ? value - ramp->step : ramp->target;
+  uint8_t commands[] = {SSD_COMMAND_CONTRAST, value};
+  //a failed step is tried again on the next tick
+  if(ssd1306_send_command_frame(commands, sizeof(commands)) != SSD1306_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+  ramp->current = value;
+  ramp->due += ramp->interval;
+  //a late tick does not make the following steps come faster
+  if((int32_t)(now - ramp->due) >= 0) ramp->due = now + ramp->interval;
+  ramp->active = (value != ramp->target);
+  return SSD1306_SUCCESS;
+}
+
+uint8_t ssd1306_is_contrast_ramp_active(void)
+{
+  return display->contrast.active;
+}
+
+int ssd1306_flip_vertically(uint8_t flip)
+{
+  SSD1306_TRACE(SSD_TRACE_FLIP_VERTICALLY, flip);
+  uint8_t command = flip ? SSD_COMMAND_SET_COM_OUTPUT_SCAN_DIRECTION_INVERSE : SSD_COMMAND_SET_COM_OUTPUT_SCAN_DIRECTION_NORMAL;
+  return ssd1306_send_command_list(&command, 1);
+}
+
+/*rotations:
+ 0   - panel in its native orientation
+ 90  - logical origin in the top right corner of the panel, x runs down the panel
+ 180 - done by the controller segment re-map and COM scan direction, costs nothing
+ 270 - 90 rotation on top of the controller 180 rotation
+ Changing between 0/180 and 90/270 needs the screen content to be redrawn
+ */
+int ssd1306_set_rotation(uint8_t new_rotation)
+{
+  SSD1306_TRACE(SSD_TRACE_SET_ROTATION, new_rotation);
+  display->rotation = new_rotation & 0b11;
+  update_screen_size();
+  uint8_t commands[] = {
+      SSD_COMMAND_SET_SEGMENT_RE_MAP | ((display->rotation & SSD_ROTATION_180) ? 0 : SSD_DISPLAY_FLIP_HORIZONTALLY),
+      (display->rotation & SSD_ROTATION_180) ? SSD_COMMAND_SET_COM_OUTPUT_SCAN_DIRECTION_NORMAL : SSD_COMMAND_SET_COM_OUTPUT_SCAN_DIRECTION_INVERSE
+  };
+  return ssd1306_send_command_list(commands, sizeof(commands));
+}
+
+uint8_t ssd1306_get_rotation() {return display->rotation;}
+
+uint8_t ssd1306_get_screen_height() {return display->screen_height;}
+uint8_t ssd1306_get_screen_width() {return display->screen_width;}
 
 ///////////// DISPLAY COMMANDS END //////////////////
 
-int ssd1306_display(void)
+//sets the controller window filled by the following display data,
+//queued settings commands share the addressing transaction
+int ssd1306_set_window(uint8_t column_start, uint8_t column_end, uint8_t page_start, uint8_t page_end)
 {
-#ifdef USE_QUICK_DISPLAY
-  if(!was_buffer_updated) return SSD1306_SUCCESS;
-  uint8_t total_updated_pages = (updated_pixel_max_y >> 3) - (updated_pixel_min_y >> 3) + 1;
-  uint8_t *ptr;
-  uint8_t data_frame[] = {
-      SSD_commandByte,
+  SSD1306_TRACE(SSD_TRACE_SET_WINDOW, column_start, column_end, page_start, page_end);
+  uint8_t address_frame[] = {
       SSD_COMMAND_SET_PAGE_ADDRESS,
-      (updated_pixel_min_y >> 3), (updated_pixel_max_y >> 3),
+      page_start, page_end,
       SSD_COMMAND_SET_COLUMN_ADDRESS,
-      (updated_pixel_min_x), (updated_pixel_max_x)
+      column_start, column_end
   };
+  return ssd1306_send_command_frame(address_frame, sizeof(address_frame));
+}
+
+//hands the area changed since the last flush to the caller and starts a new one,
+//returns 0 when there is nothing to send
+uint8_t ssd1306_take_updated_window(uint8_t *column_start, uint8_t *column_end, uint8_t *page_start, uint8_t *page_end)
+{
+  SSD1306_TRACE_NO_ARGUMENTS(SSD_TRACE_TAKE_UPDATED_WINDOW);
+#ifdef USE_CHARACTER_MODE
+  //characters are on the panel already
+  if(!display->base_buffer) return 0;
+#endif
+#ifdef USE_QUICK_DISPLAY
+  if(!display->was_buffer_updated) return 0;
+  *column_start = display->updated_pixel_min_x;
+  *column_end = display->updated_pixel_max_x;
+  *page_start = display->updated_pixel_min_y >> 3;
+  *page_end = display->updated_pixel_max_y >> 3;
+  display->updated_pixel_min_x = 255;
+  display->updated_pixel_min_y = 255;
+  display->updated_pixel_max_x = 0;
+  display->updated_pixel_max_y = 0;
+  display->was_buffer_updated = 0;
+#else
+  *column_start = 0;
+  *column_end = SCREEN_WIDTH - 1;
+  *page_start = 0;
+  *page_end = ((SCREEN_HEIGHT + 7) / 8) - 1;
+#endif
+  return 1;
+}
 
-  if(i2cs_start_transmission(OLED_ADDRESS, 0) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  if(i2cs_send_byte_array(data_frame, sizeof(data_frame)) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  if(i2cs_end_transmission() != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+//sends a window of a page-major buffer to the same window of the controller memory,
+//buffer points to the first byte of the window, stride is the buffer width in bytes
+int ssd1306_send_window(const uint8_t *buffer, uint16_t stride,
+			uint8_t column_start, uint8_t column_end,
+			uint8_t page_start, uint8_t page_end)
+{
+  SSD1306_TRACE(SSD_TRACE_SEND_WINDOW, SSD1306_TRACE_POINTER(buffer), stride, column_start, column_end, page_start, page_end);
+  uint8_t pages_count = page_end - page_start + 1;
+  uint16_t columns_count = column_end - column_start + 1;
 
-  uint16_t columns_count = (updated_pixel_max_x - updated_pixel_min_x);
+  if(ssd1306_set_window(column_start, column_end, page_start, page_end) != SSD1306_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
 
-  if(i2cs_start_transmission(OLED_ADDRESS, 0) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  if(i2cs_send_byte(SSD_dataByte) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  for(uint8_t pages_count = 0; pages_count < total_updated_pages; pages_count++)
+  if(display->transport.ops->begin(display->transport.context, SSD1306_TRANSFER_DATA) != SSD1306_SUCCESS) return transfer_abort();
+  if(columns_count == stride)
     {
-      //      columns_count = 1;
-      ptr = (screen_buffer+(SCREEN_WIDTH*((updated_pixel_min_y >> 3) + pages_count))+updated_pixel_min_x);
-      columns_count = (updated_pixel_max_x - updated_pixel_min_x+1);
-      while (columns_count--) {
-	  if(i2cs_send_byte(*ptr++) != I2C_SUCCESS) break;
-      }
+      //rows without a gap are contiguous in the buffer, sent as one burst
+      if(display->transport.ops->write(display->transport.context, buffer, stride * pages_count) != SSD1306_SUCCESS) return transfer_abort();
+    }
+  else
+    {
+      while(pages_count--)
+	{
+	  if(display->transport.ops->write(display->transport.context, buffer, columns_count) != SSD1306_SUCCESS) return transfer_abort();
+	  buffer += stride;
+	}
     }
-  if(i2cs_end_transmission() != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  updated_pixel_min_x = 255;
-  updated_pixel_min_y = 255;
-  updated_pixel_max_x = 0;
-  updated_pixel_max_y = 0;
-  was_buffer_updated = 0;
+  if(display->transport.ops->end(display->transport.context) != SSD1306_SUCCESS) return transfer_abort();
+  return SSD1306_SUCCESS;
+}
 
-#else
-  if(i2cs_start_transmission(OLED_ADDRESS, 0) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  if(i2cs_send_byte_array(addr_res_cmd_list, sizeof(addr_res_cmd_list)) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  if(i2cs_end_transmission() != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+//sends the changed area, a failed transfer is retried from the first page not sent,
+//when all retries fail the unsent pages stay marked as changed
+int ssd1306_display(void)
+{
+  SSD1306_TRACE_NO_ARGUMENTS(SSD_TRACE_DISPLAY);
+  uint16_t backoff = retry_policy.backoff_first;
+  ssd1306_flush_begin();
+  //an empty flush sends nothing the scan could cut
+  if(display->flush_active && flush_pacing.clock && flush_pacing.wait)
+    {
+      uint32_t delay = ssd1306_get_flush_delay(flush_pacing.clock());
+      if(delay) flush_pacing.wait(delay);
+    }
+  int result = flush_run();
+  for(uint8_t attempt = 0; result != SSD1306_SUCCESS && attempt < retry_policy.retries; attempt++)
+    {
+      display->error_counters.retries++;
+      display->error_counters.retried_bytes += flush_remaining_bytes();
+      if(display->transport.ops->recover)
+	{
+	  display->error_counters.recoveries++;
+	  display->transport.ops->recover(display->transport.context);
+	}
+      if(retry_policy.delay) retry_policy.delay(backoff);
+      backoff = (backoff > retry_policy.backoff_max / 2) ? retry_policy.backoff_max : backoff * 2;
+      result = flush_run();
+    }
+  if(result != SSD1306_SUCCESS)
+    {
+      display->error_counters.failed_flushes++;
+      flush_cancel();
+    }
+  return result;
+}
 
-  uint16_t columns_count = (screen_width * ((screen_height + 7) / 8));
-  uint8_t *ptr = screen_buffer;
+void ssd1306_set_flush_pacing(uint32_t (*clock)(void), void (*wait)(uint32_t microseconds), uint32_t phase)
+{
+  flush_pacing.clock = clock;
+  flush_pacing.wait = wait;
+  if(clock) flush_pacing.origin = clock() + phase;
+}
 
-  if(i2cs_start_transmission(OLED_ADDRESS, 0) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  if(i2cs_send_byte(SSD_dataByte) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  while (columns_count--) {
-      if(i2cs_send_byte(*ptr++) != I2C_SUCCESS) break;
-  }
-  if(i2cs_end_transmission() != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+uint32_t ssd1306_get_flush_delay(uint32_t now)
+{
+  if(!flush_pacing.clock) return 0;
+  uint32_t period = ssd1306_get_frame_period();
+  int32_t elapsed = now - flush_pacing.origin;
+  //before the origin (the phase is still ahead) the wait runs up to it
+  if(elapsed < 0) return (uint32_t)-elapsed % period;
+  uint32_t offset = (uint32_t)elapsed % period;
+  return offset ? period - offset : 0;
+}
+
+//retries of ssd1306_display, backoff doubles after every retry up to backoff_max,
+//delay can be NULL to retry at once, the time unit is the one delay takes
+void ssd1306_set_retry_policy(uint8_t retries, uint16_t backoff_first, uint16_t backoff_max, void (*delay)(uint16_t time))
+{
+  retry_policy.retries = retries;
+  retry_policy.backoff_first = backoff_first;
+  retry_policy.backoff_max = backoff_max;
+  retry_policy.delay = delay;
+}
+
+const ssd1306_error_counters_t *ssd1306_get_error_counters(void)
+{
+  return &display->error_counters;
+}
+
+void ssd1306_reset_error_counters(void)
+{
+  uint8_t *ptr = (uint8_t *)&display->error_counters;
+  uint16_t size = sizeof(ssd1306_error_counters_t);
+  while(size--) *ptr++ = 0;
+}
+
+//adds a window of pages to the area sent by the next flush
+void ssd1306_mark_updated_window(uint8_t column_start, uint8_t column_end, uint8_t page_start, uint8_t page_end)
+{
+  SSD1306_TRACE(SSD_TRACE_MARK_UPDATED_WINDOW, column_start, column_end, page_start, page_end);
+  mark_updated_area(column_start, page_start << 3, column_end, (page_end << 3) + 7);
+}
+
+
+//starts a flush sent in slices by ssd1306_flush_step, the changed area is taken now,
+//drawing while it runs marks the area as changed again, so the next flush sends it
+int ssd1306_flush_begin(void)
+{
+  SSD1306_TRACE_NO_ARGUMENTS(SSD_TRACE_FLUSH_BEGIN);
+  flush_cancel();
+  display->flush_active = ssd1306_take_updated_window(&display->flush_column_start, &display->flush_column_end,
+						      &display->flush_page, &display->flush_page_end);
+  display->flush_column = display->flush_column_start;
+  return SSD1306_SUCCESS;
+}
+
+//sends up to max_bytes of display data, every step addresses the rest of the window again,
+//a failed step can be repeated
+int ssd1306_flush_step(uint16_t max_bytes)
+{
+  SSD1306_TRACE(SSD_TRACE_FLUSH_STEP, max_bytes);
+  if(!display->flush_active) return ssd1306_flush_commands();
+  if(max_bytes == 0) return SSD1306_ERROR_INVALID_ARGUMENT;
+  uint8_t page_end = display->flush_page_end;
+  //a page started by an earlier step is finished in a window of its own,
+  //the controller would wrap the following pages to the wrong column
+  if(display->flush_column != display->flush_column_start) page_end = display->flush_page;
+  if(ssd1306_set_window(display->flush_column, display->flush_column_end, display->flush_page, page_end) != SSD1306_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+  if(display->transport.ops->begin(display->transport.context, SSD1306_TRANSFER_DATA) != SSD1306_SUCCESS) return transfer_abort();
+  while(max_bytes && display->flush_page <= page_end)
+    {
+      uint16_t count = display->flush_column_end - display->flush_column + 1;
+      if(count > max_bytes) count = max_bytes;
+      if(flush_write(display->flush_page, display->flush_column, count) != SSD1306_SUCCESS) return transfer_abort();
+      max_bytes -= count;
+      display->flush_column += count;
+      if(display->flush_column > display->flush_column_end)
+	{
+	  display->flush_column = display->flush_column_start;
+	  display->flush_page++;
+	}
+    }
+  if(display->transport.ops->end(display->transport.context) != SSD1306_SUCCESS) return transfer_abort();
+  if(display->flush_page <= display->flush_page_end) return SSD1306_FLUSH_IN_PROGRESS;
+  display->flush_active = 0;
+#ifdef USE_WARM_RESTART
+  retain_frame();
 #endif
   return SSD1306_SUCCESS;
 }
 
+uint8_t ssd1306_is_flush_active(void)
+{
+  return display->flush_active;
+}
+
 static void ssd1306_fill_display(uint8_t color)
 {
-  uint16_t columns_count = screen_width * ((screen_height + 7) / 8);
-  uint8_t *buff_ptr = screen_buffer;
-  switch(color)
-  {
-    case SSD_COLOR_BLACK:
-      while(columns_count--) *buff_ptr++ = 0x00;
-      break;
-    case SSD_COLOR_WHITE:
-      while(columns_count--) *buff_ptr++ = 0xFF;
-      break;
-    case SSD_COLOR_INVERSE:
-      while(columns_count--)
+  if(color > SSD_COLOR_INVERSE) return;
+#ifdef USE_CHARACTER_MODE
+  if(!display->buffer)
+    {
+      character_fill(color);
+      return;
+    }
+#endif
+  buffer_fill_rect(0, 0, display->buffer_width - 1, display->buffer_height - 1, color);
+}
+
+#ifdef USE_CHARACTER_MODE
+static void character_forget(void)
+{
+  for(uint8_t i = 0; i < sizeof(character_cells.known); i++) character_cells.known[i] = 0;
+}
+
+//the panel is filled directly, inverting needs the old content and is not done
+static void character_fill(uint8_t color)
+{
+  uint8_t bytes[16];
+  uint16_t count = SCREEN_BUFFER_SIZE;
+  if(color == SSD_COLOR_INVERSE) return;
+  for(uint8_t i = 0; i < sizeof(bytes); i++) bytes[i] = (color == SSD_COLOR_WHITE) ? 0xFF : 0x00;
+  character_forget();
+  if(ssd1306_set_window(0, SCREEN_WIDTH - 1, 0, (SCREEN_HEIGHT / 8) - 1) != SSD1306_SUCCESS) return;
+  if(display->transport.ops->begin(display->transport.context, SSD1306_TRANSFER_DATA) != SSD1306_SUCCESS)
+    {
+      transfer_abort();
+      return;
+    }
+  for(; count; count -= sizeof(bytes))
+    if(display->transport.ops->write(display->transport.context, bytes, sizeof(bytes)) != SSD1306_SUCCESS)
+      {
+	transfer_abort();
+	return;
+      }
+  if(display->transport.ops->end(display->transport.context) != SSD1306_SUCCESS)
+    {
+      transfer_abort();
+      return;
+    }
+  //an empty cell is black, cells on a white panel are not known
+  if(color == SSD_COLOR_BLACK)
+    for(uint16_t i = 0; i < SSD1306_CHARACTER_CELLS; i++)
+      {
+	character_cells.codes[i] = 0;
+	character_cells.known[i >> 3] |= 1 << (i & 7);
+      }
+}
+
+//page bytes of one cell are built from the rows of the glyph column by column,
+//a glyph narrower than the cell gets empty columns, black and inverse text are inverted cells
+static int character_send_cell(uint8_t c, uint8_t column, uint8_t page, uint8_t pages)
+{
+  uint8_t bytes[SSD1306_CHARACTER_MAX_WIDTH];
+  uint8_t width = character_cells.cell_width, glyph_width = 0;
+  uint8_t invert = (text_parameters.text_color != SSD_COLOR_WHITE) ? 0xFF : 0x00;
+  const unsigned char *bitmap = 0;
+  if(c)
+    {
+      uint16_t charHeadIndex = (((int)c - font_parameters.first_char_index) << 2) + 8;
+      glyph_width = font_parameters.font_family[charHeadIndex];
+      bitmap = font_parameters.font_family
+	  + ((((uint32_t)(font_parameters.font_family[charHeadIndex + 3])) << 16)
+	      | (((uint16_t)(font_parameters.font_family[charHeadIndex + 2])) << 8)
+	      | (font_parameters.font_family[charHeadIndex + 1]));
+    }
+  uint8_t bytesPerRow = (glyph_width + 7) >> 3;
+  if(ssd1306_set_window(column, column + width - 1, page, page + pages - 1) != SSD1306_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+  if(display->transport.ops->begin(display->transport.context, SSD1306_TRANSFER_DATA) != SSD1306_SUCCESS) return transfer_abort();
+  for(uint8_t cell_page = 0; cell_page < pages; cell_page++)
+    {
+      for(uint8_t x = 0; x < width; x++)
 	{
-	  *buff_ptr = ~(*buff_ptr);
-	  buff_ptr++;
+	  uint8_t byte = 0;
+	  for(uint8_t bit = 0; bit < 8 && x < glyph_width; bit++)
+	    {
+	      uint8_t row = cell_page * 8 + bit;
+	      if(row >= font_parameters.char_height) break;
+	      if((bitmap[row * bytesPerRow + (x >> 3)] >> (x & 0b111)) & 1) byte |= 1 << bit;
+	    }
+	  bytes[x] = byte ^ invert;
 	}
-      break;
-    default:
-      break;
-  }
-#ifdef USE_QUICK_DISPLAY
-  updated_pixel_min_x = 0;
-  updated_pixel_min_y = 0;
-  updated_pixel_max_x = SCREEN_WIDTH-1;
-  updated_pixel_max_y = SCREEN_HEIGHT-1;
-  was_buffer_updated = 1;
-#endif
+      if(display->transport.ops->write(display->transport.context, bytes, width) != SSD1306_SUCCESS) return transfer_abort();
+    }
+  if(display->transport.ops->end(display->transport.context) != SSD1306_SUCCESS) return transfer_abort();
+  return SSD1306_SUCCESS;
 }
 
+//writes the character into the cell under the cursor unless it is shown there already
+static int character_write(uint8_t c)
+{
+  const unsigned char *font = font_parameters.font_family;
+  if(!font) return 1;
+  if(character_cells.font != font)
+    {
+      character_cells.font = font;
+      character_cells.glyph_width = 0;
+      for(uint16_t i = font_parameters.first_char_index; i <= font_parameters.last_char_index; i++)
+	{
+	  uint8_t width = font[((i - font_parameters.first_char_index) << 2) + 8];
+	  if(character_cells.glyph_width < width) character_cells.glyph_width = width;
+	}
+      character_forget();
+    }
+  int16_t cell_width = character_cells.glyph_width + text_parameters.letter_spacing;
+  if(cell_width < 1) cell_width = 1;
+  if(cell_width > SSD1306_CHARACTER_MAX_WIDTH) cell_width = SSD1306_CHARACTER_MAX_WIDTH;
+  if(character_cells.cell_width != cell_width || character_cells.color != text_parameters.text_color)
+    {
+      character_cells.cell_width = cell_width;
+      character_cells.color = text_parameters.text_color;
+      character_forget();
+    }
+  uint8_t pages = text_line_height() >> 3;
+  int16_t first_column = text_parameters.offset_x, first_page = text_parameters.offset_y >> 3;
+  uint8_t columns = (first_column < SCREEN_WIDTH) ? (SCREEN_WIDTH - first_column) / cell_width : 0;
+  uint8_t column = cursor_coords.x / cell_width;
+  uint8_t row = cursor_coords.y / (pages * 8);
+  cursor_coords.x = (column + 1) * cell_width;
+  if(column >= columns || first_page + (row + 1) * pages > SCREEN_HEIGHT / 8) return 1;
+  if(c < font_parameters.first_char_index || c > font_parameters.last_char_index || c == ' ') c = 0;
+  uint16_t cell = row * columns + column;
+  uint8_t shadowed = (cell < SSD1306_CHARACTER_CELLS);
+  if(shadowed && ((character_cells.known[cell >> 3] >> (cell & 7)) & 1) && character_cells.codes[cell] == c) return 1;
+  if(character_send_cell(c, first_column + column * cell_width, first_page + row * pages, pages) != SSD1306_SUCCESS)
+    {
+      //the cell may be half written
+      if(shadowed) character_cells.known[cell >> 3] &= ~(1 << (cell & 7));
+      return 1;
+    }
+  if(shadowed)
+    {
+      character_cells.codes[cell] = c;
+      character_cells.known[cell >> 3] |= 1 << (cell & 7);
+    }
+  return 1;
+}
+#endif
+
 void ssd1306_clear_display(void)
 {
+  SSD1306_TRACE_NO_ARGUMENTS(SSD_TRACE_CLEAR_DISPLAY);
   ssd1306_fill_display(SSD_COLOR_BLACK);
 }
 
 void ssd1306_display_empty(void)
 {
+  SSD1306_TRACE_NO_ARGUMENTS(SSD_TRACE_DISPLAY_EMPTY);
   ssd1306_fill_display(SSD_COLOR_BLACK);
   ssd1306_display();
 }
 
 void ssd1306_display_full(void)
 {
+  SSD1306_TRACE_NO_ARGUMENTS(SSD_TRACE_DISPLAY_FULL);
   ssd1306_fill_display(SSD_COLOR_WHITE);
   ssd1306_display();
 }
 
 
+void ssd1306_layer_init(ssd1306_layer_t *layer, uint8_t *buffer, const uint8_t *mask, uint8_t rop)
+{
+  SSD1306_TRACE(SSD_TRACE_LAYER_INIT, SSD1306_TRACE_POINTER(layer), SSD1306_TRACE_POINTER(buffer), SSD1306_TRACE_POINTER(mask), rop);
+  layer->buffer = buffer;
+  layer->mask = mask;
+  layer->rop = rop;
+  layer->visible = 0;
+  layer->column_start = 0;
+  layer->column_end = SCREEN_WIDTH - 1;
+  layer->page_start = 0;
+  layer->page_end = ((SCREEN_HEIGHT + 7) / 8) - 1;
+  layer->above = 0;
+  for(uint16_t i = 0; i < SCREEN_BUFFER_SIZE; i++) buffer[i] = 0;
+}
+
+void ssd1306_add_layer(ssd1306_layer_t *layer)
+{
+  SSD1306_TRACE(SSD_TRACE_ADD_LAYER, SSD1306_TRACE_POINTER(layer));
+  ssd1306_layer_t **link = &display->layers;
+  while(*link) link = &(*link)->above;
+  *link = layer;
+  layer->above = 0;
+  if(layer->visible) ssd1306_mark_updated_window(layer->column_start, layer->column_end, layer->page_start, layer->page_end);
+}
+
+void ssd1306_remove_layer(ssd1306_layer_t *layer)
+{
+  SSD1306_TRACE(SSD_TRACE_REMOVE_LAYER, SSD1306_TRACE_POINTER(layer));
+  ssd1306_layer_t **link = &display->layers;
+  while(*link && *link != layer) link = &(*link)->above;
+  if(!*link) return;
+  *link = layer->above;
+  if(display->buffer == layer->buffer) display->buffer = display->base_buffer;
+  if(layer->visible) ssd1306_mark_updated_window(layer->column_start, layer->column_end, layer->page_start, layer->page_end);
+}
+
+void ssd1306_set_layer_bounds(ssd1306_layer_t *layer, int16_t x, int16_t y, int16_t width, int16_t height)
+{
+  SSD1306_TRACE(SSD_TRACE_SET_LAYER_BOUNDS, SSD1306_TRACE_POINTER(layer), x, y, width, height);
+  int16_t x0 = x < 0 ? 0 : x, y0 = y < 0 ? 0 : y, x1 = x + width - 1, y1 = y + height - 1, temp;
+  if(x1 >= display->screen_width) x1 = display->screen_width - 1;
+  if(y1 >= display->screen_height) y1 = display->screen_height - 1;
+  if(x0 > x1 || y0 > y1) return;
+  if(display->rotation & SSD_ROTATION_90)
+    {
+      temp = x0;
+      x0 = (SCREEN_WIDTH - 1) - y1;
+      y1 = x1;
+      x1 = (SCREEN_WIDTH - 1) - y0;
+      y0 = temp;
+    }
+  //the old bounds have to be sent again as well
+  if(layer->visible) ssd1306_mark_updated_window(layer->column_start, layer->column_end, layer->page_start, layer->page_end);
+  layer->column_start = x0;
+  layer->column_end = x1;
+  layer->page_start = y0 >> 3;
+  layer->page_end = y1 >> 3;
+  if(layer->visible) ssd1306_mark_updated_window(layer->column_start, layer->column_end, layer->page_start, layer->page_end);
+}
+
+//nothing is redrawn, the bounds are composed again by the next flush
+void ssd1306_show_layer(ssd1306_layer_t *layer, uint8_t visible)
+{
+  SSD1306_TRACE(SSD_TRACE_SHOW_LAYER, SSD1306_TRACE_POINTER(layer), visible);
+  if(layer->visible == visible) return;
+  layer->visible = visible;
+  ssd1306_mark_updated_window(layer->column_start, layer->column_end, layer->page_start, layer->page_end);
+}
+
+void ssd1306_draw_to_layer(ssd1306_layer_t *layer)
+{
+  SSD1306_TRACE(SSD_TRACE_DRAW_TO_LAYER, SSD1306_TRACE_POINTER(layer));
+  display->buffer = layer ? layer->buffer : display->base_buffer;
+}
+
+int ssd1306_canvas_init(ssd1306_canvas_t *canvas, uint8_t *buffer, uint8_t width, uint8_t height)
+{
+  SSD1306_TRACE(SSD_TRACE_CANVAS_INIT, SSD1306_TRACE_POINTER(canvas), SSD1306_TRACE_POINTER(buffer), width, height);
+  if(!canvas || !buffer || width < 1 || width > SCREEN_WIDTH || height < 1) return SSD1306_ERROR_INVALID_ARGUMENT;
+  canvas->buffer = buffer;
+  canvas->width = width;
+  canvas->height = height;
+  for(uint16_t i = 0; i < width * ((height + 7) >> 3); i++) buffer[i] = 0;
+  return SSD1306_SUCCESS;
+}
+
+//the screen target is kept while canvases are drawn to, one canvas can follow another
+void ssd1306_draw_to_canvas(ssd1306_canvas_t *canvas)
+{
+  SSD1306_TRACE(SSD_TRACE_DRAW_TO_CANVAS, SSD1306_TRACE_POINTER(canvas));
+  if(!display->canvas)
+    {
+      if(!canvas) return;
+      display->saved_buffer = display->buffer;
+      display->saved_rotation = display->rotation;
+      display->saved_clip_rect = display->clip_rect;
+    }
+  display->canvas = canvas;
+  if(!canvas)
+    {
+      display->buffer = display->saved_buffer;
+      display->buffer_width = SCREEN_WIDTH;
+      display->buffer_height = SCREEN_HEIGHT;
+      display->rotation = display->saved_rotation;
+      update_screen_size();
+      display->clip_rect = display->saved_clip_rect;
+      return;
+    }
+  display->buffer = canvas->buffer;
+  display->buffer_width = canvas->width;
+  display->buffer_height = canvas->height;
+  //hardware flips do not apply to a canvas, the 90 degree transform of the drawing functions is left out
+  display->rotation = SSD_ROTATION_0;
+  display->screen_width = canvas->width;
+  display->screen_height = canvas->height;
+  ssd1306_reset_clip_rect();
+}
+
+//a page-major canvas is a page bitmap, copied with shifted bytes
+void ssd1306_draw_canvas(const ssd1306_canvas_t *canvas, int16_t x, int16_t y, uint8_t rop)
+{
+  SSD1306_TRACE(SSD_TRACE_DRAW_CANVAS, SSD1306_TRACE_POINTER(canvas), x, y, rop);
+  ssd1306_draw_page_bitmap(canvas->buffer, canvas->width, canvas->height, x, y, rop);
+}
+
+
 static int ssd1306_send_init_sequence(void)
 {
   uint8_t comPinsConf = 0x02;
-  if(screen_width == 128 && screen_height == 64) comPinsConf = 0x12;
+  if(SCREEN_WIDTH == 128 && SCREEN_HEIGHT == 64) comPinsConf = 0x12;
   uint8_t initList[] = {
-      SSD_commandByte,
       SSD_COMMAND_DISPLAY_OFF,
       SSD_COMMAND_MUX_RATIO,
-      (screen_height - 1),
+      (display->timing.multiplex - 1),
       SSD_COMMAND_SET_PAGE_ADDRESS,
-      0, (screen_height / 8 - 1),
+      0, (SCREEN_HEIGHT / 8 - 1),
       SSD_COMMAND_SET_COLUMN_ADDRESS,
-      0, (screen_width - 1),
+      0, (SCREEN_WIDTH - 1),
       SSD_COMMAND_DISPLAY_OFFSET,
       (0x00),
       (0x40), //set display start line to 0
-      SSD_COMMAND_SET_SEGMENT_RE_MAP | SSD_DISPLAY_FLIP_HORIZONTALLY,
-      SSD_COMMAND_SET_COM_OUTPUT_SCAN_DIRECTION_INVERSE,
+      SSD_COMMAND_SET_SEGMENT_RE_MAP | ((display->rotation & SSD_ROTATION_180) ? 0 : SSD_DISPLAY_FLIP_HORIZONTALLY),
+      (display->rotation & SSD_ROTATION_180) ? SSD_COMMAND_SET_COM_OUTPUT_SCAN_DIRECTION_NORMAL : SSD_COMMAND_SET_COM_OUTPUT_SCAN_DIRECTION_INVERSE,
       SSD_COMMAND_COM_PINS_CONFIGURATION,
       comPinsConf,
       SSD_COMMAND_MEMORY_ADDRESSING_MODE,
       0x00,
       SSD_COMMAND_CONTRAST,
-      0xF7,
+      SSD_INIT_CONTRAST,
       SSD_COMMAND_DISABLE_ENTIRE_DISPLAY_ON,
       SSD_COMMAND_SET_DISPLAY_NORMAL,
       SSD_COMMAND_SET_CLOCK_DIV,
-      0x80,
+      (display->timing.oscillator << 4) | (display->timing.divide_ratio - 1),
       SSD_COMMAND_CHARGE_PUMP,
       0x14,
       SSD_COMMAND_PRE_CHARGE,
-      0x22,
+      (display->timing.phase2 << 4) | display->timing.phase1,
       SSD_COMMAND_DEACTIVATE_SCROLL,
+      SSD_COMMAND_FADE_BLINK,
+      SSD_FADE_OFF,
+      SSD_COMMAND_ZOOM_IN,
+      0x00,
       SSD_COMMAND_DISPLAY_ON
   };
-  if (i2cs_start_transmission(OLED_ADDRESS, 0) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
-  i2cs_send_byte_array(initList, sizeof(initList));
-  i2cs_end_transmission();
+  if(display->transport.ops->begin(display->transport.context, SSD1306_TRANSFER_COMMAND) != SSD1306_SUCCESS) return transfer_abort();
+  if(display->transport.ops->write(display->transport.context, initList, sizeof(initList)) != SSD1306_SUCCESS) return transfer_abort();
+  if(display->transport.ops->end(display->transport.context) != SSD1306_SUCCESS) return transfer_abort();
+  display->contrast.current = SSD_INIT_CONTRAST;
+  display->contrast.active = 0;
+  if(display->zoom)
+    {
+      display->zoom = 0;
+      update_screen_size();
+    }
   //clearDisplay();
+  //commands queued before init are sent along with the first frame
   ssd1306_display_empty();
   return SSD1306_SUCCESS;
 }
 
 
 
-static int abs(int i)
+static void read_font_parameters(const unsigned char *fonts, font_parameters_t *parameters)
 {
-  return i > 0 ? i : -i;
+  parameters->font_family = fonts;
+  parameters->first_char_index = (fonts[0x03]) << 8 | (fonts[0x02]);
+  parameters->last_char_index = (fonts[0x05]) << 8 | (fonts[0x04]);
+  parameters->char_height = (fonts[0x06]);
+}
+
+//each run of set bits of a glyph row becomes one scaled rectangle,
+//rotated screens get it as masked page bytes from the same kernel
+static uint8_t draw_glyph(const font_parameters_t *font, uint8_t c, int16_t x, int16_t y, uint8_t scale, uint8_t color)
+{
+  uint8_t charBitmapByte;
+  if(!font->font_family || c < font->first_char_index || c > font->last_char_index) return 0;
+  uint16_t charHeadIndex =  (((int)c - font->first_char_index) << 2) + 8 ;
+  uint8_t charWidth = (font->font_family[charHeadIndex]);
+  uint32_t charOffset =
+      (((uint32_t)(font->font_family[charHeadIndex + 3])) << 16)
+      | (((uint16_t)(font->font_family[charHeadIndex + 2])) << 8)
+      | (font->font_family[charHeadIndex+1]);
+  uint8_t bytesPerRow = (charWidth + 7) >> 3;
+  int16_t runStart;
+  for(uint8_t row = 0; row < font->char_height; row++)
+    {
+      runStart = -1;
+      charBitmapByte = 0;
+      for(uint8_t column = 0; column < charWidth; column++)
+	{
+	  if((column & 0b111) == 0) charBitmapByte = (font->font_family[charOffset + row * bytesPerRow + (column >> 3)]);
+	  if((charBitmapByte >> (column & 0b111)) & 1)
+	    {
+	      if(runStart < 0) runStart = column;
+	    }
+	  else if(runStart >= 0)
+	    {
+	      fill_rect_clipped(x + runStart * scale, y + row * scale,
+				x + column * scale - 1, y + (row + 1) * scale - 1, color);
+	      runStart = -1;
+	    }
+	}
+      if(runStart >= 0)
+	fill_rect_clipped(x + runStart * scale, y + row * scale,
+			  x + charWidth * scale - 1, y + (row + 1) * scale - 1, color);
+    }
+  return charWidth;
+}
+
+//grows the area sent by the next ssd1306_display, panel coordinates
+static void mark_updated_area(int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+{
+#ifdef USE_QUICK_DISPLAY
+  if(display->canvas) return;
+  display->was_buffer_updated = 1;
+  if(display->updated_pixel_min_x > x0) display->updated_pixel_min_x = x0;
+  if(display->updated_pixel_max_x < x1) display->updated_pixel_max_x = x1;
+  if(display->updated_pixel_min_y > y0) display->updated_pixel_min_y = y0;
+  if(display->updated_pixel_max_y < y1) display->updated_pixel_max_y = y1;
+#else
+  //the whole panel is sent every time
+  (void)x0;
+  (void)y0;
+  (void)x1;
+  (void)y1;
+#endif
+}
+
+//size of the drawing area for the rotation, a zoomed panel shows only the upper half of the rows
+static void update_screen_size(void)
+{
+  uint8_t rows = display->zoom ? SCREEN_HEIGHT / 2 : SCREEN_HEIGHT;
+  display->screen_width = (display->rotation & SSD_ROTATION_90) ? rows : SCREEN_WIDTH;
+  display->screen_height = (display->rotation & SSD_ROTATION_90) ? SCREEN_WIDTH : rows;
+  ssd1306_reset_clip_rect();
+}
+
+//sends count bytes of a page of the picture, composed from the layers when there are any
+static int flush_write(uint8_t page, uint8_t column, uint16_t count)
+{
+  if(display->layers) return flush_write_composed(page, column, count);
+  return display->transport.ops->write(display->transport.context,
+				       display->base_buffer + page * SCREEN_WIDTH + column, count);
+}
+
+//the layers are combined in a page row on the stack, only within their bounds
+static int flush_write_composed(uint8_t page, uint8_t column, uint16_t count)
+{
+  uint32_t row[SCREEN_WIDTH / 4];
+  uint8_t *line = (uint8_t *)row;
+  uint16_t offset = page * SCREEN_WIDTH, first, last;
+  compose_span(line + column, display->base_buffer + offset + column, 0, count, SSD_ROP_COPY);
+  for(const ssd1306_layer_t *layer = display->layers; layer; layer = layer->above)
+    {
+      if(!layer->visible || page < layer->page_start || page > layer->page_end) continue;
+      first = column > layer->column_start ? column : layer->column_start;
+      last = column + count - 1 < layer->column_end ? column + count - 1 : layer->column_end;
+      if(first > last) continue;
+      compose_span(line + first, layer->buffer + offset + first,
+		   layer->mask ? layer->mask + offset + first : 0, last - first + 1, layer->rop);
+    }
+  return display->transport.ops->write(display->transport.context, line + column, count);
+}
+
+//combines source into destination, a word at a time where both are word aligned
+static void compose_span(uint8_t *destination, const uint8_t *source, const uint8_t *mask, uint16_t count, uint8_t rop)
+{
+  uint32_t bits, word_mask;
+  if(rop != SSD_ROP_COPY) mask = 0;
+  if(REFERENCE_RASTER)
+    {
+      while(count--) apply_rop(destination++, *source++, mask ? *mask++ : 0xFF, rop);
+      return;
+    }
+  while(count && ((uintptr_t)destination & 0b11))
+    {
+      apply_rop(destination++, *source++, mask ? *mask++ : 0xFF, rop);
+      count--;
+    }
+  if(!((uintptr_t)source & 0b11) && !((uintptr_t)mask & 0b11))
+    {
+      for(; count >= 4; count -= 4, destination += 4, source += 4)
+	{
+	  bits = *(const buffer_word_t *)source;
+	  word_mask = 0xFFFFFFFF;
+	  if(mask)
+	    {
+	      word_mask = *(const buffer_word_t *)mask;
+	      mask += 4;
+	    }
+	  switch(rop)
+	  {
+	    case SSD_ROP_COPY:
+	      *(buffer_word_t *)destination = (*(buffer_word_t *)destination & ~word_mask) | (bits & word_mask);
+	      break;
+	    case SSD_ROP_OR:
+	      *(buffer_word_t *)destination |= bits;
+	      break;
+	    case SSD_ROP_CLEAR:
+	      *(buffer_word_t *)destination &= ~bits;
+	      break;
+	    default:
+	      *(buffer_word_t *)destination ^= bits;
+	      break;
+	  }
+	}
+    }
+  while(count--) apply_rop(destination++, *source++, mask ? *mask++ : 0xFF, rop);
+}
+
+//gives the unsent pages of a running flush back to the changed area
+static void flush_cancel(void)
+{
+  if(!display->flush_active) return;
+  ssd1306_mark_updated_window(display->flush_column_start, display->flush_column_end,
+			      display->flush_page, display->flush_page_end);
+  display->flush_active = 0;
+}
+
+//sends the whole running flush, a page resumed in the middle takes an extra step
+static int flush_run(void)
+{
+  int result;
+  do
+    {
+      result = ssd1306_flush_step(UINT16_MAX);
+    }
+  while(result == SSD1306_FLUSH_IN_PROGRESS);
+  return result;
+}
+
+static uint16_t flush_remaining_bytes(void)
+{
+  if(!display->flush_active) return 0;
+  uint16_t columns = display->flush_column_end - display->flush_column_start + 1;
+  return columns * (display->flush_page_end - display->flush_page + 1) - (display->flush_column - display->flush_column_start);
+}
+
+//closes a failed transaction so the bus is released, the error is counted
+static int transfer_abort(void)
+{
+  display->error_counters.failed_transfers++;
+  display->transport.ops->end(display->transport.context);
+  return SSD1306_ERROR_COMMUNICATION;
+}
+
+//rows y0..y1 that fall into the page
+static uint8_t page_clip_mask(int16_t page, int16_t y0, int16_t y1)
+{
+  uint8_t mask = 0xFF;
+  if(page == (y0 >> 3)) mask &= 0xFF << (y0 & 0b111);
+  if(page == (y1 >> 3)) mask &= 0xFF >> (7 - (y1 & 0b111));
+  return mask;
+}
+
+//only pixels in mask are changed
+static void apply_rop(uint8_t *destination, uint8_t bits, uint8_t mask, uint8_t rop)
+{
+  switch(rop)
+  {
+    case SSD_ROP_COPY:
+      if(mask == 0xFF) *destination = bits;
+      else *destination = (*destination & ~mask) | (bits & mask);
+      break;
+    case SSD_ROP_OR:
+      *destination |= bits & mask;
+      break;
+    case SSD_ROP_CLEAR:
+      *destination &= ~(bits & mask);
+      break;
+    default:
+      *destination ^= bits & mask;
+      break;
+  }
+}
+
+//fills a rectangle of the screen buffer given in panel coordinates,
+//coordinates have to be already clipped and sorted
+static void buffer_fill_rect(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t color)
+{
+  mark_updated_area(x0, y0, x1, y1);
+  if(REFERENCE_RASTER)
+    {
+      for(int16_t y = y0; y <= y1; y++)
+	for(int16_t x = x0; x <= x1; x++) buffer_put_pixel(x, y, color);
+      return;
+    }
+  uint8_t last_page = y1 >> 3;
+  uint8_t columns = x1 - x0 + 1;
+  for(uint8_t page = y0 >> 3; page <= last_page; page++)
+    fill_span(display->buffer + page * display->buffer_width + x0, columns, page_clip_mask(page, y0, y1), color);
+}
+
+//sets, clears or inverts the mask bits of count bytes, a word at a time in the middle
+static void fill_span(uint8_t *ptr, uint16_t count, uint8_t mask, uint8_t color)
+{
+  uint32_t word_mask = mask * 0x01010101UL;
+  switch (color) {
+    case SSD_COLOR_BLACK:
+      for(; count && ((uintptr_t)ptr & 0b11); count--) *ptr++ &= ~mask;
+      for(; count >= 4; count -= 4, ptr += 4) *(buffer_word_t *)ptr &= ~word_mask;
+      while(count--) *ptr++ &= ~mask;
+      break;
+    case SSD_COLOR_WHITE:
+      for(; count && ((uintptr_t)ptr & 0b11); count--) *ptr++ |= mask;
+      for(; count >= 4; count -= 4, ptr += 4) *(buffer_word_t *)ptr |= word_mask;
+      while(count--) *ptr++ |= mask;
+      break;
+    default:
+      for(; count && ((uintptr_t)ptr & 0b11); count--) *ptr++ ^= mask;
+      for(; count >= 4; count -= 4, ptr += 4) *(buffer_word_t *)ptr ^= word_mask;
+      while(count--) *ptr++ ^= mask;
+      break;
+  }
+}
+
+//copies a rectangle of the buffer in panel coordinates, both rectangles have to be on the screen,
+//every destination page row is shifted into a row on the stack first, so the rectangles may overlap
+static void buffer_copy_rect(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t dx, int16_t dy)
+{
+  uint32_t row[SCREEN_WIDTH / 4];
+  uint8_t *line = (uint8_t *)row;
+  int16_t first_page = (y0 + dy) >> 3, last_page = (y1 + dy) >> 3, step = 1, page, source_page;
+  uint8_t offset = (-dy) & 0b111, columns = x1 - x0 + 1, mask;
+  const uint8_t *upper, *lower;
+  mark_updated_area(x0 + dx, y0 + dy, x1 + dx, y1 + dy);
+  if(REFERENCE_RASTER)
+    {
+      //like memmove, pixels are copied starting at the side the rectangle moves to
+      int16_t x_first = (dx > 0) ? x1 : x0, x_last = (dx > 0) ? x0 : x1, x_step = (dx > 0) ? -1 : 1;
+      int16_t y_first = (dy > 0) ? y1 : y0, y_last = (dy > 0) ? y0 : y1, y_step = (dy > 0) ? -1 : 1;
+      for(int16_t y = y_first; ; y += y_step)
+	{
+	  for(int16_t x = x_first; ; x += x_step)
+	    {
+	      buffer_put_pixel(x + dx, y + dy, (display->buffer[(y >> 3) * display->buffer_width + x] >> (y & 0b111)) & 1);
+	      if(x == x_last) break;
+	    }
+	  if(y == y_last) break;
+	}
+      return;
+    }
+  //moving down, lower pages are written first, their sources are above them
+  if(dy > 0)
+    {
+      page = first_page;
+      first_page = last_page;
+      last_page = page;
+      step = -1;
+    }
+  for(page = first_page; ; page += step)
+    {
+      //rows of the destination page start offset rows into source_page
+      source_page = floor_div(((int32_t)page << 3) - dy, 8);
+      upper = (source_page >= 0) ? display->buffer + source_page * display->buffer_width + x0 : 0;
+      lower = (offset && source_page + 1 <= ((display->buffer_height - 1) >> 3)) ? display->buffer + (source_page + 1) * display->buffer_width + x0 : 0;
+      shift_span(line + x0 + dx, upper, lower, columns, offset);
+      mask = page_clip_mask(page, y0 + dy, y1 + dy);
+      if(mask == 0xFF) compose_span(display->buffer + page * display->buffer_width + x0 + dx, line + x0 + dx, 0, columns, SSD_ROP_COPY);
+      else
+	for(uint8_t column = 0; column < columns; column++)
+	  apply_rop(display->buffer + page * display->buffer_width + x0 + dx + column, line[x0 + dx + column], mask, SSD_ROP_COPY);
+      if(page == last_page) break;
+    }
+}
+
+//destination byte i gets the rows from offset on of upper[i] followed by the first rows of lower[i],
+//a missing page reads as empty, bytes of four columns are shifted in one word where aligned
+static void shift_span(uint8_t *destination, const uint8_t *upper, const uint8_t *lower, uint16_t count, uint8_t offset)
+{
+  static const uint8_t empty[4] __attribute__((aligned(4))) = {0};
+  uint32_t keep = (0xFF >> offset) * 0x01010101UL, lower_word;
+  uint8_t upper_step = upper ? 1 : 0, lower_step = lower ? 1 : 0;
+  if(!upper) upper = empty;
+  if(!lower) lower = empty;
+  for(; count && ((uintptr_t)destination & 0b11); count--, upper += upper_step, lower += lower_step)
+    *destination++ = (*upper >> offset) | (offset ? *lower << (8 - offset) : 0);
+  if(!(((uintptr_t)upper | (uintptr_t)lower) & 0b11))
+    for(; count >= 4; count -= 4, destination += 4, upper += upper_step << 2, lower += lower_step << 2)
+      {
+	lower_word = offset ? (*(const buffer_word_t *)lower << (8 - offset)) & ~keep : 0;
+	*(buffer_word_t *)destination = ((*(const buffer_word_t *)upper >> offset) & keep) | lower_word;
+      }
+  for(; count; count--, upper += upper_step, lower += lower_step)
+    *destination++ = (*upper >> offset) | (offset ? *lower << (8 - offset) : 0);
+}
+
+//copies a rectangle given in panel coordinates from source, both have the layout of the buffer
+static void buffer_restore_rect(const uint8_t *source, int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+{
+  mark_updated_area(x0, y0, x1, y1);
+  if(REFERENCE_RASTER)
+    {
+      for(int16_t y = y0; y <= y1; y++)
+	for(int16_t x = x0; x <= x1; x++)
+	  buffer_put_pixel(x, y, (source[(y >> 3) * display->buffer_width + x] >> (y & 0b111)) & 1);
+      return;
+    }
+  uint8_t mask;
+  uint16_t offset;
+  for(int16_t page = y0 >> 3; page <= (y1 >> 3); page++)
+    {
+      mask = page_clip_mask(page, y0, y1);
+      offset = page * display->buffer_width;
+      for(int16_t column = x0; column <= x1; column++)
+	apply_rop(display->buffer + offset + column, source[offset + column], mask, SSD_ROP_COPY);
+    }
+}
+
+//sets, clears or inverts a pixel of the buffer in panel coordinates
+static void buffer_put_pixel(int16_t x, int16_t y, uint8_t color)
+{
+  uint8_t *ptr = display->buffer + (y >> 3) * display->buffer_width + x;
+  if(color == SSD_COLOR_BLACK) *ptr &= ~(1 << (y & 0b111));
+  else if(color == SSD_COLOR_WHITE) *ptr |= 1 << (y & 0b111);
+  else *ptr ^= 1 << (y & 0b111);
 }
 
-static void swap_uint8_t(uint8_t *a, uint8_t *b)
+//clips a rectangle in screen coordinates and
+//maps it to the panel coordinates of the current rotation
+static void fill_rect_clipped(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t color)
 {
-  uint8_t temp = *a;
-  *a = *b;
-  *b = temp;
+  if (x0 > x1) swap_int16_t(&x0, &x1);
+  if (y0 > y1) swap_int16_t(&y0, &y1);
+  if(x1 < display->clip_rect.x0 || y1 < display->clip_rect.y0 || x0 > display->clip_rect.x1 || y0 > display->clip_rect.y1) return;
+  if(x0 < display->clip_rect.x0) x0 = display->clip_rect.x0;
+  if(y0 < display->clip_rect.y0) y0 = display->clip_rect.y0;
+  if(x1 > display->clip_rect.x1) x1 = display->clip_rect.x1;
+  if(y1 > display->clip_rect.y1) y1 = display->clip_rect.y1;
+  //empty clip rectangle
+  if(x0 > x1 || y0 > y1) return;
+  if(REFERENCE_RASTER)
+    {
+      for(int16_t y = y0; y <= y1; y++)
+	for(int16_t x = x0; x <= x1; x++) ssd1306_draw_pixel(x, y, color);
+      return;
+    }
+  if(display->rotation & SSD_ROTATION_90)
+    {
+      buffer_fill_rect((SCREEN_WIDTH - 1) - y1, x0, (SCREEN_WIDTH - 1) - y0, x1, color);
+      return;
+    }
+  buffer_fill_rect(x0, y0, x1, y1, color);
+}
+
+#ifdef USE_WARM_RESTART
+static uint32_t crc32_buffer(const uint8_t *data, uint16_t length)
+{
+  static const uint32_t nibble_table[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+      0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  uint32_t crc = 0xFFFFFFFF;
+  while(length--)
+    {
+      crc ^= *data++;
+      crc = (crc >> 4) ^ nibble_table[crc & 0x0F];
+      crc = (crc >> 4) ^ nibble_table[crc & 0x0F];
+    }
+  return ~crc;
+}
+
+//called after a successful flush, the buffer then matches the panel content
+static void retain_frame(void)
+{
+  if(display != &default_display) return;
+#ifdef USE_QUICK_DISPLAY
+  //changes not sent yet mean the buffer differs from the panel
+  if(display->was_buffer_updated)
+    {
+      retained_frame.magic = 0;
+      return;
+    }
+#endif
+  retained_frame.frame_crc = crc32_buffer(display->base_buffer, SCREEN_BUFFER_SIZE);
+  retained_frame.rotation = display->rotation;
+  retained_frame.magic = RETAINED_FRAME_MAGIC;
+}
+#endif
+
+//Bresenham line cut analytically to the clip rectangle and emitted as runs:
+//horizontal runs for shallow lines, vertical runs (masked page bytes) for steep ones.
+//Pixels are the same as walking the whole line from its left (top) end.
+static void draw_line_runs(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t thickness, uint8_t color)
+{
+  uint8_t steep = abs(x1 - x0) < abs(y1 - y0);
+  int16_t major0 = steep ? y0 : x0, minor0 = steep ? x0 : y0;
+  int16_t major1 = steep ? y1 : x1, minor1 = steep ? x1 : y1;
+  if(major0 > major1)
+    {
+      swap_int16_t(&major0, &major1);
+      swap_int16_t(&minor0, &minor1);
+    }
+  int32_t major_delta = major1 - major0, minor_delta = abs(minor1 - minor0);
+  int8_t minor_step = minor1 < minor0 ? -1 : 1;
+  int32_t half = major_delta >> 1;
+  //the brush reaches this far from the thin line across the major axis
+  int16_t brush_before = (thickness - 1) >> 1, brush_after = thickness >> 1;
+
+  int32_t major_min = steep ? display->clip_rect.y0 : display->clip_rect.x0, major_max = steep ? display->clip_rect.y1 : display->clip_rect.x1;
+  int32_t minor_min = (steep ? display->clip_rect.x0 : display->clip_rect.y0) - brush_after;
+  int32_t minor_max = (steep ? display->clip_rect.x1 : display->clip_rect.y1) + brush_before;
+
+  if(REFERENCE_RASTER)
+    {
+      //the whole line step by step, the brush is cut to the clip rectangle only
+      int32_t err = half, minor = minor0;
+      int32_t across_min = steep ? display->clip_rect.x0 : display->clip_rect.y0;
+      int32_t across_max = steep ? display->clip_rect.x1 : display->clip_rect.y1;
+      for(int32_t k = 0; k <= major_delta; k++)
+	{
+	  int32_t across_first = minor - brush_before, across_last = minor + brush_after;
+	  if(across_first < across_min) across_first = across_min;
+	  if(across_last > across_max) across_last = across_max;
+	  if(!line_pattern.length || ((line_pattern.pattern >> (k % line_pattern.length)) & 1))
+	    for(int32_t across = across_first; across <= across_last; across++)
+	      {
+		if(steep) ssd1306_draw_pixel(across, major0 + k, color);
+		else ssd1306_draw_pixel(major0 + k, across, color);
+	      }
+	  err -= minor_delta;
+	  if(err < 0)
+	    {
+	      err += major_delta;
+	      minor += minor_step;
+	    }
+	}
+      return;
+    }
+
+  //step range k of the major axis inside the clip rectangle
+  int32_t k_first = major_min - major0 > 0 ? major_min - major0 : 0;
+  int32_t k_last = major_max - major0 < major_delta ? major_max - major0 : major_delta;
+  //minor offset after k steps is m(k) = (k * minor_delta - half + major_delta - 1) / major_delta,
+  //limits on the minor coordinate become limits on k
+  int32_t m_low = minor_step > 0 ? minor_min - minor0 : minor0 - minor_max;
+  int32_t m_high = minor_step > 0 ? minor_max - minor0 : minor0 - minor_min;
+  if(m_high < 0) return;
+  if(minor_delta == 0)
+    {
+      if(m_low > 0) return;
+    }
+  else
+    {
+      if(m_low > 0)
+	{
+	  int64_t k = ((int64_t)m_low * major_delta + half - major_delta + 1 + minor_delta - 1) / minor_delta;
+	  if(k > k_first) k_first = k;
+	}
+      int64_t k = ((int64_t)m_high * major_delta + half) / minor_delta;
+      if(k < k_last) k_last = k;
+    }
+  if(k_first > k_last) return;
+
+  int32_t m = major_delta ? (int32_t)(((int64_t)k_first * minor_delta - half + major_delta - 1) / major_delta) : 0;
+  int32_t err = half - k_first * minor_delta + m * major_delta;
+  int16_t minor = minor0 + minor_step * m;
+  uint8_t phase = line_pattern.length ? k_first % line_pattern.length : 0;
+  int32_t run_start = -1;
+  for(int32_t k = k_first; k <= k_last; k++)
+    {
+      if(!line_pattern.length || ((line_pattern.pattern >> phase) & 1))
+	{
+	  if(run_start < 0) run_start = k;
+	}
+      else if(run_start >= 0)
+	{
+	  if(steep) fill_rect_clipped(minor - brush_before, major0 + run_start, minor + brush_after, major0 + k - 1, color);
+	  else fill_rect_clipped(major0 + run_start, minor - brush_before, major0 + k - 1, minor + brush_after, color);
+	  run_start = -1;
+	}
+      if(line_pattern.length && ++phase == line_pattern.length) phase = 0;
+      err -= minor_delta;
+      if(err < 0)
+	{
+	  err += major_delta;
+	  //a run ends when the minor coordinate moves
+	  if(run_start >= 0)
+	    {
+	      if(steep) fill_rect_clipped(minor - brush_before, major0 + run_start, minor + brush_after, major0 + k, color);
+	      else fill_rect_clipped(major0 + run_start, minor - brush_before, major0 + k, minor + brush_after, color);
+	      run_start = -1;
+	    }
+	  minor += minor_step;
+	}
+    }
+  if(run_start >= 0)
+    {
+      if(steep) fill_rect_clipped(minor - brush_before, major0 + run_start, minor + brush_after, major0 + k_last, color);
+      else fill_rect_clipped(major0 + run_start, minor - brush_before, major0 + k_last, minor + brush_after, color);
+    }
+}
+
+//pixel (x, y) relative to the centre is inside when
+//4 * x^2 * (2 * radius_y + 1)^2 + 4 * y^2 * (2 * radius_x + 1)^2 <= (2 * radius_x + 1)^2 * (2 * radius_y + 1)^2,
+//for circles this is x^2 + y^2 <= r^2 + r, a negative radius gives an empty conic
+static void conic_begin(conic_t *conic, int16_t radius_x, int16_t radius_y)
+{
+  int64_t diameter_x = 2 * radius_x + 1, diameter_y = 2 * radius_y + 1;
+  conic->x_weight = 4 * diameter_y * diameter_y;
+  conic->y_weight = 4 * diameter_x * diameter_x;
+  conic->limit = diameter_x * diameter_x * diameter_y * diameter_y;
+  conic->half_width = (radius_x < 0 || radius_y < 0) ? -1 : radius_x;
+}
+
+//half width of the span at distance row from the centre, -1 when the row is outside,
+//the half width only shrinks so rows have to be asked in increasing order
+static int16_t conic_half_width(conic_t *conic, int16_t row)
+{
+  int64_t row_term = (int64_t)row * row * conic->y_weight;
+  while(conic->half_width >= 0 &&
+	(int64_t)conic->half_width * conic->half_width * conic->x_weight + row_term > conic->limit)
+    conic->half_width--;
+  return conic->half_width;
+}
+
+//the inside test of conic_begin for one pixel
+static uint8_t conic_inside(int16_t radius_x, int16_t radius_y, int32_t x, int32_t y)
+{
+  int64_t diameter_x = 2 * radius_x + 1, diameter_y = 2 * radius_y + 1;
+  if(radius_x < 0 || radius_y < 0) return 0;
+  return 4 * x * x * diameter_y * diameter_y + 4 * y * y * diameter_x * diameter_x <= diameter_x * diameter_x * diameter_y * diameter_y;
+}
+
+//inside pixels with an outside neighbour further from the centre in x or y, see conic_draw_outline
+static uint8_t conic_outline_inside(int16_t radius_x, int16_t radius_y, int32_t x, int32_t y)
+{
+  if(x < 0) x = -x;
+  if(y < 0) y = -y;
+  return conic_inside(radius_x, radius_y, x, y) &&
+      (!conic_inside(radius_x, radius_y, x + 1, y) || !conic_inside(radius_x, radius_y, x, y + 1));
+}
+
+//pixels of each row that the next row outwards does not cover, at least the outermost one
+static void conic_draw_outline(conic_t *conic, int16_t mid_x, int16_t mid_y, const arc_sector_t *sector, uint8_t color)
+{
+  conic_t next = *conic;
+  int16_t half_width = conic_half_width(conic, 0);
+  for(int16_t row = 0; half_width >= 0; row++)
+    {
+      int16_t next_width = conic_half_width(&next, row + 1);
+      int16_t inner = next_width + 1;
+      if(inner > half_width) inner = half_width;
+      for(int16_t side = -1; side <= 1; side += 2)
+	{
+	  if(row == 0 && side > 0) break;
+	  if(inner == 0) arc_fill_row(sector, mid_x, mid_y, side * row, -half_width, half_width, color);
+	  else
+	    {
+	      arc_fill_row(sector, mid_x, mid_y, side * row, -half_width, -inner, color);
+	      arc_fill_row(sector, mid_x, mid_y, side * row, inner, half_width, color);
+	    }
+	}
+      half_width = next_width;
+    }
+}
+
+//direction of angle in degrees as a 2.14 fixed point vector, y points up
+static void angle_direction(int16_t angle, int32_t *x, int32_t *y)
+{
+  static const uint16_t sine_table[91] = {
+      0, 286, 572, 857, 1143, 1428, 1713, 1997, 2280, 2563,
+      2845, 3126, 3406, 3686, 3964, 4240, 4516, 4790, 5063, 5334,
+      5604, 5872, 6138, 6402, 6664, 6924, 7182, 7438, 7692, 7943,
+      8192, 8438, 8682, 8923, 9162, 9397, 9630, 9860, 10087, 10311,
+      10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,
+      12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,
+      14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,
+      15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,
+      16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,
+      16384
+  };
+  if(angle < 90)
+    {
+      *x = sine_table[90 - angle];
+      *y = sine_table[angle];
+    }
+  else if(angle < 180)
+    {
+      *x = -sine_table[angle - 90];
+      *y = sine_table[180 - angle];
+    }
+  else if(angle < 270)
+    {
+      *x = -sine_table[270 - angle];
+      *y = -sine_table[angle - 180];
+    }
+  else
+    {
+      *x = sine_table[angle - 270];
+      *y = -sine_table[360 - angle];
+    }
+}
+
+//returns 0 when the sector is empty (same start and end angle)
+static uint8_t arc_sector_begin(arc_sector_t *sector, int16_t start_angle, int16_t end_angle)
+{
+  sector->full = ((int32_t)end_angle - start_angle >= 360);
+  start_angle %= 360;
+  if(start_angle < 0) start_angle += 360;
+  end_angle %= 360;
+  if(end_angle < 0) end_angle += 360;
+  int16_t sweep = end_angle - start_angle;
+  if(sweep < 0) sweep += 360;
+  if(sweep == 0 && !sector->full) return 0;
+  sector->reflex = (sweep > 180);
+  angle_direction(start_angle, &sector->start_x, &sector->start_y);
+  angle_direction(end_angle, &sector->end_x, &sector->end_y);
+  return 1;
+}
+
+//narrows x_min..x_max to the x of the row where a * x + b >= 0
+static void half_plane_row(int32_t a, int32_t b, int32_t *x_min, int32_t *x_max)
+{
+  if(a > 0)
+    {
+      int32_t bound = -floor_div(b, a);
+      if(*x_min < bound) *x_min = bound;
+    }
+  else if(a < 0)
+    {
+      int32_t bound = floor_div(b, -a);
+      if(*x_max > bound) *x_max = bound;
+    }
+  else if(b < 0)
+    {
+      *x_min = 1;
+      *x_max = 0;
+    }
+}
+
+//the test of arc_fill_row for the pixel x of row dy, relative to the centre
+static uint8_t arc_sector_inside(const arc_sector_t *sector, int32_t x, int32_t dy)
+{
+  int32_t v = -dy;
+  if(sector->full) return 1;
+  if(!sector->reflex)
+    return sector->start_x * v - sector->start_y * x >= 0 && sector->end_y * x - sector->end_x * v >= 0;
+  return !(sector->end_x * v - sector->end_y * x > 0 && sector->start_y * x - sector->start_x * v > 0);
+}
+
+//fills pixels x0..x1 of row dy (relative to the centre) that are inside the sector,
+//the sector may be NULL for whole conics
+static void arc_fill_row(const arc_sector_t *sector, int16_t mid_x, int16_t mid_y, int16_t dy,
+			 int16_t x0, int16_t x1, uint8_t color)
+{
+  int32_t x_min = INT16_MIN, x_max = INT16_MAX, v = -dy;
+  if(x0 > x1) return;
+  if(!sector || sector->full)
+    {
+      fill_rect_clipped(mid_x + x0, mid_y + dy, mid_x + x1, mid_y + dy, color);
+      return;
+    }
+  if(!sector->reflex)
+    {
+      //left of the start ray and right of the end ray, edges included
+      half_plane_row(-sector->start_y, sector->start_x * v, &x_min, &x_max);
+      half_plane_row(sector->end_y, -sector->end_x * v, &x_min, &x_max);
+      if(x_min < x0) x_min = x0;
+      if(x_max > x1) x_max = x1;
+      if(x_min <= x_max) fill_rect_clipped(mid_x + x_min, mid_y + dy, mid_x + x_max, mid_y + dy, color);
+      return;
+    }
+  //everything but the open wedge from the end ray to the start ray
+  half_plane_row(-sector->end_y, sector->end_x * v - 1, &x_min, &x_max);
+  half_plane_row(sector->start_y, -sector->start_x * v - 1, &x_min, &x_max);
+  if(x_min > x_max)
+    {
+      fill_rect_clipped(mid_x + x0, mid_y + dy, mid_x + x1, mid_y + dy, color);
+      return;
+    }
+  if(x0 <= x_min - 1) fill_rect_clipped(mid_x + x0, mid_y + dy, mid_x + (x1 < x_min - 1 ? x1 : x_min - 1), mid_y + dy, color);
+  if(x_max + 1 <= x1) fill_rect_clipped(mid_x + (x0 > x_max + 1 ? x0 : x_max + 1), mid_y + dy, mid_x + x1, mid_y + dy, color);
+}
+
+//division rounding towards minus infinity
+static int32_t floor_div(int64_t numerator, int32_t divisor)
+{
+  int64_t quotient = numerator / divisor;
+  if((numerator % divisor != 0) && ((numerator < 0) != (divisor < 0))) quotient--;
+  return (int32_t)quotient;
+}
+
+static int abs(int i)
+{
+  return i > 0 ? i : -i;
 }
 
 static void swap_int16_t(int16_t *a, int16_t *b)
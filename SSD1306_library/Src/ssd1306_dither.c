@@ -0,0 +1,134 @@
+/*
+ * ssd1306_dither.c
+ */
+
+#include <ssd1306.h>
+#include <ssd1306_dither.h>
+
+static const uint8_t bayer_matrix[8][8] = {
+    { 0, 32,  8, 40,  2, 34, 10, 42},
+    {48, 16, 56, 24, 50, 18, 58, 26},
+    {12, 44,  4, 36, 14, 46,  6, 38},
+    {60, 28, 52, 20, 62, 30, 54, 22},
+    { 3, 35, 11, 43,  1, 33,  9, 41},
+    {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47,  7, 39, 13, 45,  5, 37},
+    {63, 31, 55, 23, 61, 29, 53, 21}
+};
+
+typedef struct
+{
+  int16_t x;
+  int16_t y;
+  uint8_t width;
+  uint8_t height;
+  uint8_t mode;
+  uint16_t row;
+} dither_state_t;
+static dither_state_t dither_state = {0, 0, 0, 0, SSD_DITHER_THRESHOLD, 0};
+
+//errors carried to the current and the next row, one extra cell on each side
+static int16_t row_errors[2][SCREEN_WIDTH + 2];
+static uint8_t current_errors = 0;
+//one page of output columns, bit n is row n of the batch
+static uint8_t page_columns[SCREEN_WIDTH];
+
+//converts a row and sets bit_index of each output column
+static void dither_row_bits(const uint8_t *gray_row, uint8_t bit_index)
+{
+  uint8_t bit = 1 << bit_index;
+  uint8_t screen_row = (dither_state.y + dither_state.row + bit_index) & 0b111;
+  int16_t value;
+  int16_t *errors = row_errors[current_errors], *next_errors = row_errors[current_errors ^ 1];
+  if(dither_state.mode == SSD_DITHER_FLOYD_STEINBERG)
+    {
+      for(uint8_t column = 0; column < dither_state.width + 2; column++) next_errors[column] = 0;
+    }
+  for(uint8_t column = 0; column < dither_state.width; column++)
+    {
+      switch(dither_state.mode)
+      {
+	case SSD_DITHER_BAYER:
+	  value = gray_row[column] > ((bayer_matrix[screen_row][(dither_state.x + column) & 0b111] << 2) + 2);
+	  break;
+	case SSD_DITHER_FLOYD_STEINBERG:
+	  {
+	    int16_t wanted = gray_row[column] + (errors[column + 1] >> 4);
+	    int16_t error;
+	    value = wanted >= 128;
+	    error = wanted - (value ? 255 : 0);
+	    //7/16 right, 3/16 down left, 5/16 down, 1/16 down right, kept in 1/16 units
+	    errors[column + 2] += error * 7;
+	    next_errors[column] += error * 3;
+	    next_errors[column + 1] += error * 5;
+	    next_errors[column + 2] += error;
+	    break;
+	  }
+	default:
+	  value = gray_row[column] >= 128;
+	  break;
+      }
+      if(value) page_columns[column] |= bit;
+      else page_columns[column] &= ~bit;
+    }
+  current_errors ^= 1;
+}
+
+int ssd1306_dither_begin(int16_t x, int16_t y, uint8_t width, uint8_t height, uint8_t mode)
+{
+  if(width < 1 || width > SCREEN_WIDTH) return SSD1306_ERROR_INVALID_ARGUMENT;
+  dither_state.x = x;
+  dither_state.y = y;
+  dither_state.width = width;
+  dither_state.height = height;
+  dither_state.mode = mode;
+  dither_state.row = 0;
+  for(uint8_t column = 0; column < SCREEN_WIDTH + 2; column++) row_errors[0][column] = row_errors[1][column] = 0;
+  current_errors = 0;
+  return SSD1306_SUCCESS;
+}
+
+int ssd1306_dither_row(const uint8_t *gray_row)
+{
+  if(dither_state.row >= dither_state.height) return SSD1306_ERROR_INVALID_ARGUMENT;
+  dither_row_bits(gray_row, 0);
+  ssd1306_draw_page_bitmap(page_columns, dither_state.width, 1,
+			   dither_state.x, dither_state.y + dither_state.row, SSD_ROP_COPY);
+  dither_state.row++;
+  return SSD1306_SUCCESS;
+}
+
+int ssd1306_dither_rows8(const uint8_t *gray_rows, uint16_t row_stride)
+{
+  if(dither_state.row >= dither_state.height) return SSD1306_ERROR_INVALID_ARGUMENT;
+  uint8_t rows = dither_state.height - dither_state.row;
+  if(rows > 8) rows = 8;
+  for(uint8_t row = 0; row < rows; row++)
+    {
+      dither_row_bits(gray_rows, row);
+      gray_rows += row_stride;
+    }
+  //a page aligned batch replaces whole bytes of the buffer
+  ssd1306_draw_page_bitmap(page_columns, dither_state.width, rows,
+			   dither_state.x, dither_state.y + dither_state.row, SSD_ROP_COPY);
+  dither_state.row += rows;
+  return SSD1306_SUCCESS;
+}
+
+int ssd1306_dither_image(int16_t x, int16_t y, uint8_t width, uint8_t height, uint8_t mode,
+			 ssd1306_dither_source_t source, void *context)
+{
+  if(ssd1306_dither_begin(x, y, width, height, mode) != SSD1306_SUCCESS) return SSD1306_ERROR_INVALID_ARGUMENT;
+  uint8_t rows;
+  while(dither_state.row < height)
+    {
+      //rows up to the next page boundary are batched into one page write
+      rows = 8 - ((y + dither_state.row) & 0b111);
+      if(rows > height - dither_state.row) rows = height - dither_state.row;
+      for(uint8_t row = 0; row < rows; row++)
+	dither_row_bits(source(context, dither_state.row + row), row);
+      ssd1306_draw_page_bitmap(page_columns, width, rows, x, y + dither_state.row, SSD_ROP_COPY);
+      dither_state.row += rows;
+    }
+  return SSD1306_SUCCESS;
+}
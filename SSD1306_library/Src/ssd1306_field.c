@@ -0,0 +1,93 @@
+/*
+ * ssd1306_field.c
+ */
+
+#include <ssd1306.h>
+#include <ssd1306_field.h>
+#include <ssd1306_print.h>
+
+static int field_show(ssd1306_field_t *field, const char *text, size_t length);
+
+int ssd1306_field_init(ssd1306_field_t *field, uint8_t x, uint8_t y, uint8_t cells,
+		       const unsigned char *font, uint8_t scale, char *format, uint8_t align, uint8_t color)
+{
+  const char *widest = "0123456789+-.:";
+  uint8_t width = 0, glyphWidth;
+  if(!field || !font || !cells || cells > SSD1306_FIELD_MAX_CELLS
+      || !scale || color > SSD_COLOR_WHITE) return SSD1306_ERROR_INVALID_ARGUMENT;
+  while(*widest)
+    {
+      glyphWidth = ssd1306_get_glyph_width(font, *widest++);
+      if(glyphWidth > width) width = glyphWidth;
+    }
+  field->font = font;
+  field->format = format;
+  field->x = x;
+  field->y = y;
+  field->cells = cells;
+  //one empty font column between the cells
+  field->cell_width = (width + 1) * scale;
+  field->cell_height = font[0x06] * scale;
+  field->scale = scale;
+  field->align = align;
+  field->color = color;
+  field->valid = 0;
+  return SSD1306_SUCCESS;
+}
+
+int ssd1306_field_set_text(ssd1306_field_t *field, const char *text)
+{
+  size_t length = 0;
+  while(text[length] != '\0') length++;
+  return field_show(field, text, length);
+}
+
+int ssd1306_field_update(ssd1306_field_t *field, ...)
+{
+  char text[SSD1306_FIELD_MAX_CELLS + 1];
+  va_list args;
+  va_start(args, field);
+  size_t length = ssd1306_vsnprintf(text, sizeof(text), field->format, args);
+  va_end(args);
+  return field_show(field, text, length);
+}
+
+void ssd1306_field_invalidate(ssd1306_field_t *field)
+{
+  field->valid = 0;
+}
+
+//length is the full length of text, only the first cells characters are read
+static int field_show(ssd1306_field_t *field, const char *text, size_t length)
+{
+  char cell[SSD1306_FIELD_MAX_CELLS];
+  uint8_t padding = 0, glyphWidth, cellX;
+  int redrawn = 0;
+  if(length > field->cells)
+    {
+      for(uint8_t i = 0; i < field->cells; i++) cell[i] = '#';
+    }
+  else
+    {
+      if(field->align == SSD_ALIGN_RIGHT) padding = field->cells - length;
+      for(uint8_t i = 0; i < field->cells; i++)
+	cell[i] = (i < padding || i >= padding + length) ? ' ' : text[i - padding];
+    }
+  for(uint8_t i = 0; i < field->cells; i++)
+    {
+      if(field->valid && field->shown[i] == cell[i]) continue;
+      cellX = field->x + i * field->cell_width;
+      ssd1306_fill_rect(cellX, field->y, field->cell_width, field->cell_height, !field->color);
+      if(cell[i] != ' ')
+	{
+	  //narrow glyphs are centered in the cell
+	  glyphWidth = ssd1306_get_glyph_width(field->font, cell[i]) * field->scale;
+	  ssd1306_draw_glyph(field->font, cell[i], cellX + (field->cell_width - glyphWidth) / 2,
+			     field->y, field->scale, field->color);
+	}
+      field->shown[i] = cell[i];
+      redrawn++;
+    }
+  field->valid = 1;
+  return redrawn;
+}
@@ -0,0 +1,104 @@
+/*
+ * ssd1306_gray.c
+ */
+
+#include <ssd1306.h>
+#include <ssd1306_gray.h>
+
+//plane 1 holds the high bit of the level, plane 0 the low bit
+static uint8_t gray_planes[2][SSD1306_GRAY_PLANE_SIZE];
+static uint8_t region_x = 0, region_page = 0, region_width = 0, region_pages = 0;
+static uint16_t bus_budget = SSD1306_GRAY_PLANE_SIZE;
+static uint8_t gray_subframe = 0;
+
+int ssd1306_gray_set_region(uint8_t x, uint8_t y, uint8_t width, uint8_t height)
+{
+  if(width < 1 || height < 1) return SSD1306_ERROR_INVALID_ARGUMENT;
+  if(x + width > SCREEN_WIDTH || y + height > SCREEN_HEIGHT) return SSD1306_ERROR_INVALID_ARGUMENT;
+  uint8_t first_page = y >> 3;
+  uint8_t pages = ((y + height - 1) >> 3) - first_page + 1;
+  uint16_t bytes = width * pages;
+  if(bytes > SSD1306_GRAY_PLANE_SIZE || bytes > bus_budget) return SSD1306_ERROR_INVALID_ARGUMENT;
+  region_x = x;
+  region_page = first_page;
+  region_width = width;
+  region_pages = pages;
+  gray_subframe = 0;
+  ssd1306_gray_clear();
+  return SSD1306_SUCCESS;
+}
+
+void ssd1306_gray_set_bus_budget(uint16_t bytes_per_subframe)
+{
+  bus_budget = bytes_per_subframe;
+  //a region over the new budget is dropped
+  if(region_width * region_pages > bus_budget) region_width = 0;
+}
+
+void ssd1306_gray_clear(void)
+{
+  uint8_t *plane_low = gray_planes[0], *plane_high = gray_planes[1];
+  uint16_t bytes = SSD1306_GRAY_PLANE_SIZE;
+  while(bytes--)
+    {
+      *plane_low++ = 0;
+      *plane_high++ = 0;
+    }
+}
+
+void ssd1306_gray_draw_pixel(int16_t x, int16_t y, uint8_t level)
+{
+  x -= region_x;
+  if(x < 0 || x >= region_width || y < (region_page << 3) || y >= ((region_page + region_pages) << 3)) return;
+  uint16_t index = ((y >> 3) - region_page) * region_width + x;
+  uint8_t bit = 1 << (y & 0b111);
+  if(level & 0b01) gray_planes[0][index] |= bit;
+  else gray_planes[0][index] &= ~bit;
+  if(level & 0b10) gray_planes[1][index] |= bit;
+  else gray_planes[1][index] &= ~bit;
+}
+
+void ssd1306_gray_fill_rect(int16_t x, int16_t y, int16_t width, int16_t height, uint8_t level)
+{
+  int16_t x0 = x - region_x, x1 = x0 + width - 1;
+  int16_t y0 = y - (region_page << 3), y1 = y0 + height - 1;
+  if(x0 < 0) x0 = 0;
+  if(y0 < 0) y0 = 0;
+  if(x1 >= region_width) x1 = region_width - 1;
+  if(y1 >= (region_pages << 3)) y1 = (region_pages << 3) - 1;
+  if(x0 > x1 || y0 > y1) return;
+  for(uint8_t page = y0 >> 3; page <= (y1 >> 3); page++)
+    {
+      uint8_t mask = 0xFF;
+      if(page == (y0 >> 3)) mask &= 0xFF << (y0 & 0b111);
+      if(page == (y1 >> 3)) mask &= 0xFF >> (7 - (y1 & 0b111));
+      uint8_t low = (level & 0b01) ? mask : 0, high = (level & 0b10) ? mask : 0;
+      uint8_t *plane_low = gray_planes[0] + page * region_width + x0;
+      uint8_t *plane_high = gray_planes[1] + page * region_width + x0;
+      for(int16_t column = x0; column <= x1; column++)
+	{
+	  *plane_low = (*plane_low & ~mask) | low;
+	  *plane_high = (*plane_high & ~mask) | high;
+	  plane_low++;
+	  plane_high++;
+	}
+    }
+}
+
+//subframe 0 sends the high plane, which stays on the panel during subframe 1,
+//subframe 2 sends the low plane
+int ssd1306_gray_tick(void)
+{
+  if(!region_width) return SSD1306_SUCCESS;
+  uint8_t subframe = gray_subframe;
+  gray_subframe = (gray_subframe == 2) ? 0 : gray_subframe + 1;
+  if(subframe == 1) return SSD1306_SUCCESS;
+  return ssd1306_send_window(gray_planes[subframe == 0 ? 1 : 0], region_width,
+			     region_x, region_x + region_width - 1,
+			     region_page, region_page + region_pages - 1);
+}
+
+uint8_t ssd1306_gray_get_subframe(void)
+{
+  return gray_subframe;
+}
@@ -0,0 +1,156 @@
+/*
+ * ssd1306_list.c
+ */
+
+#include <ssd1306.h>
+#include <ssd1306_list.h>
+
+static void list_draw_rows(ssd1306_list_t *list, int16_t top, int16_t bottom);
+static void list_invert_row(const ssd1306_list_t *list, uint16_t index, int16_t top, int16_t bottom);
+
+int ssd1306_list_init(ssd1306_list_t *list, uint8_t x, uint8_t y, uint8_t width, uint8_t height,
+		      const unsigned char *font, uint16_t count, ssd1306_list_text_t get_text, void *context)
+{
+  if(!list || !font || !get_text || !width || !height) return SSD1306_ERROR_INVALID_ARGUMENT;
+  list->get_text = get_text;
+  list->context = context;
+  list->font = font;
+  list->x = x;
+  list->y = y;
+  list->width = width;
+  list->height = height;
+  list->row_height = font[0x06] + 2;
+  list->speed = 2;
+  list->valid = 0;
+  list->count = count;
+  list->selected = 0;
+  list->offset = 0;
+  list->target = 0;
+  return SSD1306_SUCCESS;
+}
+
+void ssd1306_list_set_count(ssd1306_list_t *list, uint16_t count)
+{
+  list->count = count;
+  list->valid = 0;
+  list->offset = 0;
+  list->target = 0;
+  ssd1306_list_select(list, list->selected);
+  list->offset = list->target;
+}
+
+void ssd1306_list_set_scroll_speed(ssd1306_list_t *list, uint8_t speed)
+{
+  list->speed = speed;
+}
+
+void ssd1306_list_select(ssd1306_list_t *list, uint16_t index)
+{
+  int32_t top, bottom, last;
+  if(index >= list->count) index = list->count ? list->count - 1 : 0;
+  //the bar is taken off the old entry and put on the new one where they are visible
+  if(list->valid && index != list->selected)
+    {
+      list_invert_row(list, list->selected, list->y, list->y + list->height - 1);
+      list_invert_row(list, index, list->y, list->y + list->height - 1);
+    }
+  list->selected = index;
+  top = (int32_t)index * list->row_height;
+  bottom = top + list->row_height - 1;
+  if(top < list->target) list->target = top;
+  else if(bottom > list->target + list->height - 1) list->target = bottom - list->height + 1;
+  last = (int32_t)list->count * list->row_height - list->height;
+  if(list->target > last) list->target = last;
+  if(list->target < 0) list->target = 0;
+}
+
+void ssd1306_list_move(ssd1306_list_t *list, int16_t delta)
+{
+  int32_t index = (int32_t)list->selected + delta;
+  if(index < 0) index = 0;
+  if(index >= list->count) index = list->count - 1;
+  ssd1306_list_select(list, index);
+}
+
+//the pixels of the area move by the step, only the uncovered rows are drawn,
+//rows outside the clip rectangle of the caller are neither moved nor drawn
+int ssd1306_list_update(ssd1306_list_t *list)
+{
+  const ssd1306_clip_rect_t *clip = &ssd1306_get_display()->clip_rect;
+  int32_t step = list->target - list->offset;
+  int16_t top = list->y, bottom = list->y + list->height - 1;
+  if(top < clip->y0) top = clip->y0;
+  if(bottom > clip->y1) bottom = clip->y1;
+  if(list->speed && step > list->speed) step = list->speed;
+  if(list->speed && step < -list->speed) step = -list->speed;
+  list->offset += step;
+  if(!list->valid || step >= bottom - top + 1 || step <= top - bottom - 1)
+    {
+      list_draw_rows(list, list->y, list->y + list->height - 1);
+      list->valid = 1;
+    }
+  else if(step > 0)
+    {
+      ssd1306_scroll_rect(list->x, top, list->width, bottom - top + 1, 0, -step, SSD_COLOR_BLACK);
+      list_draw_rows(list, bottom - step + 1, bottom);
+    }
+  else if(step < 0)
+    {
+      ssd1306_scroll_rect(list->x, top, list->width, bottom - top + 1, 0, -step, SSD_COLOR_BLACK);
+      list_draw_rows(list, top, top - step - 1);
+    }
+  return list->offset != list->target;
+}
+
+void ssd1306_list_invalidate(ssd1306_list_t *list)
+{
+  list->valid = 0;
+}
+
+//draws the entries in the screen rows top..bottom of the area,
+//the clip rectangle (cut to the one of the caller) keeps the rows around them as they are
+static void list_draw_rows(ssd1306_list_t *list, int16_t top, int16_t bottom)
+{
+  ssd1306_display_t *display = ssd1306_get_display();
+  ssd1306_clip_rect_t clip = display->clip_rect;
+  char text[SSD1306_LIST_MAX_TEXT];
+  int16_t row_y, glyph_x;
+  int32_t first = (top - list->y + list->offset) / list->row_height;
+  int32_t last = (bottom - list->y + list->offset) / list->row_height;
+  ssd1306_fill_rect(list->x, top, list->width, bottom - top + 1, SSD_COLOR_BLACK);
+  if(display->clip_rect.x0 < list->x) display->clip_rect.x0 = list->x;
+  if(display->clip_rect.y0 < top) display->clip_rect.y0 = top;
+  if(display->clip_rect.x1 > list->x + list->width - 1) display->clip_rect.x1 = list->x + list->width - 1;
+  if(display->clip_rect.y1 > bottom) display->clip_rect.y1 = bottom;
+  if(display->clip_rect.x0 > display->clip_rect.x1 || display->clip_rect.y0 > display->clip_rect.y1)
+    {
+      display->clip_rect = clip;
+      return;
+    }
+  for(int32_t index = first; index <= last && index < list->count; index++)
+    {
+      row_y = list->y + index * list->row_height - list->offset;
+      text[0] = '\0';
+      list->get_text(list->context, index, text, sizeof(text));
+      glyph_x = list->x + 2;
+      for(const char *c = text; *c && glyph_x < list->x + list->width; c++)
+	{
+	  if(*c == ' ') glyph_x += 2;
+	  else glyph_x += ssd1306_draw_glyph(list->font, *c, glyph_x, row_y + 1, 1, SSD_COLOR_WHITE) + 1;
+	}
+    }
+  if(list->selected >= first && list->selected <= last) list_invert_row(list, list->selected, top, bottom);
+  display->clip_rect = clip;
+}
+
+//inverts the part of the entry row that is in the screen rows top..bottom
+static void list_invert_row(const ssd1306_list_t *list, uint16_t index, int16_t top, int16_t bottom)
+{
+  int32_t row_top = list->y + (int32_t)index * list->row_height - list->offset;
+  int32_t row_bottom = row_top + list->row_height - 1;
+  if(index >= list->count) return;
+  if(row_top < top) row_top = top;
+  if(row_bottom > bottom) row_bottom = bottom;
+  if(row_top > row_bottom) return;
+  ssd1306_fill_rect(list->x, row_top, list->width, row_bottom - row_top + 1, SSD_COLOR_INVERSE);
+}
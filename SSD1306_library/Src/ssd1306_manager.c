@@ -0,0 +1,230 @@
+/*
+ * ssd1306_manager.c
+ */
+
+#include <ssd1306.h>
+#include <ssd1306_manager.h>
+
+#define SLOT_IDLE 0
+#define SLOT_WAITING 1 // changes seen, waiting for the bus
+#define SLOT_SENDING 2
+
+//may be called from an interrupt, the rest is done by the next poll
+static void manager_transfer_done(void *context, int result)
+{
+  ssd1306_manager_slot_t *slot = (ssd1306_manager_slot_t *)context;
+  slot->transfer_result = result;
+  slot->transfer_done = 1;
+}
+
+static uint8_t slot_has_changes(const ssd1306_manager_slot_t *slot)
+{
+#ifdef USE_QUICK_DISPLAY
+  return slot->display->was_buffer_updated;
+#else
+  //every poll sends the whole panel
+  (void)slot;
+  return 1;
+#endif
+}
+
+//time of the poll, or the current time when the manager has a clock
+static uint32_t manager_time(const ssd1306_manager_t *manager, uint32_t now)
+{
+  return manager->clock ? manager->clock() : now;
+}
+
+static int slot_finish(const ssd1306_manager_t *manager, ssd1306_manager_slot_t *slot, uint32_t now, int result)
+{
+  now = manager_time(manager, now);
+  slot->state = SLOT_IDLE;
+  if(result != SSD1306_SUCCESS)
+    {
+      slot->stats.errors++;
+      return result;
+    }
+  uint32_t latency = now - slot->dirty_since;
+  slot->stats.frames++;
+  slot->stats.last_latency = latency;
+  slot->stats.total_latency += latency;
+  if(slot->stats.max_latency < latency) slot->stats.max_latency = latency;
+  slot->stats.busy_time += now - slot->flush_started;
+  return SSD1306_SUCCESS;
+}
+
+//a failed async flush gives the pages not sent yet back to the changed area,
+//the next poll sends them
+static int slot_fail(const ssd1306_manager_t *manager, ssd1306_manager_slot_t *slot, uint32_t now)
+{
+  ssd1306_display_t *selected = ssd1306_get_display();
+  ssd1306_select_display(slot->display);
+  ssd1306_mark_updated_window(slot->column_start, slot->column_end, slot->page, slot->page_end);
+  ssd1306_select_display(selected);
+  return slot_finish(manager, slot, now, SSD1306_ERROR_COMMUNICATION);
+}
+
+//starts the transfer of the rest of the window when it spans all columns
+//(it is contiguous in the buffer), otherwise of the current page
+static int slot_send_next(ssd1306_manager_slot_t *slot)
+{
+  ssd1306_display_t *display = slot->display;
+  uint16_t columns = slot->column_end - slot->column_start + 1;
+  slot->transfer_pages = (columns == SCREEN_WIDTH) ? slot->page_end - slot->page + 1 : 1;
+  slot->transfer_bytes = columns * slot->transfer_pages;
+  slot->transfer_done = 0;
+  return display->transport.ops->write_data_async(display->transport.context,
+						  display->base_buffer + slot->page * SCREEN_WIDTH + slot->column_start,
+						  slot->transfer_bytes, manager_transfer_done, slot);
+}
+
+//handles finished transfers of a running flush and sends the next page
+static int slot_advance(const ssd1306_manager_t *manager, ssd1306_manager_slot_t *slot, uint32_t now)
+{
+  while(slot->state == SLOT_SENDING && slot->transfer_done)
+    {
+      if(slot->transfer_result != SSD1306_SUCCESS) return slot_fail(manager, slot, now);
+      slot->stats.bytes += slot->transfer_bytes;
+      slot->page += slot->transfer_pages;
+      if(slot->page > slot->page_end) return slot_finish(manager, slot, now, SSD1306_SUCCESS);
+      //a transport may report a failed start through done as well
+      if(slot_send_next(slot) != SSD1306_SUCCESS && !slot->transfer_done) return slot_fail(manager, slot, now);
+    }
+  return SSD1306_SUCCESS;
+}
+
+static int slot_start(const ssd1306_manager_t *manager, ssd1306_manager_slot_t *slot, uint32_t now)
+{
+  ssd1306_display_t *display = slot->display;
+  uint8_t page_start;
+  slot->state = SLOT_IDLE;
+  slot->flush_started = manager_time(manager, now);
+  ssd1306_select_display(display);
+  if(!ssd1306_take_updated_window(&slot->column_start, &slot->column_end, &page_start, &slot->page_end)) return SSD1306_SUCCESS;
+  slot->page = page_start;
+  if(!display->transport.ops->write_data_async || display->layers)
+    {
+      //blocking transport or a picture composed while it is sent,
+      //ssd1306_display sends the window with its retries
+      //and keeps what it could not send as changed
+      ssd1306_mark_updated_window(slot->column_start, slot->column_end, page_start, slot->page_end);
+      int result = ssd1306_display();
+      if(result == SSD1306_SUCCESS)
+	slot->stats.bytes += (slot->column_end - slot->column_start + 1) * (slot->page_end - page_start + 1);
+      return slot_finish(manager, slot, now, result);
+    }
+  if(ssd1306_set_window(slot->column_start, slot->column_end, page_start, slot->page_end) != SSD1306_SUCCESS)
+    return slot_fail(manager, slot, now);
+  slot->state = SLOT_SENDING;
+  if(slot_send_next(slot) != SSD1306_SUCCESS && !slot->transfer_done) return slot_fail(manager, slot, now);
+  return slot_advance(manager, slot, now);
+}
+
+//waiting slot to send next on the bus, NULL when the bus is busy or nothing waits
+static ssd1306_manager_slot_t *manager_next_for_bus(ssd1306_manager_t *manager, uint8_t bus, uint32_t now)
+{
+  ssd1306_manager_slot_t *best = 0;
+  for(uint8_t i = 0; i < manager->count; i++)
+    {
+      ssd1306_manager_slot_t *slot = &manager->slots[i];
+      if(slot->bus != bus) continue;
+      if(slot->state == SLOT_SENDING) return 0;
+      if(slot->state != SLOT_WAITING) continue;
+      if(!best || slot->priority > best->priority
+	  || (slot->priority == best->priority && now - slot->dirty_since > now - best->dirty_since))
+	best = slot;
+    }
+  return best;
+}
+
+void ssd1306_manager_init(ssd1306_manager_t *manager)
+{
+  uint8_t *ptr = (uint8_t *)manager;
+  uint16_t size = sizeof(ssd1306_manager_t);
+  while(size--) *ptr++ = 0;
+}
+
+int ssd1306_manager_add(ssd1306_manager_t *manager, ssd1306_display_t *display, uint8_t bus, uint8_t priority)
+{
+  if(!display || manager->count >= SSD1306_MANAGER_MAX_DISPLAYS) return SSD1306_ERROR_INVALID_ARGUMENT;
+  ssd1306_manager_slot_t *slot = &manager->slots[manager->count];
+  slot->display = display;
+  slot->bus = bus;
+  slot->priority = priority;
+  slot->state = SLOT_IDLE;
+  return manager->count++;
+}
+
+void ssd1306_manager_set_clock(ssd1306_manager_t *manager, uint32_t (*clock)(void))
+{
+  manager->clock = clock;
+}
+
+int ssd1306_manager_poll(ssd1306_manager_t *manager, uint32_t now)
+{
+  int result = SSD1306_SUCCESS;
+  ssd1306_display_t *selected = ssd1306_get_display();
+
+  for(uint8_t i = 0; i < manager->count; i++)
+    if(slot_advance(manager, &manager->slots[i], now) != SSD1306_SUCCESS) result = SSD1306_ERROR_COMMUNICATION;
+
+  //latency counts from the first poll that sees a change
+  for(uint8_t i = 0; i < manager->count; i++)
+    {
+      ssd1306_manager_slot_t *slot = &manager->slots[i];
+      if(slot->state == SLOT_IDLE && slot_has_changes(slot))
+	{
+	  slot->state = SLOT_WAITING;
+	  slot->dirty_since = now;
+	}
+    }
+
+  //every free bus gets its next flush, blocking transports finish at once
+  //and let the next panel of their bus start in the same poll
+  for(uint8_t started = 1; started; )
+    {
+      started = 0;
+      for(uint8_t i = 0; i < manager->count; i++)
+	{
+	  ssd1306_manager_slot_t *slot = manager_next_for_bus(manager, manager->slots[i].bus, now);
+	  if(!slot) continue;
+	  started = 1;
+	  if(slot_start(manager, slot, now) != SSD1306_SUCCESS) result = SSD1306_ERROR_COMMUNICATION;
+	}
+    }
+
+  ssd1306_select_display(selected);
+  return result;
+}
+
+uint8_t ssd1306_manager_is_idle(const ssd1306_manager_t *manager)
+{
+  for(uint8_t i = 0; i < manager->count; i++)
+    {
+      if(manager->slots[i].state != SLOT_IDLE || slot_has_changes(&manager->slots[i])) return 0;
+    }
+  return 1;
+}
+
+const ssd1306_display_stats_t *ssd1306_manager_get_stats(const ssd1306_manager_t *manager, uint8_t index)
+{
+  if(index >= manager->count) return 0;
+  return &manager->slots[index].stats;
+}
+
+uint32_t ssd1306_manager_get_throughput(const ssd1306_manager_t *manager, uint8_t index)
+{
+  if(index >= manager->count) return 0;
+  const ssd1306_display_stats_t *stats = &manager->slots[index].stats;
+  if(!stats->busy_time) return 0;
+  return (uint64_t)stats->bytes * 1000 / stats->busy_time;
+}
+
+void ssd1306_manager_reset_stats(ssd1306_manager_t *manager)
+{
+  for(uint8_t i = 0; i < manager->count; i++)
+    {
+      uint8_t *ptr = (uint8_t *)&manager->slots[i].stats;
+      uint16_t size = sizeof(ssd1306_display_stats_t);
+      while(size--) *ptr++ = 0;
+    }
+}
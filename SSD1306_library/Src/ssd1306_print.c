@@ -1,10 +1,19 @@
-#include "ssd1306_print.h"
+#include "ssd1306.h"
+#include "ssd1306_trace.h"
 
 static size_t print_int(int64_t n);
 static size_t print_float(double n, uint16_t precision);
 static size_t print_str(char str[]);
+static size_t print_format(char *str, va_list args);
+static int print_char(char c);
 
-int ssd1306_write(char c);
+//when buffer is set the output goes there instead of the screen
+static struct
+{
+  char *buffer;
+  size_t size;
+  size_t length;
+} print_target;
 
 static int _atoi(char *str, uint8_t size)
 {
@@ -29,6 +38,45 @@ size_t ssd1306_printf(char *str, ...)
 {
   va_list args;
   va_start(args, str);
+  SSD1306_TRACE_SITE_BEGIN();
+  size_t n = print_format(str, args);
+  SSD1306_TRACE_SITE_END();
+  va_end(args);
+  return n;
+}
+
+//formats into buffer like ssd1306_printf formats to the screen, the result is always
+//terminated and cut to size - 1 characters, returns the untruncated length
+size_t ssd1306_vsnprintf(char *buffer, size_t size, char *str, va_list args)
+{
+  print_target.buffer = buffer;
+  print_target.size = size;
+  print_target.length = 0;
+  print_format(str, args);
+  if(size) buffer[print_target.length < size ? print_target.length : size - 1] = '\0';
+  print_target.buffer = 0;
+  return print_target.length;
+}
+
+size_t ssd1306_snprintf(char *buffer, size_t size, char *str, ...)
+{
+  va_list args;
+  va_start(args, str);
+  size_t n = ssd1306_vsnprintf(buffer, size, str, args);
+  va_end(args);
+  return n;
+}
+
+static int print_char(char c)
+{
+  if(!print_target.buffer) return ssd1306_write(c);
+  if(print_target.length + 1 < print_target.size) print_target.buffer[print_target.length] = c;
+  print_target.length++;
+  return 1;
+}
+
+static size_t print_format(char *str, va_list args)
+{
   size_t n = 0;
 
   uint16_t i = 0;
@@ -36,7 +84,7 @@ size_t ssd1306_printf(char *str, ...)
     {
       if(str[i] != '%')
 	{
-	  ssd1306_write(str[i]);
+	  print_char(str[i]);
 	  n++;
 	  i++;
 	}
@@ -49,7 +97,7 @@ size_t ssd1306_printf(char *str, ...)
 	      switch(str[temp])
 	      {
 		case 'c':
-		  ssd1306_write((char)va_arg(args, int));
+		  print_char((char)va_arg(args, int));
 		  found_specifier = 1;
 		  n++;
 		  break;
@@ -78,7 +126,6 @@ size_t ssd1306_printf(char *str, ...)
 	  i = temp;
 	}
     }
-  va_end(args);
   return n;
 }
 
@@ -86,13 +133,13 @@ static size_t print_int(int64_t n)
 {
   if(n < 0)
     {
-      ssd1306_write('-');
+      print_char('-');
       n = -n;
     }
 
   if(n == 0)
     {
-      ssd1306_write('0');
+      print_char('0');
       return 1;
     }
 
@@ -109,11 +156,11 @@ static size_t print_int(int64_t n)
   uint8_t temp = digits;
   while(reversed_n != 0)
     {
-      ssd1306_write(('0' + (reversed_n%10)));
+      print_char(('0' + (reversed_n%10)));
       reversed_n /= 10;
       temp--;
     }
-  while(temp--) ssd1306_write('0');
+  while(temp--) print_char('0');
   return digits;
 }
 
@@ -122,11 +169,11 @@ static size_t print_float(double n, uint16_t precision)
   size_t digits = 0;
   if(n < 0)
     {
-      ssd1306_write('-');
+      print_char('-');
       n = -n;
     }
   digits += print_int((int)n);
-  digits += ssd1306_write('.');
+  digits += print_char('.');
   while(precision--)
     {
       if(precision == 0) n += 0.05;
@@ -141,7 +188,7 @@ static size_t print_str(char *str)
   size_t digits = 0;
   while (*str != '\0')
     {
-      ssd1306_write(*str++);
+      print_char(*str++);
       digits++;
     }
   return digits;
@@ -0,0 +1,178 @@
+/*
+ * ssd1306_queue.c
+ *
+ * Bounded queue where every cell carries a sequence number: a cell is free for the
+ * producer at position p when its sequence is p, and ready for the consumer when it is p + 1.
+ */
+
+#include <ssd1306.h>
+#include <ssd1306_queue.h>
+
+#define QUEUE_MASK (SSD1306_QUEUE_SIZE - 1)
+
+static uint8_t queue_has_newer(ssd1306_queue_t *queue, uint16_t tag);
+static void queue_execute(const ssd1306_draw_command_t *command);
+
+void ssd1306_queue_init(ssd1306_queue_t *queue)
+{
+  for(uint32_t i = 0; i < SSD1306_QUEUE_SIZE; i++) queue->cells[i].sequence = i;
+  queue->post_position = 0;
+  queue->drain_position = 0;
+  queue->overflows = 0;
+  queue->coalesced = 0;
+}
+
+//safe from interrupts and tasks at the same time, never waits for the consumer
+int ssd1306_queue_post(ssd1306_queue_t *queue, const ssd1306_draw_command_t *command)
+{
+  uint32_t position = __atomic_load_n(&queue->post_position, __ATOMIC_RELAXED);
+  for(;;)
+    {
+      ssd1306_queue_cell_t *cell = &queue->cells[position & QUEUE_MASK];
+      int32_t difference = (int32_t)(__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - position);
+      if(difference == 0)
+	{
+	  //claims the cell, another producer winning it reloads position
+	  if(__atomic_compare_exchange_n(&queue->post_position, &position, position + 1, 1,
+					 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	    {
+	      cell->command = *command;
+	      __atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE);
+	      return SSD1306_SUCCESS;
+	    }
+	}
+      else if(difference < 0)
+	{
+	  //the cell still holds a command from one ring earlier
+	  __atomic_fetch_add(&queue->overflows, 1, __ATOMIC_RELAXED);
+	  return SSD1306_ERROR_QUEUE_FULL;
+	}
+      else position = __atomic_load_n(&queue->post_position, __ATOMIC_RELAXED);
+    }
+}
+
+int ssd1306_queue_pixel(ssd1306_queue_t *queue, uint16_t tag, int16_t x, int16_t y, uint8_t color)
+{
+  ssd1306_draw_command_t command = {SSD_QUEUE_PIXEL, color, tag, x, y, {0}};
+  return ssd1306_queue_post(queue, &command);
+}
+
+int ssd1306_queue_span(ssd1306_queue_t *queue, uint16_t tag, int16_t x0, int16_t y, int16_t x1, uint8_t color)
+{
+  ssd1306_draw_command_t command = {SSD_QUEUE_SPAN, color, tag, x0, y, {0}};
+  command.data.x1 = x1;
+  return ssd1306_queue_post(queue, &command);
+}
+
+int ssd1306_queue_rect(ssd1306_queue_t *queue, uint16_t tag, int16_t x, int16_t y, int16_t width, int16_t height, uint8_t color)
+{
+  ssd1306_draw_command_t command = {SSD_QUEUE_RECT, color, tag, x, y, {0}};
+  command.data.size.width = width;
+  command.data.size.height = height;
+  return ssd1306_queue_post(queue, &command);
+}
+
+//longer texts are cut to SSD1306_QUEUE_TEXT_LENGTH characters
+int ssd1306_queue_text(ssd1306_queue_t *queue, uint16_t tag, int16_t x, int16_t y, const char *text, uint8_t color)
+{
+  ssd1306_draw_command_t command = {SSD_QUEUE_TEXT, color, tag, x, y, {0}};
+  uint8_t i = 0;
+  for(; i < SSD1306_QUEUE_TEXT_LENGTH && text[i] != '\0'; i++) command.data.text[i] = text[i];
+  if(i < SSD1306_QUEUE_TEXT_LENGTH) command.data.text[i] = '\0';
+  return ssd1306_queue_post(queue, &command);
+}
+
+int ssd1306_queue_bitmap(ssd1306_queue_t *queue, uint16_t tag, const uint8_t *bitmap, uint8_t width, uint8_t height,
+			 int16_t x, int16_t y, uint8_t rop)
+{
+  ssd1306_draw_command_t command = {SSD_QUEUE_BITMAP, rop, tag, x, y, {0}};
+  command.data.bitmap.bitmap = bitmap;
+  command.data.bitmap.width = width;
+  command.data.bitmap.height = height;
+  return ssd1306_queue_post(queue, &command);
+}
+
+uint16_t ssd1306_queue_drain(ssd1306_queue_t *queue, uint16_t max_commands)
+{
+  uint16_t taken = 0;
+  while(taken < max_commands)
+    {
+      uint32_t position = queue->drain_position;
+      ssd1306_queue_cell_t *cell = &queue->cells[position & QUEUE_MASK];
+      if(__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != position + 1) break;
+      ssd1306_draw_command_t command = cell->command;
+      //the cell is handed back to the producers for the next ring
+      __atomic_store_n(&cell->sequence, position + SSD1306_QUEUE_SIZE, __ATOMIC_RELEASE);
+      queue->drain_position = position + 1;
+      taken++;
+      if(command.tag && queue_has_newer(queue, command.tag))
+	{
+	  queue->coalesced++;
+	  continue;
+	}
+      queue_execute(&command);
+    }
+  return taken;
+}
+
+//looks for the tag among the commands already posted behind the drain position
+static uint8_t queue_has_newer(ssd1306_queue_t *queue, uint16_t tag)
+{
+  for(uint32_t position = queue->drain_position; position != queue->drain_position + SSD1306_QUEUE_SIZE; position++)
+    {
+      ssd1306_queue_cell_t *cell = &queue->cells[position & QUEUE_MASK];
+      if(__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != position + 1) return 0;
+      if(cell->command.tag == tag) return 1;
+    }
+  return 0;
+}
+
+static void queue_execute(const ssd1306_draw_command_t *command)
+{
+  switch(command->type)
+  {
+    case SSD_QUEUE_PIXEL:
+      ssd1306_draw_pixel(command->x, command->y, command->color);
+      break;
+    case SSD_QUEUE_SPAN:
+      ssd1306_draw_h_line(command->x, command->y, command->data.x1, command->color);
+      break;
+    case SSD_QUEUE_RECT:
+      {
+	//ssd1306_fill_rect takes screen coordinates, the part left of or above the screen is cut off
+	int16_t x = command->x, y = command->y, width = command->data.size.width, height = command->data.size.height;
+	if(x < 0)
+	  {
+	    width += x;
+	    x = 0;
+	  }
+	if(y < 0)
+	  {
+	    height += y;
+	    y = 0;
+	  }
+	if(width < 1 || height < 1 || x > 255 || y > 255) break;
+	ssd1306_fill_rect(x, y, width > 255 ? 255 : width, height > 255 ? 255 : height, command->color);
+      }
+      break;
+    case SSD_QUEUE_TEXT:
+      {
+	if(command->x < 0 || command->y < 0 || command->x > 255 || command->y > 255) break;
+	//the text color and cursor of the draining task are given back afterwards
+	uint8_t color = ssd1306_get_text_color();
+	uint8_t cursor_x = ssd1306_get_cursor_x(), cursor_y = ssd1306_get_cursor_y();
+	ssd1306_set_text_color(command->color);
+	ssd1306_set_cursor_coord(command->x, command->y);
+	for(uint8_t i = 0; i < SSD1306_QUEUE_TEXT_LENGTH && command->data.text[i] != '\0'; i++) ssd1306_write(command->data.text[i]);
+	ssd1306_set_text_color(color);
+	ssd1306_set_cursor_coord(cursor_x, cursor_y);
+      }
+      break;
+    case SSD_QUEUE_BITMAP:
+      ssd1306_draw_page_bitmap(command->data.bitmap.bitmap, command->data.bitmap.width, command->data.bitmap.height,
+			       command->x, command->y, command->color);
+      break;
+    default:
+      break;
+  }
+}
@@ -0,0 +1,175 @@
+/*
+ * ssd1306_sprite.c
+ *
+ * A sprite at row offset s of a page is drawn from the copy shifted down by s rows,
+ * so each of its bytes lands in one byte of the screen buffer.
+ */
+
+#include <ssd1306.h>
+#include <ssd1306_sprite.h>
+
+static void sprite_draw(const ssd1306_sprite_engine_t *engine, const ssd1306_sprite_t *sprite,
+			int16_t x, int16_t y, uint8_t frame);
+static void sprite_restore(const ssd1306_sprite_engine_t *engine, const ssd1306_sprite_t *sprite);
+static uint8_t sprite_overlaps_erased(const ssd1306_sprite_engine_t *engine, const ssd1306_sprite_t *sprite);
+
+void ssd1306_sprite_preshift(ssd1306_sprite_sheet_t *sheet, uint8_t *buffer)
+{
+  uint8_t width = sheet->width, pages = (sheet->height + 7) >> 3;
+  uint8_t last_mask = (sheet->height & 0b111) ? 0xFF >> (8 - (sheet->height & 0b111)) : 0xFF;
+  uint8_t lower, upper;
+  const uint8_t *src;
+  uint8_t *dst = buffer;
+  for(uint8_t frame = 0; frame < sheet->frame_count; frame++)
+    {
+      src = sheet->frames + frame * width * pages;
+      for(uint8_t shift = 0; shift < 8; shift++)
+	for(uint8_t page = 0; page <= pages; page++)
+	  for(uint8_t column = 0; column < width; column++)
+	    {
+	      //rows not in the frame are cleared, they would show up once shifted in
+	      lower = page < pages ? src[page * width + column] & (page == pages - 1 ? last_mask : 0xFF) : 0;
+	      upper = page > 0 ? src[(page - 1) * width + column] & (page == pages ? last_mask : 0xFF) : 0;
+	      *dst++ = (lower << shift) | (shift ? upper >> (8 - shift) : 0);
+	    }
+    }
+  sheet->shifted = buffer;
+}
+
+void ssd1306_sprite_engine_init(ssd1306_sprite_engine_t *engine, const uint8_t *background)
+{
+  engine->count = 0;
+  engine->background = background;
+}
+
+int ssd1306_sprite_add(ssd1306_sprite_engine_t *engine, const ssd1306_sprite_sheet_t *sheet, int16_t x, int16_t y)
+{
+  if(engine->count >= SSD1306_SPRITE_MAX || !sheet || !sheet->frame_count
+      || !sheet->width || !sheet->height || sheet->height > 248) return SSD1306_ERROR_INVALID_ARGUMENT;
+  ssd1306_sprite_t *sprite = &engine->sprites[engine->count];
+  sprite->sheet = sheet;
+  sprite->x = x;
+  sprite->y = y;
+  sprite->velocity_x = 0;
+  sprite->velocity_y = 0;
+  sprite->frame = 0;
+  sprite->frame_ticks = 0;
+  sprite->tick = 0;
+  sprite->visible = 1;
+  sprite->drawn = 0;
+  sprite->erased = 0;
+  return engine->count++;
+}
+
+void ssd1306_sprite_move(ssd1306_sprite_engine_t *engine, uint8_t index, int16_t x, int16_t y)
+{
+  if(index >= engine->count) return;
+  engine->sprites[index].x = x;
+  engine->sprites[index].y = y;
+}
+
+void ssd1306_sprite_set_velocity(ssd1306_sprite_engine_t *engine, uint8_t index, int8_t velocity_x, int8_t velocity_y)
+{
+  if(index >= engine->count) return;
+  engine->sprites[index].velocity_x = velocity_x;
+  engine->sprites[index].velocity_y = velocity_y;
+}
+
+void ssd1306_sprite_set_animation(ssd1306_sprite_engine_t *engine, uint8_t index, uint8_t frame, uint8_t frame_ticks)
+{
+  if(index >= engine->count) return;
+  engine->sprites[index].frame = frame % engine->sprites[index].sheet->frame_count;
+  engine->sprites[index].frame_ticks = frame_ticks;
+  engine->sprites[index].tick = 0;
+}
+
+void ssd1306_sprite_show(ssd1306_sprite_engine_t *engine, uint8_t index, uint8_t visible)
+{
+  if(index >= engine->count) return;
+  engine->sprites[index].visible = visible;
+}
+
+void ssd1306_sprite_update(ssd1306_sprite_engine_t *engine)
+{
+  ssd1306_sprite_t *sprite;
+  for(uint8_t i = 0; i < engine->count; i++)
+    {
+      sprite = &engine->sprites[i];
+      if(sprite->frame_ticks && ++sprite->tick >= sprite->frame_ticks)
+	{
+	  sprite->tick = 0;
+	  if(++sprite->frame >= sprite->sheet->frame_count) sprite->frame = 0;
+	}
+      sprite->x += sprite->velocity_x;
+      sprite->y += sprite->velocity_y;
+      sprite->erased = 0;
+      if(sprite->drawn && (!sprite->visible || sprite->x != sprite->drawn_x
+	  || sprite->y != sprite->drawn_y || sprite->frame != sprite->drawn_frame))
+	{
+	  if(engine->background) sprite_restore(engine, sprite);
+	  else sprite_draw(engine, sprite, sprite->drawn_x, sprite->drawn_y, sprite->drawn_frame);
+	  sprite->drawn = 0;
+	  sprite->erased = 1;
+	}
+    }
+  //a restored background may have cut into sprites that did not change,
+  //drawing them again with SSD_ROP_OR leaves their untouched pixels as they are
+  if(engine->background)
+    for(uint8_t i = 0; i < engine->count; i++)
+      {
+	sprite = &engine->sprites[i];
+	if(sprite->drawn && sprite_overlaps_erased(engine, sprite)) sprite->drawn = 0;
+      }
+  for(uint8_t i = 0; i < engine->count; i++)
+    {
+      sprite = &engine->sprites[i];
+      if(!sprite->visible || sprite->drawn) continue;
+      sprite_draw(engine, sprite, sprite->x, sprite->y, sprite->frame);
+      sprite->drawn = 1;
+      sprite->drawn_x = sprite->x;
+      sprite->drawn_y = sprite->y;
+      sprite->drawn_frame = sprite->frame;
+    }
+}
+
+void ssd1306_sprite_invalidate(ssd1306_sprite_engine_t *engine)
+{
+  for(uint8_t i = 0; i < engine->count; i++) engine->sprites[i].drawn = 0;
+}
+
+static void sprite_draw(const ssd1306_sprite_engine_t *engine, const ssd1306_sprite_t *sprite,
+			int16_t x, int16_t y, uint8_t frame)
+{
+  const ssd1306_sprite_sheet_t *sheet = sprite->sheet;
+  uint8_t rop = engine->background ? SSD_ROP_OR : SSD_ROP_XOR;
+  uint8_t pages = (sheet->height + 7) >> 3, shift = y & 0b111;
+  if(sheet->shifted)
+    {
+      //the copy starts at the page boundary, the rows above the sprite are empty
+      ssd1306_draw_page_bitmap(sheet->shifted + (frame * 8 + shift) * sheet->width * (pages + 1),
+			       sheet->width, sheet->height + shift, x, y - shift, rop);
+      return;
+    }
+  ssd1306_draw_page_bitmap(sheet->frames + frame * sheet->width * pages, sheet->width, sheet->height, x, y, rop);
+}
+
+//copies the footprint drawn last from the background
+static void sprite_restore(const ssd1306_sprite_engine_t *engine, const ssd1306_sprite_t *sprite)
+{
+  ssd1306_restore_rect(engine->background, sprite->drawn_x, sprite->drawn_y, sprite->sheet->width, sprite->sheet->height);
+}
+
+static uint8_t sprite_overlaps_erased(const ssd1306_sprite_engine_t *engine, const ssd1306_sprite_t *sprite)
+{
+  const ssd1306_sprite_t *other;
+  for(uint8_t i = 0; i < engine->count; i++)
+    {
+      other = &engine->sprites[i];
+      if(!other->erased) continue;
+      if(other->drawn_x <= sprite->drawn_x + sprite->sheet->width - 1
+	  && sprite->drawn_x <= other->drawn_x + other->sheet->width - 1
+	  && other->drawn_y <= sprite->drawn_y + sprite->sheet->height - 1
+	  && sprite->drawn_y <= other->drawn_y + other->sheet->height - 1) return 1;
+    }
+  return 0;
+}
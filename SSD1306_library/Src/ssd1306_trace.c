@@ -0,0 +1,453 @@
+/*
+ * ssd1306_trace.c
+ */
+
+#include <ssd1306.h>
+#include <ssd1306_trace.h>
+
+#ifdef USE_TRACE
+
+#define TRACE_MAX_ARGUMENTS (3 + 2 * SSD1306_POLYGON_MAX_POINTS)
+//id, count, time, site and the arguments, 5 bytes per varint at most
+#define TRACE_MAX_RECORD (2 + 5 * (2 + TRACE_MAX_ARGUMENTS))
+
+static struct
+{
+  uint8_t *buffer;
+  uint16_t size;
+  uint16_t head;         // next byte written
+  uint16_t tail;         // first byte of the oldest record
+  uint16_t used;
+  uint32_t first_time;   // time of the record at tail
+  uint32_t last_time;    // time of the newest record
+  uint32_t dropped;
+  uint32_t (*clock)(void);
+  uint8_t recording;
+  uint8_t depth;
+  void *site;
+} trace;
+
+typedef struct
+{
+  const ssd1306_transport_t *target;
+  uint32_t bytes;
+} counting_context_t;
+
+static uint8_t put_varint(uint8_t *out, uint32_t value);
+static uint32_t get_varint(const uint8_t *data, uint32_t length, uint32_t *position, uint8_t *error);
+static uint8_t ring_byte(uint16_t offset);
+static void ring_drop_oldest(void);
+static uint8_t replay_call(uint8_t call, const int32_t *a, uint8_t count,
+			   const ssd1306_trace_replay_t *replay, ssd1306_display_t *display);
+static const void *replay_resolve(int32_t address, const ssd1306_trace_replay_t *replay);
+static ssd1306_trace_site_t *replay_site(ssd1306_trace_replay_t *replay, uint32_t site, uint8_t call);
+
+void ssd1306_trace_start(uint8_t *buffer, uint16_t size, uint32_t (*clock)(void))
+{
+  trace.buffer = buffer;
+  trace.size = size;
+  trace.head = 0;
+  trace.tail = 0;
+  trace.used = 0;
+  trace.dropped = 0;
+  trace.clock = clock;
+  trace.depth = 0;
+  trace.site = 0;
+  trace.recording = (buffer && size >= TRACE_MAX_RECORD);
+}
+
+void ssd1306_trace_stop(void)
+{
+  trace.recording = 0;
+}
+
+uint32_t ssd1306_trace_dropped(void)
+{
+  return trace.dropped;
+}
+
+//records the call when it is not made from inside another recorded call
+uint8_t ssd1306_trace_enter(uint8_t call, void *site, const int32_t *arguments, uint8_t count)
+{
+  uint8_t record[TRACE_MAX_RECORD];
+  uint8_t length = 2;
+  if(trace.depth++ || !trace.recording) return 1;
+  uint32_t now = trace.clock ? trace.clock() : 0;
+  if(!trace.used) trace.first_time = trace.last_time = now;
+  if(count > TRACE_MAX_ARGUMENTS) count = TRACE_MAX_ARGUMENTS;
+  record[0] = call;
+  record[1] = count;
+  length += put_varint(record + length, now - trace.last_time);
+  length += put_varint(record + length, (uint32_t)(uintptr_t)(trace.site ? trace.site : site));
+  for(uint8_t i = 0; i < count; i++)
+    length += put_varint(record + length, ((uint32_t)arguments[i] << 1) ^ (uint32_t)(arguments[i] >> 31));
+  while(trace.size - trace.used < length) ring_drop_oldest();
+  trace.last_time = now;
+  for(uint8_t i = 0; i < length; i++)
+    {
+      trace.buffer[trace.head] = record[i];
+      if(++trace.head == trace.size) trace.head = 0;
+    }
+  trace.used += length;
+  return 1;
+}
+
+void ssd1306_trace_leave(uint8_t *scope)
+{
+  (void)scope;
+  trace.depth--;
+}
+
+void ssd1306_trace_set_site(void *site)
+{
+  trace.site = site;
+}
+
+uint32_t ssd1306_trace_dump(void (*write)(const uint8_t *bytes, uint16_t count))
+{
+  uint8_t time[4] = {trace.first_time, trace.first_time >> 8, trace.first_time >> 16, trace.first_time >> 24};
+  uint32_t length = trace.used;
+  write(time, sizeof(time));
+  //the ring is sent in at most two pieces
+  if(trace.tail + trace.used > trace.size)
+    {
+      write(trace.buffer + trace.tail, trace.size - trace.tail);
+      write(trace.buffer, trace.used - (trace.size - trace.tail));
+    }
+  else if(trace.used) write(trace.buffer + trace.tail, trace.used);
+  trace.head = trace.tail = trace.used = 0;
+  return length + sizeof(time);
+}
+
+static int counting_begin(void *context, uint8_t transfer_type)
+{
+  const ssd1306_transport_t *target = ((counting_context_t *)context)->target;
+  return target->ops->begin(target->context, transfer_type);
+}
+
+static int counting_write(void *context, const uint8_t *bytes, uint16_t count)
+{
+  counting_context_t *counting = (counting_context_t *)context;
+  counting->bytes += count;
+  return counting->target->ops->write(counting->target->context, bytes, count);
+}
+
+static int counting_end(void *context)
+{
+  const ssd1306_transport_t *target = ((counting_context_t *)context)->target;
+  return target->ops->end(target->context);
+}
+
+static int counting_write_data_async(void *context, const uint8_t *bytes, uint16_t count,
+				     ssd1306_transfer_done_t done, void *done_context)
+{
+  counting_context_t *counting = (counting_context_t *)context;
+  counting->bytes += count;
+  return counting->target->ops->write_data_async(counting->target->context, bytes, count, done, done_context);
+}
+
+static int counting_recover(void *context)
+{
+  const ssd1306_transport_t *target = ((counting_context_t *)context)->target;
+  return target->ops->recover(target->context);
+}
+
+//the transport of the display is wrapped while the calls run, so their bus bytes can be counted
+int ssd1306_trace_replay(const uint8_t *dump, uint32_t length, ssd1306_trace_replay_t *replay)
+{
+  ssd1306_display_t *display = ssd1306_get_display();
+  ssd1306_transport_t target = display->transport;
+  ssd1306_transport_ops_t counting_ops = {
+      counting_begin,
+      counting_write,
+      counting_end,
+      target.ops->write_data_async ? counting_write_data_async : 0,
+      target.ops->recover ? counting_recover : 0
+  };
+  counting_context_t counting = {&target, 0};
+  int32_t arguments[TRACE_MAX_ARGUMENTS];
+  uint32_t position = 4, site, bytes, started, time;
+  uint8_t call, count, error = 0, recording = trace.recording;
+  if(length < 4) return SSD1306_ERROR_INVALID_ARGUMENT;
+  time = dump[0] | (dump[1] << 8) | ((uint32_t)dump[2] << 16) | ((uint32_t)dump[3] << 24);
+  replay->site_count = 0;
+  replay->calls = 0;
+  replay->skipped = 0;
+  trace.recording = 0;
+  display->transport.ops = &counting_ops;
+  display->transport.context = &counting;
+  while(position + 2 <= length && !error)
+    {
+      call = dump[position++];
+      count = dump[position++];
+      if(count > TRACE_MAX_ARGUMENTS)
+	{
+	  error = 1;
+	  break;
+	}
+      time += get_varint(dump, length, &position, &error);
+      site = get_varint(dump, length, &position, &error);
+      for(uint8_t i = 0; i < count; i++)
+	{
+	  uint32_t value = get_varint(dump, length, &position, &error);
+	  arguments[i] = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+	}
+      if(error) break;
+      bytes = counting.bytes;
+      started = replay->clock ? replay->clock() : 0;
+      if(!replay_call(call, arguments, count, replay, display))
+	{
+	  replay->skipped++;
+	  continue;
+	}
+      ssd1306_trace_site_t *entry = replay_site(replay, site, call);
+      if(entry)
+	{
+	  entry->calls++;
+	  entry->bus_bytes += counting.bytes - bytes;
+	  if(replay->clock) entry->time += replay->clock() - started;
+	}
+      replay->calls++;
+      if(replay->on_flush && (call == SSD_TRACE_DISPLAY || call == SSD_TRACE_FLUSH_STEP)) replay->on_flush(time);
+    }
+  display->transport = target;
+  ssd1306_select_display(display);
+  trace.recording = recording;
+  return error ? SSD1306_ERROR_INVALID_ARGUMENT : SSD1306_SUCCESS;
+}
+
+static ssd1306_trace_site_t *replay_site(ssd1306_trace_replay_t *replay, uint32_t site, uint8_t call)
+{
+  for(uint16_t i = 0; i < replay->site_count; i++)
+    if(replay->sites[i].site == site && replay->sites[i].call == call) return &replay->sites[i];
+  if(!replay->sites || replay->site_count >= replay->site_capacity) return 0;
+  ssd1306_trace_site_t *entry = &replay->sites[replay->site_count++];
+  entry->site = site;
+  entry->call = call;
+  entry->calls = 0;
+  entry->bus_bytes = 0;
+  entry->time = 0;
+  return entry;
+}
+
+//host object for a device address, NULL for address 0 or when the host has none
+static const void *replay_resolve(int32_t address, const ssd1306_trace_replay_t *replay)
+{
+  return (address && replay->resolve) ? replay->resolve((uint32_t)address) : 0;
+}
+
+//returns 0 when the call can not be run again, display is the one the replay started on
+static uint8_t replay_call(uint8_t call, const int32_t *a, uint8_t count,
+			   const ssd1306_trace_replay_t *replay, ssd1306_display_t *display)
+{
+  static const uint8_t argument_counts[] = {
+      0, 0, 0, 1, 0, 3, 5, 6, 2, 4, 0, 4, 4, 5, 6, 7,
+      6, 4, 5, 5, 6, 4, 5, 5, 5, 7, 6, 7, 3, 6, 6, 1,
+      1, 6, 2, 2, 1, 1, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1,
+      1, 0, 2, 1, 1, 2, 4, 2, 1, 2, 1, 0, 0, 4, 0, 6,
+      0, 0, 4, 1, 4, 1, 1, 5, 2, 1, 4, 1, 4, 5
+  };
+  const void *data = 0;
+  if(call >= sizeof(argument_counts) || call == 0 || count < argument_counts[call]) return 0;
+  switch(call)
+  {
+    case SSD_TRACE_DRAW_XBM:
+    case SSD_TRACE_DRAW_PAGE_BITMAP:
+    case SSD_TRACE_SET_FONT:
+    case SSD_TRACE_DRAW_GLYPH:
+    case SSD_TRACE_SEND_WINDOW:
+    case SSD_TRACE_LAYER_INIT:
+    case SSD_TRACE_ADD_LAYER:
+    case SSD_TRACE_REMOVE_LAYER:
+    case SSD_TRACE_SET_LAYER_BOUNDS:
+    case SSD_TRACE_SHOW_LAYER:
+    case SSD_TRACE_CANVAS_INIT:
+    case SSD_TRACE_DRAW_CANVAS:
+    case SSD_TRACE_RESTORE_RECT:
+      data = replay_resolve(a[0], replay);
+      if(!data) return 0;
+      break;
+    case SSD_TRACE_SELECT_DISPLAY:
+    case SSD_TRACE_DRAW_TO_LAYER:
+    case SSD_TRACE_DRAW_TO_CANVAS:
+      //0 stands for the default target
+      data = replay_resolve(a[0], replay);
+      if(a[0] && !data) return 0;
+      break;
+    default:
+      break;
+  }
+  switch(call)
+  {
+    case SSD_TRACE_DISPLAY: ssd1306_display(); break;
+    case SSD_TRACE_FLUSH_BEGIN: ssd1306_flush_begin(); break;
+    case SSD_TRACE_FLUSH_STEP: ssd1306_flush_step(a[0]); break;
+    case SSD_TRACE_CLEAR_DISPLAY: ssd1306_clear_display(); break;
+    case SSD_TRACE_DRAW_PIXEL: ssd1306_draw_pixel(a[0], a[1], a[2]); break;
+    case SSD_TRACE_DRAW_LINE: ssd1306_draw_line(a[0], a[1], a[2], a[3], a[4]); break;
+    case SSD_TRACE_DRAW_LINE_THICK: ssd1306_draw_line_thick(a[0], a[1], a[2], a[3], a[4], a[5]); break;
+    case SSD_TRACE_SET_LINE_PATTERN: ssd1306_set_line_pattern(a[0], a[1]); break;
+    case SSD_TRACE_SET_CLIP_RECT: ssd1306_set_clip_rect(a[0], a[1], a[2], a[3]); break;
+    case SSD_TRACE_RESET_CLIP_RECT: ssd1306_reset_clip_rect(); break;
+    case SSD_TRACE_DRAW_H_LINE: ssd1306_draw_h_line(a[0], a[1], a[2], a[3]); break;
+    case SSD_TRACE_DRAW_V_LINE: ssd1306_draw_v_line(a[0], a[1], a[2], a[3]); break;
+    case SSD_TRACE_FILL_RECT: ssd1306_fill_rect(a[0], a[1], a[2], a[3], a[4]); break;
+    case SSD_TRACE_COPY_RECT: ssd1306_copy_rect(a[0], a[1], a[2], a[3], a[4], a[5]); break;
+    case SSD_TRACE_SCROLL_RECT: ssd1306_scroll_rect(a[0], a[1], a[2], a[3], a[4], a[5], a[6]); break;
+    case SSD_TRACE_FILL_RECT_ROUND: ssd1306_fill_rect_round(a[0], a[1], a[2], a[3], a[4], a[5]); break;
+    case SSD_TRACE_FILL_CIRCLE: ssd1306_fill_circle(a[0], a[1], a[2], a[3]); break;
+    case SSD_TRACE_FILL_CIRCLE_QUARTER: ssd1306_fill_circle_quarter(a[0], a[1], a[2], a[3], a[4]); break;
+    case SSD_TRACE_DRAW_RECT: ssd1306_draw_rect(a[0], a[1], a[2], a[3], a[4]); break;
+    case SSD_TRACE_DRAW_RECT_ROUND: ssd1306_draw_rect_round(a[0], a[1], a[2], a[3], a[4], a[5]); break;
+    case SSD_TRACE_DRAW_CIRCLE: ssd1306_draw_circle(a[0], a[1], a[2], a[3]); break;
+    case SSD_TRACE_DRAW_CIRCLE_QUARTER: ssd1306_draw_circle_quarter(a[0], a[1], a[2], a[3], a[4]); break;
+    case SSD_TRACE_FILL_ELLIPSE: ssd1306_fill_ellipse(a[0], a[1], a[2], a[3], a[4]); break;
+    case SSD_TRACE_DRAW_ELLIPSE: ssd1306_draw_ellipse(a[0], a[1], a[2], a[3], a[4]); break;
+    case SSD_TRACE_FILL_ARC: ssd1306_fill_arc(a[0], a[1], a[2], a[3], a[4], a[5], a[6]); break;
+    case SSD_TRACE_DRAW_ARC: ssd1306_draw_arc(a[0], a[1], a[2], a[3], a[4], a[5]); break;
+    case SSD_TRACE_FILL_TRIANGLE: ssd1306_fill_triangle(a[0], a[1], a[2], a[3], a[4], a[5], a[6]); break;
+    case SSD_TRACE_FILL_POLYGON:
+      {
+	ssd1306_point_t points[SSD1306_POLYGON_MAX_POINTS];
+	if(a[0] > SSD1306_POLYGON_MAX_POINTS || count < 3 + 2 * a[0]) return 0;
+	for(uint8_t i = 0; i < a[0]; i++)
+	  {
+	    points[i].x = a[3 + 2 * i];
+	    points[i].y = a[4 + 2 * i];
+	  }
+	ssd1306_fill_polygon(points, a[0], a[1], a[2]);
+	break;
+      }
+    case SSD_TRACE_DRAW_XBM: ssd1306_draw_XBM(data, a[1], a[2], a[3], a[4], a[5]); break;
+    case SSD_TRACE_DRAW_PAGE_BITMAP: ssd1306_draw_page_bitmap(data, a[1], a[2], a[3], a[4], a[5]); break;
+    case SSD_TRACE_SET_FONT: ssd1306_set_font(data); break;
+    case SSD_TRACE_WRITE: ssd1306_write(a[0]); break;
+    case SSD_TRACE_DRAW_GLYPH: ssd1306_draw_glyph(data, a[1], a[2], a[3], a[4], a[5]); break;
+    case SSD_TRACE_SET_CURSOR: ssd1306_set_cursor(a[0], a[1]); break;
+    case SSD_TRACE_SET_CURSOR_COORD: ssd1306_set_cursor_coord(a[0], a[1]); break;
+    case SSD_TRACE_SET_CURSOR_COLUMN: ssd1306_set_cursor_column(a[0]); break;
+    case SSD_TRACE_SET_CURSOR_ROW: ssd1306_set_cursor_row(a[0]); break;
+    case SSD_TRACE_ADVANCE_CURSOR_ROW: ssd1306_advance_cursor_row(a[0], a[1]); break;
+    case SSD_TRACE_SET_TEXT_OFFSET: ssd1306_set_text_offset(a[0], a[1]); break;
+    case SSD_TRACE_SET_TEXT_SCALE: ssd1306_set_text_scale(a[0]); break;
+    case SSD_TRACE_SET_TEXT_COLOR: ssd1306_set_text_color(a[0]); break;
+    case SSD_TRACE_SET_TEXT_LINE_SPACING: ssd1306_set_text_line_spacing(a[0]); break;
+    case SSD_TRACE_SET_TEXT_LETTER_SPACING: ssd1306_set_text_letter_spacing(a[0]); break;
+    case SSD_TRACE_SET_CONTRAST: ssd1306_set_contrast(a[0]); break;
+    case SSD_TRACE_SET_DISPLAY_ON: ssd1306_set_display_on(a[0]); break;
+    case SSD_TRACE_INVERT_DISPLAY: ssd1306_invert_display(a[0]); break;
+    case SSD_TRACE_FLIP_VERTICALLY: ssd1306_flip_vertically(a[0]); break;
+    case SSD_TRACE_SET_ROTATION: ssd1306_set_rotation(a[0]); break;
+    case SSD_TRACE_FLUSH_COMMANDS: ssd1306_flush_commands(); break;
+    case SSD_TRACE_SET_FADE: ssd1306_set_fade(a[0], a[1]); break;
+    case SSD_TRACE_SET_ZOOM: ssd1306_set_zoom(a[0]); break;
+    case SSD_TRACE_SEND_COMMAND: ssd1306_send_command(a[0]); break;
+    case SSD_TRACE_SEND_COMMAND_WITH_VALUE: ssd1306_send_command_with_value(a[0], a[1]); break;
+    case SSD_TRACE_MARK_UPDATED_WINDOW: ssd1306_mark_updated_window(a[0], a[1], a[2], a[3]); break;
+    case SSD_TRACE_SET_CLOCK_DIV: ssd1306_set_clock_div(a[0], a[1]); break;
+    case SSD_TRACE_SET_MULTIPLEX_RATIO: ssd1306_set_multiplex_ratio(a[0]); break;
+    case SSD_TRACE_SET_PRE_CHARGE: ssd1306_set_pre_charge(a[0], a[1]); break;
+    case SSD_TRACE_SELECT_DISPLAY: ssd1306_select_display(data ? (ssd1306_display_t *)data : display); break;
+    case SSD_TRACE_INIT: ssd1306_init(); break;
+#ifdef USE_WARM_RESTART
+    case SSD_TRACE_INIT_WARM: ssd1306_init_warm(); break;
+#endif
+    case SSD_TRACE_SET_WINDOW: ssd1306_set_window(a[0], a[1], a[2], a[3]); break;
+    case SSD_TRACE_TAKE_UPDATED_WINDOW:
+      {
+	uint8_t column_start, column_end, page_start, page_end;
+	ssd1306_take_updated_window(&column_start, &column_end, &page_start, &page_end);
+	break;
+      }
+    case SSD_TRACE_SEND_WINDOW: ssd1306_send_window(data, a[1], a[2], a[3], a[4], a[5]); break;
+    case SSD_TRACE_DISPLAY_EMPTY: ssd1306_display_empty(); break;
+    case SSD_TRACE_DISPLAY_FULL: ssd1306_display_full(); break;
+    case SSD_TRACE_START_CONTRAST_RAMP: ssd1306_start_contrast_ramp(a[0], a[1], a[2], a[3]); break;
+    case SSD_TRACE_CONTRAST_RAMP_TICK: ssd1306_contrast_ramp_tick(a[0]); break;
+    case SSD_TRACE_LAYER_INIT:
+      {
+	uint8_t *buffer = (uint8_t *)replay_resolve(a[1], replay);
+	const uint8_t *mask = replay_resolve(a[2], replay);
+	if(!buffer || (a[2] && !mask)) return 0;
+	ssd1306_layer_init((ssd1306_layer_t *)data, buffer, mask, a[3]);
+	break;
+      }
+    case SSD_TRACE_ADD_LAYER: ssd1306_add_layer((ssd1306_layer_t *)data); break;
+    case SSD_TRACE_REMOVE_LAYER: ssd1306_remove_layer((ssd1306_layer_t *)data); break;
+    case SSD_TRACE_SET_LAYER_BOUNDS: ssd1306_set_layer_bounds((ssd1306_layer_t *)data, a[1], a[2], a[3], a[4]); break;
+    case SSD_TRACE_SHOW_LAYER: ssd1306_show_layer((ssd1306_layer_t *)data, a[1]); break;
+    case SSD_TRACE_DRAW_TO_LAYER: ssd1306_draw_to_layer((ssd1306_layer_t *)data); break;
+    case SSD_TRACE_CANVAS_INIT:
+      {
+	uint8_t *buffer = (uint8_t *)replay_resolve(a[1], replay);
+	if(!buffer) return 0;
+	ssd1306_canvas_init((ssd1306_canvas_t *)data, buffer, a[2], a[3]);
+	break;
+      }
+    case SSD_TRACE_DRAW_TO_CANVAS: ssd1306_draw_to_canvas((ssd1306_canvas_t *)data); break;
+    case SSD_TRACE_DRAW_CANVAS: ssd1306_draw_canvas(data, a[1], a[2], a[3]); break;
+    case SSD_TRACE_RESTORE_RECT: ssd1306_restore_rect(data, a[1], a[2], a[3], a[4]); break;
+    default: return 0;
+  }
+  return 1;
+}
+
+static uint8_t put_varint(uint8_t *out, uint32_t value)
+{
+  uint8_t length = 0;
+  while(value >= 0x80)
+    {
+      out[length++] = (value & 0x7F) | 0x80;
+      value >>= 7;
+    }
+  out[length++] = value;
+  return length;
+}
+
+static uint32_t get_varint(const uint8_t *data, uint32_t length, uint32_t *position, uint8_t *error)
+{
+  uint32_t value = 0;
+  for(uint8_t shift = 0; shift < 35; shift += 7)
+    {
+      if(*position >= length) break;
+      uint8_t byte = data[(*position)++];
+      value |= (uint32_t)(byte & 0x7F) << shift;
+      if(!(byte & 0x80)) return value;
+    }
+  *error = 1;
+  return 0;
+}
+
+static uint8_t ring_byte(uint16_t offset)
+{
+  offset += trace.tail;
+  if(offset >= trace.size) offset -= trace.size;
+  return trace.buffer[offset];
+}
+
+//the time of the dropped record moves into the start time of the ring
+static void ring_drop_oldest(void)
+{
+  uint16_t length = 2;
+  uint8_t count = ring_byte(1), byte;
+  uint32_t delta = 0;
+  for(uint8_t varint = 0; varint < count + 2; varint++)
+    {
+      uint8_t shift = 0;
+      do
+	{
+	  byte = ring_byte(length++);
+	  if(varint == 0) delta |= (uint32_t)(byte & 0x7F) << shift;
+	  shift += 7;
+	}
+      while(byte & 0x80);
+    }
+  //the next record keeps its delta relative to the dropped one
+  trace.first_time += delta;
+  trace.tail += length;
+  if(trace.tail >= trace.size) trace.tail -= trace.size;
+  trace.used -= length;
+  trace.dropped++;
+}
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * ssd1306_transport_host.c
+ *
+ * Stand-in for the controller when the library is built for a PC.
+ * Only horizontal addressing mode is emulated.
+ */
+
+#include <ssd1306.h>
+
+static uint8_t host_command_arguments(uint8_t command)
+{
+  switch(command)
+  {
+    case 0x21: //column address
+    case 0x22: //page address
+    case 0xA3: //vertical scroll area
+      return 2;
+    case 0x20: //addressing mode
+    case 0x23: //fade out and blinking
+    case 0x81: //contrast
+    case 0x8D: //charge pump
+    case 0xA8: //multiplex ratio
+    case 0xD3: //display offset
+    case 0xD5: //clock divide
+    case 0xD6: //zoom in
+    case 0xD9: //pre charge
+    case 0xDA: //COM pins
+    case 0xDB: //VCOMH deselect level
+      return 1;
+    case 0x26: //horizontal scroll setup
+    case 0x27:
+      return 6;
+    case 0x29: //vertical and horizontal scroll setup
+    case 0x2A:
+      return 5;
+    default:
+      return 0;
+  }
+}
+
+static void host_command_byte(ssd1306_host_t *host, uint8_t value)
+{
+  if(!host->pending_arguments)
+    {
+      host->pending_command = value;
+      host->pending_arguments = host_command_arguments(value);
+      host->argument_index = 0;
+      return;
+    }
+  switch(host->pending_command)
+  {
+    case 0x21:
+      if(host->argument_index == 0) host->column_start = host->column = value & 0x7F;
+      else host->column_end = value & 0x7F;
+      break;
+    case 0x22:
+      if(host->argument_index == 0) host->page_start = host->page = value & 0x07;
+      else host->page_end = value & 0x07;
+      break;
+    default:
+      break;
+  }
+  host->argument_index++;
+  host->pending_arguments--;
+}
+
+static void host_data_byte(ssd1306_host_t *host, uint8_t value)
+{
+  host->gddram[host->page * 128 + host->column] = value;
+  if(host->column >= host->column_end)
+    {
+      host->column = host->column_start;
+      host->page = (host->page >= host->page_end) ? host->page_start : host->page + 1;
+    }
+  else host->column++;
+}
+
+static int host_begin(void *context, uint8_t transfer_type)
+{
+  ssd1306_host_t *host = (ssd1306_host_t *)context;
+  if(host->fail) return SSD1306_ERROR_COMMUNICATION;
+  host->transfer_type = transfer_type;
+  host->transfers++;
+  return SSD1306_SUCCESS;
+}
+
+static int host_write(void *context, const uint8_t *bytes, uint16_t count)
+{
+  ssd1306_host_t *host = (ssd1306_host_t *)context;
+  if(host->fail) return SSD1306_ERROR_COMMUNICATION;
+  if(host->transfer_type == SSD1306_TRANSFER_DATA)
+    {
+      host->data_bytes += count;
+      while(count--) host_data_byte(host, *bytes++);
+    }
+  else
+    {
+      host->command_bytes += count;
+      while(count--) host_command_byte(host, *bytes++);
+    }
+  return SSD1306_SUCCESS;
+}
+
+static int host_end(void *context)
+{
+  ssd1306_host_t *host = (ssd1306_host_t *)context;
+  if(host->fail) return SSD1306_ERROR_COMMUNICATION;
+  return SSD1306_SUCCESS;
+}
+
+static int host_write_data_async(void *context, const uint8_t *bytes, uint16_t count,
+				 ssd1306_transfer_done_t done, void *done_context)
+{
+  int result = host_begin(context, SSD1306_TRANSFER_DATA);
+  if(result == SSD1306_SUCCESS) result = host_write(context, bytes, count);
+  if(result == SSD1306_SUCCESS) result = host_end(context);
+  if(done) done(done_context, result);
+  return result;
+}
+
+//a half received command is dropped, like a controller after a bus reset
+static int host_recover(void *context)
+{
+  ssd1306_host_t *host = (ssd1306_host_t *)context;
+  host->pending_arguments = 0;
+  host->recoveries++;
+  return SSD1306_SUCCESS;
+}
+
+void ssd1306_host_reset(ssd1306_host_t *host)
+{
+  uint8_t *ptr = (uint8_t *)host;
+  uint16_t size = sizeof(ssd1306_host_t);
+  while(size--) *ptr++ = 0;
+  host->column_end = 127;
+  host->page_end = 7;
+}
+
+const ssd1306_transport_ops_t ssd1306_host_ops = {
+    host_begin,
+    host_write,
+    host_end,
+    host_write_data_async,
+    host_recover
+};
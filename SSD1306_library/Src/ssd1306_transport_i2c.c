@@ -0,0 +1,74 @@
+/*
+ * ssd1306_transport_i2c.c
+ */
+
+#include <ssd1306.h>
+#include "i2cs.h"
+
+#define SSD_commandByte 0x00
+#define SSD_dataByte 0x40
+
+static int i2c_begin(void *context, uint8_t transfer_type)
+{
+  ssd1306_i2c_t *i2c = (ssd1306_i2c_t *)context;
+  uint8_t control = transfer_type == SSD1306_TRANSFER_DATA ? SSD_dataByte : SSD_commandByte;
+  if(i2c->bus)
+    {
+      if(i2c->bus->start(i2c->bus->handle, i2c->address) != SSD1306_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+      if(i2c->bus->write(i2c->bus->handle, &control, 1) != SSD1306_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+      return SSD1306_SUCCESS;
+    }
+  if(i2cs_start_transmission(i2c->address, 0) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+  if(i2cs_send_byte(control) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+  return SSD1306_SUCCESS;
+}
+
+static int i2c_write(void *context, const uint8_t *bytes, uint16_t count)
+{
+  ssd1306_i2c_t *i2c = (ssd1306_i2c_t *)context;
+  if(i2c->bus)
+    {
+      if(i2c->bus->write(i2c->bus->handle, bytes, count) != SSD1306_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+      return SSD1306_SUCCESS;
+    }
+  if(i2cs_send_byte_array(bytes, count) != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+  return SSD1306_SUCCESS;
+}
+
+static int i2c_end(void *context)
+{
+  ssd1306_i2c_t *i2c = (ssd1306_i2c_t *)context;
+  if(i2c->bus)
+    {
+      if(i2c->bus->stop(i2c->bus->handle) != SSD1306_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+      return SSD1306_SUCCESS;
+    }
+  if(i2cs_end_transmission() != I2C_SUCCESS) return SSD1306_ERROR_COMMUNICATION;
+  return SSD1306_SUCCESS;
+}
+
+static int i2c_write_data_async(void *context, const uint8_t *bytes, uint16_t count,
+				ssd1306_transfer_done_t done, void *done_context)
+{
+  ssd1306_i2c_t *i2c = (ssd1306_i2c_t *)context;
+  if(!i2c->bus || !i2c->bus->write_async)
+    {
+      //no background transfers, the burst is sent in place and completes immediately
+      int result = i2c_begin(context, SSD1306_TRANSFER_DATA);
+      if(result == SSD1306_SUCCESS) result = i2c_write(context, bytes, count);
+      if(result == SSD1306_SUCCESS) result = i2c_end(context);
+      if(done) done(done_context, result);
+      return result;
+    }
+  if(i2c->bus->write_async(i2c->bus->handle, i2c->address, SSD_dataByte, bytes, count, done, done_context) != SSD1306_SUCCESS)
+    return SSD1306_ERROR_COMMUNICATION;
+  return SSD1306_SUCCESS;
+}
+
+const ssd1306_transport_ops_t ssd1306_i2c_ops = {
+    i2c_begin,
+    i2c_write,
+    i2c_end,
+    i2c_write_data_async,
+    0
+};
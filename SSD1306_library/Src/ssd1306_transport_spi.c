@@ -0,0 +1,72 @@
+/*
+ * ssd1306_transport_spi.c
+ *
+ * 4-wire SPI: D/C low for command bytes, high for display data.
+ */
+
+#include <ssd1306.h>
+
+static int spi_begin(void *context, uint8_t transfer_type)
+{
+  ssd1306_spi_t *spi = (ssd1306_spi_t *)context;
+  spi->set_dc(transfer_type == SSD1306_TRANSFER_DATA);
+  if(spi->set_cs) spi->set_cs(0);
+  return SSD1306_SUCCESS;
+}
+
+static int spi_write(void *context, const uint8_t *bytes, uint16_t count)
+{
+  ssd1306_spi_t *spi = (ssd1306_spi_t *)context;
+  if(spi->spi_write(bytes, count) != SSD1306_SUCCESS)
+    {
+      if(spi->set_cs) spi->set_cs(1);
+      return SSD1306_ERROR_COMMUNICATION;
+    }
+  return SSD1306_SUCCESS;
+}
+
+static int spi_end(void *context)
+{
+  ssd1306_spi_t *spi = (ssd1306_spi_t *)context;
+  if(spi->set_cs) spi->set_cs(1);
+  return SSD1306_SUCCESS;
+}
+
+static void spi_async_done(void *context, int result)
+{
+  ssd1306_spi_t *spi = (ssd1306_spi_t *)context;
+  if(spi->set_cs) spi->set_cs(1);
+  if(spi->pending_done) spi->pending_done(spi->pending_done_context, result);
+}
+
+static int spi_write_data_async(void *context, const uint8_t *bytes, uint16_t count,
+				ssd1306_transfer_done_t done, void *done_context)
+{
+  ssd1306_spi_t *spi = (ssd1306_spi_t *)context;
+  if(!spi->spi_write_async)
+    {
+      //no DMA, the burst is sent in place and completes immediately
+      int result = spi_begin(context, SSD1306_TRANSFER_DATA);
+      if(result == SSD1306_SUCCESS) result = spi_write(context, bytes, count);
+      spi_end(context);
+      if(done) done(done_context, result);
+      return result;
+    }
+  spi->pending_done = done;
+  spi->pending_done_context = done_context;
+  spi_begin(context, SSD1306_TRANSFER_DATA);
+  if(spi->spi_write_async(bytes, count, spi_async_done, spi) != SSD1306_SUCCESS)
+    {
+      if(spi->set_cs) spi->set_cs(1);
+      return SSD1306_ERROR_COMMUNICATION;
+    }
+  return SSD1306_SUCCESS;
+}
+
+const ssd1306_transport_ops_t ssd1306_spi_ops = {
+    spi_begin,
+    spi_write,
+    spi_end,
+    spi_write_data_async,
+    0
+};
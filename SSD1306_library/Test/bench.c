@@ -0,0 +1,157 @@
+/*
+ * bench.c
+ *
+ * Times every drawing primitive on the host and prints ns per call and pixels per second,
+ * pixels are the ones a call lights on a cleared screen.
+ * An optional argument sets the time spent on each primitive in milliseconds.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <ssd1306.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Fonts/Fixedsys8x14.h"
+#include "img_xbmp/splash128x32.h"
+
+static ssd1306_host_t host;
+static volatile uint32_t sink;
+
+static const ssd1306_point_t star[] = {
+    {64, 0}, {71, 31}, {46, 11}, {82, 11}, {57, 31}
+};
+
+static void bench_pixel(uint32_t i) { ssd1306_draw_pixel(i & 127, (i >> 7) & 31, SSD_COLOR_WHITE); }
+static void bench_h_line(uint32_t i) { ssd1306_draw_h_line(3, i & 31, 124, SSD_COLOR_WHITE); }
+static void bench_v_line(uint32_t i) { ssd1306_draw_v_line(i & 127, 1, 30, SSD_COLOR_WHITE); }
+static void bench_line_shallow(uint32_t i) { ssd1306_draw_line(0, i & 7, 127, 31 - (i & 7), SSD_COLOR_WHITE); }
+static void bench_line_steep(uint32_t i) { ssd1306_draw_line(40 + (i & 7), 0, 60 - (i & 7), 31, SSD_COLOR_WHITE); }
+static void bench_line_thick(uint32_t i) { ssd1306_draw_line_thick(4, 4 + (i & 3), 120, 26, 4, SSD_COLOR_WHITE); }
+static void bench_rect(uint32_t i) { ssd1306_draw_rect(i & 7, 2, 100, 28, SSD_COLOR_WHITE); }
+static void bench_fill_rect(uint32_t i) { ssd1306_fill_rect(i & 7, 3, 100, 26, SSD_COLOR_WHITE); }
+static void bench_fill_rect_inverse(uint32_t i) { ssd1306_fill_rect(i & 7, 3, 100, 26, SSD_COLOR_INVERSE); }
+static void bench_fill_screen(uint32_t i) { (void)i; ssd1306_fill_rect(0, 0, 128, 32, SSD_COLOR_WHITE); }
+static void bench_circle(uint32_t i) { ssd1306_draw_circle(64 + (i & 7), 16, 15, SSD_COLOR_WHITE); }
+static void bench_fill_circle(uint32_t i) { ssd1306_fill_circle(64 + (i & 7), 16, 15, SSD_COLOR_WHITE); }
+static void bench_circle_quarter(uint32_t i) { ssd1306_draw_circle_quarter(64, 16, 15, i & 3, SSD_COLOR_WHITE); }
+static void bench_fill_circle_quarter(uint32_t i) { ssd1306_fill_circle_quarter(64, 16, 15, i & 3, SSD_COLOR_WHITE); }
+static void bench_rect_round(uint32_t i) { ssd1306_draw_rect_round(i & 7, 1, 100, 30, 8, SSD_COLOR_WHITE); }
+static void bench_fill_rect_round(uint32_t i) { ssd1306_fill_rect_round(i & 7, 1, 100, 30, 8, SSD_COLOR_WHITE); }
+static void bench_ellipse(uint32_t i) { ssd1306_draw_ellipse(64 + (i & 7), 16, 40, 14, SSD_COLOR_WHITE); }
+static void bench_fill_ellipse(uint32_t i) { ssd1306_fill_ellipse(64 + (i & 7), 16, 40, 14, SSD_COLOR_WHITE); }
+static void bench_fill_arc(uint32_t i) { ssd1306_fill_arc(64, 16, 15, 8, i & 63, 250, SSD_COLOR_WHITE); }
+static void bench_fill_triangle(uint32_t i) { ssd1306_fill_triangle(2, 30, 60 + (i & 7), 1, 120, 24, SSD_COLOR_WHITE); }
+static void bench_fill_polygon(uint32_t i) { (void)i; ssd1306_fill_polygon(star, 5, SSD_FILL_NON_ZERO, SSD_COLOR_WHITE); }
+static void bench_xbm(uint32_t i)
+{
+  ssd1306_draw_XBM(splash128x32_bits, splash128x32_width, splash128x32_height, i & 31, (i >> 5) & 3, SSD_COLOR_WHITE);
+}
+static void bench_text(uint32_t i)
+{
+  ssd1306_set_cursor_coord(i & 7, 2);
+  ssd1306_printf("Hello 1234");
+}
+static void bench_text_scale2(uint32_t i)
+{
+  ssd1306_set_text_scale(2);
+  ssd1306_set_cursor_coord(i & 7, 2);
+  ssd1306_printf("Hi 42");
+  ssd1306_set_text_scale(1);
+}
+static void bench_printf_formats(uint32_t i)
+{
+  ssd1306_set_cursor_coord(0, 2);
+  ssd1306_printf("%d %.2f %s", (int)i & 1023, 3.25, "ok");
+}
+static void bench_display(uint32_t i)
+{
+  ssd1306_draw_pixel(i & 127, 0, SSD_COLOR_INVERSE);
+  ssd1306_draw_pixel(127 - (i & 127), 31, SSD_COLOR_INVERSE);
+  ssd1306_display();
+}
+static void bench_display_full(uint32_t i) { (void)i; ssd1306_display_full(); }
+
+static const struct
+{
+  const char *name;
+  void (*run)(uint32_t i);
+} benches[] = {
+    {"draw_pixel", bench_pixel},
+    {"draw_h_line", bench_h_line},
+    {"draw_v_line", bench_v_line},
+    {"draw_line shallow", bench_line_shallow},
+    {"draw_line steep", bench_line_steep},
+    {"draw_line_thick", bench_line_thick},
+    {"draw_rect", bench_rect},
+    {"fill_rect", bench_fill_rect},
+    {"fill_rect inverse", bench_fill_rect_inverse},
+    {"fill_rect screen", bench_fill_screen},
+    {"draw_circle", bench_circle},
+    {"fill_circle", bench_fill_circle},
+    {"draw_circle_quarter", bench_circle_quarter},
+    {"fill_circle_quarter", bench_fill_circle_quarter},
+    {"draw_rect_round", bench_rect_round},
+    {"fill_rect_round", bench_fill_rect_round},
+    {"draw_ellipse", bench_ellipse},
+    {"fill_ellipse", bench_fill_ellipse},
+    {"fill_arc", bench_fill_arc},
+    {"fill_triangle", bench_fill_triangle},
+    {"fill_polygon", bench_fill_polygon},
+    {"draw_XBM", bench_xbm},
+    {"printf text", bench_text},
+    {"printf text scale 2", bench_text_scale2},
+    {"printf formats", bench_printf_formats},
+    {"display 2 pixels", bench_display},
+    {"display_full", bench_display_full},
+};
+
+static double now_seconds(void)
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static uint32_t lit_pixels(void)
+{
+  uint32_t count = 0;
+  const uint8_t *buffer = ssd1306_get_buffer();
+  for(uint16_t i = 0; i < SCREEN_BUFFER_SIZE; i++)
+    for(uint8_t value = buffer[i]; value; value &= value - 1) count++;
+  return count;
+}
+
+int main(int argc, char **argv)
+{
+  double budget = (argc > 1 ? atof(argv[1]) : 200) * 1e-3;
+  ssd1306_transport_t transport = {&ssd1306_host_ops, &host};
+  ssd1306_host_reset(&host);
+  ssd1306_set_transport(&transport);
+  ssd1306_init();
+  ssd1306_set_font(Fixedsys8x14);
+
+  printf("%-22s %12s %10s %14s\n", "primitive", "ns/op", "pixels", "Mpixels/s");
+  for(unsigned b = 0; b < sizeof(benches) / sizeof(benches[0]); b++)
+    {
+      ssd1306_clear_display();
+      benches[b].run(0);
+      uint32_t pixels = lit_pixels();
+
+      //calls in batches of doubling size until the budget is spent
+      uint32_t calls = 0, batch = 16;
+      double start = now_seconds(), elapsed;
+      do
+	{
+	  for(uint32_t i = 0; i < batch; i++) benches[b].run(calls + i);
+	  calls += batch;
+	  batch *= 2;
+	  elapsed = now_seconds() - start;
+	}
+      while(elapsed < budget);
+      sink += ssd1306_get_buffer()[0];
+
+      double ns = elapsed * 1e9 / calls;
+      printf("%-22s %12.1f %10u %14.2f\n", benches[b].name, ns, (unsigned)pixels, pixels / ns * 1e3);
+    }
+  return 0;
+}
@@ -0,0 +1,704 @@
+/*
+ * golden_test.c
+ *
+ * Renders a fixed corpus through the drawing functions on the host transport
+ * and compares every screen with a PBM image in the golden directory.
+ * Run with the golden directory, --update writes the images instead.
+ * Behaviour checks of the flush and the widgets follow on the same transport.
+ */
+
+#include <ssd1306.h>
+#include <ssd1306_field.h>
+#include <ssd1306_list.h>
+#include <ssd1306_manager.h>
+#include <ssd1306_queue.h>
+#include <ssd1306_sprite.h>
+#include <stdio.h>
+#include <string.h>
+#include "Fonts/Fixedsys8x14.h"
+#include "img_xbmp/splash128x32.h"
+
+static ssd1306_host_t host;
+
+static const uint8_t arrow_xbm[] = {
+    0x18, 0x3C, 0x7E, 0xFF, 0x18, 0x18, 0x18, 0x18
+};
+
+static const uint8_t checker_pages[] = {
+    0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55,
+    0xFF, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0xFF
+};
+
+static void scene_lines(void)
+{
+  //every octant from the middle, then lines cut by all four edges
+  for(int i = 0; i < 16; i++)
+    {
+      static const int8_t dx[16] = {30, 30, 30, 15, 0, -15, -30, -30, -30, -30, -30, -15, 0, 15, 30, 30};
+      static const int8_t dy[16] = {0, 7, 15, 15, 15, 15, 15, 7, 0, -7, -15, -15, -15, -15, -15, -7};
+      ssd1306_draw_line(64, 16, 64 + dx[i], 16 + dy[i], SSD_COLOR_WHITE);
+    }
+  ssd1306_draw_line(-20, -5, 20, 40, SSD_COLOR_WHITE);
+  ssd1306_draw_line(100, -10, 140, 20, SSD_COLOR_WHITE);
+  ssd1306_draw_line(5, 31, 5, 31, SSD_COLOR_WHITE);
+  ssd1306_draw_line(0, 0, 127, 31, SSD_COLOR_INVERSE);
+}
+
+static void scene_line_styles(void)
+{
+  ssd1306_draw_line_thick(4, 4, 60, 28, 3, SSD_COLOR_WHITE);
+  ssd1306_draw_line_thick(70, 28, 124, 2, 4, SSD_COLOR_WHITE);
+  ssd1306_set_line_pattern(0b1100111, 7);
+  ssd1306_draw_line(0, 16, 127, 16, SSD_COLOR_INVERSE);
+  ssd1306_draw_line(64, 0, 40, 31, SSD_COLOR_WHITE);
+  ssd1306_set_line_pattern(0, 0);
+}
+
+static void scene_rects(void)
+{
+  ssd1306_draw_rect(0, 0, 128, 32, SSD_COLOR_WHITE);
+  ssd1306_fill_rect(4, 3, 30, 11, SSD_COLOR_WHITE);
+  ssd1306_fill_rect(20, 7, 30, 20, SSD_COLOR_INVERSE);
+  ssd1306_draw_h_line(60, 5, 120, SSD_COLOR_WHITE);
+  ssd1306_draw_h_line(120, 9, 60, SSD_COLOR_WHITE);
+  ssd1306_draw_v_line(70, 2, 29, SSD_COLOR_WHITE);
+  ssd1306_draw_v_line(75, 29, 12, SSD_COLOR_WHITE);
+  ssd1306_fill_rect(110, 20, 40, 40, SSD_COLOR_WHITE);
+  ssd1306_fill_rect(112, 22, 4, 4, SSD_COLOR_BLACK);
+  for(int i = 0; i < 16; i++) ssd1306_draw_pixel(80 + i * 2, 14 + (i & 3), SSD_COLOR_WHITE);
+}
+
+static void scene_circles(void)
+{
+  for(int r = 0; r < 6; r++) ssd1306_draw_circle(6 + r * 12, 8, r, SSD_COLOR_WHITE);
+  for(int r = 0; r < 6; r++) ssd1306_fill_circle(6 + r * 12, 24, r, SSD_COLOR_WHITE);
+  ssd1306_draw_circle(90, 16, 15, SSD_COLOR_WHITE);
+  ssd1306_fill_circle(90, 16, 9, SSD_COLOR_INVERSE);
+  ssd1306_fill_circle(125, 2, 12, SSD_COLOR_WHITE);
+  ssd1306_draw_circle(125, 30, 6, SSD_COLOR_WHITE);
+}
+
+static void scene_circle_quarters(void)
+{
+  for(int q = 0; q < 4; q++)
+    {
+      ssd1306_draw_circle_quarter(12 + q * 30, 14, 10, q, SSD_COLOR_WHITE);
+      ssd1306_fill_circle_quarter(12 + q * 30, 16, 7, q, SSD_COLOR_WHITE);
+      ssd1306_fill_circle_quarter(20 + q * 30, 28, 3, q, SSD_COLOR_WHITE);
+    }
+}
+
+static void scene_round_rects(void)
+{
+  ssd1306_draw_rect_round(0, 0, 40, 32, 0, SSD_COLOR_WHITE);
+  ssd1306_draw_rect_round(44, 0, 40, 32, 5, SSD_COLOR_WHITE);
+  ssd1306_fill_rect_round(48, 4, 32, 24, 8, SSD_COLOR_WHITE);
+  ssd1306_fill_rect_round(88, 2, 38, 12, 6, SSD_COLOR_WHITE);
+  ssd1306_draw_rect_round(88, 16, 38, 15, 1, SSD_COLOR_WHITE);
+  ssd1306_fill_rect_round(4, 4, 32, 24, 12, SSD_COLOR_INVERSE);
+}
+
+static void scene_conics(void)
+{
+  ssd1306_draw_ellipse(20, 16, 18, 10, SSD_COLOR_WHITE);
+  ssd1306_fill_ellipse(20, 16, 10, 4, SSD_COLOR_WHITE);
+  ssd1306_fill_arc(64, 16, 14, 8, -45, 200, SSD_COLOR_WHITE);
+  ssd1306_draw_arc(64, 16, 15, 210, 320, SSD_COLOR_WHITE);
+  ssd1306_fill_ellipse(110, 20, 30, 14, SSD_COLOR_INVERSE);
+}
+
+static void scene_polygons(void)
+{
+  static const ssd1306_point_t star[] = {
+      {64, 0}, {71, 31}, {46, 11}, {82, 11}, {57, 31}
+  };
+  ssd1306_fill_triangle(2, 30, 20, 1, 38, 24, SSD_COLOR_WHITE);
+  ssd1306_fill_triangle(10, 10, 10, 10, 30, 10, SSD_COLOR_WHITE);
+  ssd1306_fill_polygon(star, 5, SSD_FILL_EVEN_ODD, SSD_COLOR_WHITE);
+  ssd1306_fill_polygon(star, 5, SSD_FILL_NON_ZERO, SSD_COLOR_INVERSE);
+  ssd1306_fill_triangle(90, -10, 140, 16, 95, 45, SSD_COLOR_WHITE);
+}
+
+static void scene_bitmaps(void)
+{
+  ssd1306_draw_XBM(splash128x32_bits, splash128x32_width, splash128x32_height, 0, 3, SSD_COLOR_WHITE);
+  ssd1306_draw_XBM(arrow_xbm, 8, 8, 90, 5, SSD_COLOR_WHITE);
+  ssd1306_draw_XBM(arrow_xbm, 8, 8, 94, 9, SSD_COLOR_INVERSE);
+  ssd1306_draw_XBM(arrow_xbm, 8, 8, 124, 28, SSD_COLOR_WHITE);
+  ssd1306_draw_page_bitmap(checker_pages, 12, 16, 100, 3, SSD_ROP_COPY);
+  ssd1306_draw_page_bitmap(checker_pages, 12, 16, 106, 11, SSD_ROP_XOR);
+}
+
+static void scene_copy_scroll(void)
+{
+  ssd1306_draw_XBM(splash128x32_bits, splash128x32_width, splash128x32_height, 0, 0, SSD_COLOR_WHITE);
+  ssd1306_copy_rect(10, 4, 30, 14, 85, 13);
+  ssd1306_scroll_rect(40, 0, 30, 32, 3, -5, SSD_COLOR_BLACK);
+}
+
+static void scene_clip(void)
+{
+  ssd1306_set_clip_rect(10, 5, 60, 20);
+  ssd1306_fill_circle(20, 10, 15, SSD_COLOR_WHITE);
+  ssd1306_draw_line(0, 31, 127, 0, SSD_COLOR_WHITE);
+  ssd1306_fill_rect(60, 0, 30, 32, SSD_COLOR_INVERSE);
+  ssd1306_reset_clip_rect();
+  ssd1306_draw_rect(9, 4, 62, 22, SSD_COLOR_WHITE);
+}
+
+static void draw_text_lines(uint8_t scale)
+{
+  ssd1306_set_font(Fixedsys8x14);
+  ssd1306_set_text_scale(scale);
+  ssd1306_set_cursor_coord(0, 0);
+  ssd1306_printf("AgQ%dz~", scale);
+  ssd1306_set_text_color(SSD_COLOR_INVERSE);
+  ssd1306_set_cursor_coord(3, 14 * scale - 6);
+  ssd1306_printf("!@#$");
+}
+
+static void scene_text_scale1(void)
+{
+  draw_text_lines(1);
+}
+
+static void scene_text_scale2(void)
+{
+  draw_text_lines(2);
+}
+
+static void scene_text_scale3(void)
+{
+  draw_text_lines(3);
+}
+
+static void scene_text_spacing(void)
+{
+  ssd1306_set_font(Fixedsys8x14);
+  ssd1306_set_text_letter_spacing(3);
+  ssd1306_set_text_line_spacing(2);
+  ssd1306_set_cursor(0, 0);
+  ssd1306_printf("spaced\nlines");
+  ssd1306_draw_glyph(Fixedsys8x14, 'W', 100, 10, 2, SSD_COLOR_WHITE);
+}
+
+static void scene_printf_formats(void)
+{
+  ssd1306_set_font(Fixedsys8x14);
+  ssd1306_set_cursor(0, 0);
+  ssd1306_printf("%d %i %c%s", -42, 7, '#', "ok");
+  ssd1306_set_cursor(0, 1);
+  ssd1306_printf("%f %.3f %.0f", 3.14159, -0.5, 9.9);
+}
+
+static void scene_rotated(void)
+{
+  ssd1306_set_rotation(SSD_ROTATION_90);
+  ssd1306_fill_rect(2, 2, 10, 40, SSD_COLOR_WHITE);
+  ssd1306_draw_line(0, 0, 31, 127, SSD_COLOR_INVERSE);
+  ssd1306_fill_circle(16, 90, 12, SSD_COLOR_WHITE);
+  ssd1306_set_font(Fixedsys8x14);
+  ssd1306_set_cursor_coord(14, 50);
+  ssd1306_printf("%d", 90);
+}
+
+static void scene_upside_down(void)
+{
+  ssd1306_set_rotation(SSD_ROTATION_180);
+  ssd1306_draw_rect_round(0, 0, 128, 32, 6, SSD_COLOR_WHITE);
+  ssd1306_set_font(Fixedsys8x14);
+  ssd1306_set_cursor_coord(8, 9);
+  ssd1306_printf("180 %s", "deg");
+}
+
+static const struct
+{
+  const char *name;
+  void (*draw)(void);
+} scenes[] = {
+    {"lines", scene_lines},
+    {"line_styles", scene_line_styles},
+    {"rects", scene_rects},
+    {"circles", scene_circles},
+    {"circle_quarters", scene_circle_quarters},
+    {"round_rects", scene_round_rects},
+    {"conics", scene_conics},
+    {"polygons", scene_polygons},
+    {"bitmaps", scene_bitmaps},
+    {"copy_scroll", scene_copy_scroll},
+    {"clip", scene_clip},
+    {"text_scale1", scene_text_scale1},
+    {"text_scale2", scene_text_scale2},
+    {"text_scale3", scene_text_scale3},
+    {"text_spacing", scene_text_spacing},
+    {"printf_formats", scene_printf_formats},
+    {"rotated", scene_rotated},
+    {"upside_down", scene_upside_down},
+};
+
+static void reset_state(void)
+{
+  ssd1306_transport_t transport = {&ssd1306_host_ops, &host};
+  ssd1306_host_reset(&host);
+  ssd1306_select_display(0);
+  ssd1306_set_transport(&transport);
+  ssd1306_set_rotation(SSD_ROTATION_0);
+  ssd1306_init();
+  ssd1306_reset_clip_rect();
+  ssd1306_set_line_pattern(0, 0);
+  ssd1306_set_text_scale(1);
+  ssd1306_set_text_color(SSD_COLOR_WHITE);
+  ssd1306_set_text_offset(0, 0);
+  ssd1306_set_text_letter_spacing(0);
+  ssd1306_set_text_line_spacing(0);
+  ssd1306_set_retry_policy(SSD1306_DEFAULT_RETRIES, 1, 16, 0);
+  ssd1306_reset_error_counters();
+  ssd1306_clear_display();
+}
+
+//P4 bitmap of the screen, lit pixels are 1 (black ink)
+static int render_pbm(uint8_t *image, int *width, int *height)
+{
+  *width = ssd1306_get_screen_width();
+  *height = ssd1306_get_screen_height();
+  int row_bytes = (*width + 7) / 8;
+  memset(image, 0, row_bytes * *height);
+  for(int y = 0; y < *height; y++)
+    for(int x = 0; x < *width; x++)
+      if(ssd1306_get_pixel(x, y)) image[y * row_bytes + x / 8] |= 0x80 >> (x & 7);
+  return row_bytes * *height;
+}
+
+static int read_pbm(const char *path, uint8_t *image, int size, int width, int height)
+{
+  FILE *file = fopen(path, "rb");
+  if(!file) return -1;
+  int file_width, file_height;
+  int ok = fscanf(file, "P4 %d %d", &file_width, &file_height) == 2
+      && fgetc(file) != EOF
+      && file_width == width && file_height == height
+      && fread(image, 1, size, file) == (size_t)size;
+  fclose(file);
+  return ok ? 0 : -1;
+}
+
+static int write_pbm(const char *path, const uint8_t *image, int size, int width, int height)
+{
+  FILE *file = fopen(path, "wb");
+  if(!file) return -1;
+  fprintf(file, "P4\n%d %d\n", width, height);
+  int ok = fwrite(image, 1, size, file) == (size_t)size;
+  return (fclose(file) == 0 && ok) ? 0 : -1;
+}
+
+//host transport whose bus gets stuck at the fail_at-th data write,
+//the recover hook frees it again unless stuck_for_good is set
+static uint32_t data_writes, fail_at;
+static uint8_t stuck_for_good;
+static uint16_t backoffs[8];
+static uint8_t backoff_count;
+
+static int stuck_begin(void *context, uint8_t transfer_type)
+{
+  return ssd1306_host_ops.begin(context, transfer_type);
+}
+
+static int stuck_write(void *context, const uint8_t *bytes, uint16_t count)
+{
+  ssd1306_host_t *target = (ssd1306_host_t *)context;
+  if(!target->fail && target->transfer_type == SSD1306_TRANSFER_DATA && ++data_writes == fail_at) target->fail = 1;
+  return ssd1306_host_ops.write(context, bytes, count);
+}
+
+static int stuck_end(void *context)
+{
+  return ssd1306_host_ops.end(context);
+}
+
+static int stuck_recover(void *context)
+{
+  if(!stuck_for_good) ((ssd1306_host_t *)context)->fail = 0;
+  return ssd1306_host_ops.recover(context);
+}
+
+static const ssd1306_transport_ops_t stuck_ops = {stuck_begin, stuck_write, stuck_end, 0, stuck_recover};
+
+static void record_backoff(uint16_t time)
+{
+  if(backoff_count < sizeof(backoffs) / sizeof(backoffs[0])) backoffs[backoff_count++] = time;
+}
+
+static void use_stuck_transport(uint32_t write, uint8_t for_good)
+{
+  ssd1306_transport_t transport = {&stuck_ops, &host};
+  ssd1306_set_transport(&transport);
+  data_writes = 0;
+  fail_at = write;
+  stuck_for_good = for_good;
+  backoff_count = 0;
+  host.data_bytes = 0;
+}
+
+static int panel_matches_buffer(void)
+{
+  return !memcmp(host.gddram, ssd1306_get_buffer(), SCREEN_BUFFER_SIZE);
+}
+
+//one page per data write, the retry carries on with the third page
+static const char *check_bus_error_retried(void)
+{
+  ssd1306_fill_rect(0, 0, 128, 32, SSD_COLOR_WHITE);
+  ssd1306_set_retry_policy(2, 4, 16, record_backoff);
+  use_stuck_transport(3, 0);
+  const ssd1306_error_counters_t *counters = ssd1306_get_error_counters();
+  if(ssd1306_display() != SSD1306_SUCCESS) return "display failed";
+  if(!panel_matches_buffer()) return "panel memory differs from the screen buffer";
+  if(host.data_bytes != SCREEN_BUFFER_SIZE) return "sent pages were sent again";
+  if(counters->retries != 1 || counters->recoveries != 1 || host.recoveries != 1) return "wrong retry count";
+  if(counters->retried_bytes != 2 * SCREEN_WIDTH || counters->failed_flushes) return "wrong error counters";
+  if(backoff_count != 1 || backoffs[0] != 4) return "wrong backoff";
+  return 0;
+}
+
+//after the last retry the unsent pages stay changed and the next flush sends only them
+static const char *check_bus_error_given_up(void)
+{
+  ssd1306_fill_rect(0, 0, 128, 32, SSD_COLOR_WHITE);
+  ssd1306_set_retry_policy(3, 3, 10, record_backoff);
+  use_stuck_transport(3, 1);
+  const ssd1306_error_counters_t *counters = ssd1306_get_error_counters();
+  if(ssd1306_display() != SSD1306_ERROR_COMMUNICATION) return "display did not fail";
+  if(counters->retries != 3 || counters->failed_flushes != 1) return "wrong error counters";
+  if(backoff_count != 3 || backoffs[0] != 3 || backoffs[1] != 6 || backoffs[2] != 10) return "wrong backoff";
+  host.fail = 0;
+  host.data_bytes = 0;
+  if(ssd1306_display() != SSD1306_SUCCESS) return "display failed after the bus came back";
+  if(!panel_matches_buffer()) return "panel memory differs from the screen buffer";
+  if(host.data_bytes != 2 * SCREEN_WIDTH) return "more than the unsent pages were sent";
+  if(counters->failed_flushes != 1) return "the resend counted as failed";
+  return 0;
+}
+
+//a step that failed leaves its pages to the next display, which recovers the bus first
+static const char *check_bus_error_in_step(void)
+{
+  ssd1306_fill_rect(0, 0, 128, 32, SSD_COLOR_WHITE);
+  ssd1306_set_retry_policy(1, 2, 16, record_backoff);
+  use_stuck_transport(3, 0);
+  const ssd1306_error_counters_t *counters = ssd1306_get_error_counters();
+  ssd1306_flush_begin();
+  if(ssd1306_flush_step(SCREEN_WIDTH) != SSD1306_FLUSH_IN_PROGRESS
+      || ssd1306_flush_step(SCREEN_WIDTH) != SSD1306_FLUSH_IN_PROGRESS) return "first pages not sent";
+  if(ssd1306_flush_step(SCREEN_WIDTH) != SSD1306_ERROR_COMMUNICATION) return "stuck bus not reported";
+  if(ssd1306_display() != SSD1306_SUCCESS) return "display failed";
+  if(!panel_matches_buffer()) return "panel memory differs from the screen buffer";
+  if(host.data_bytes != SCREEN_BUFFER_SIZE) return "sent pages were sent again";
+  if(counters->retries != 1 || counters->failed_transfers != 2 || counters->failed_flushes) return "wrong error counters";
+  if(backoff_count != 1 || backoffs[0] != 2) return "wrong backoff";
+  return 0;
+}
+
+//steps smaller and larger than a page, a started page is finished in a step of its own
+static const char *check_flush_step_slices(void)
+{
+  static const struct
+  {
+    uint16_t max_bytes;
+    int steps;
+  } slices[] = {{50, 12}, {200, 4}, {SCREEN_BUFFER_SIZE, 1}};
+  for(unsigned i = 0; i < sizeof(slices) / sizeof(slices[0]); i++)
+    {
+      int result, steps = 0;
+      ssd1306_clear_display();
+      for(int x = 0; x < 128; x += 3) ssd1306_draw_line(x, 0, 127 - x, 31, SSD_COLOR_INVERSE);
+      host.data_bytes = 0;
+      ssd1306_flush_begin();
+      do
+	{
+	  result = ssd1306_flush_step(slices[i].max_bytes);
+	  steps++;
+	}
+      while(result == SSD1306_FLUSH_IN_PROGRESS && steps < 100);
+      if(result != SSD1306_SUCCESS) return "step failed";
+      if(steps != slices[i].steps) return "wrong number of steps";
+      if(host.data_bytes != SCREEN_BUFFER_SIZE) return "bytes sent twice or left out";
+      if(!panel_matches_buffer()) return "panel memory differs from the screen buffer";
+    }
+  return 0;
+}
+
+//a drain draws what the same calls would, the older command of a tag is dropped
+static const char *check_queue_drain(void)
+{
+  static ssd1306_queue_t queue;
+  static uint8_t expected[SCREEN_BUFFER_SIZE];
+  ssd1306_set_font(Fixedsys8x14);
+  ssd1306_fill_rect(40, 8, 20, 10, SSD_COLOR_WHITE);
+  ssd1306_draw_pixel(3, 30, SSD_COLOR_WHITE);
+  ssd1306_draw_h_line(0, 2, 127, SSD_COLOR_WHITE);
+  ssd1306_draw_page_bitmap(checker_pages, 12, 16, 100, 4, SSD_ROP_XOR);
+  ssd1306_set_text_color(SSD_COLOR_INVERSE);
+  ssd1306_set_cursor_coord(60, 16);
+  ssd1306_write('4');
+  ssd1306_write('2');
+  memcpy(expected, ssd1306_get_buffer(), SCREEN_BUFFER_SIZE);
+
+  ssd1306_clear_display();
+  ssd1306_set_text_color(SSD_COLOR_WHITE);
+  ssd1306_set_cursor_coord(3, 2);
+  ssd1306_queue_init(&queue);
+  ssd1306_queue_rect(&queue, 1, 0, 0, 20, 10, SSD_COLOR_WHITE);
+  ssd1306_queue_pixel(&queue, 0, 3, 30, SSD_COLOR_WHITE);
+  ssd1306_queue_rect(&queue, 1, 40, 8, 20, 10, SSD_COLOR_WHITE);
+  ssd1306_queue_span(&queue, 0, 0, 2, 127, SSD_COLOR_WHITE);
+  ssd1306_queue_bitmap(&queue, 0, checker_pages, 12, 16, 100, 4, SSD_ROP_XOR);
+  ssd1306_queue_text(&queue, 2, 60, 16, "42", SSD_COLOR_INVERSE);
+  if(ssd1306_queue_drain(&queue, 2) != 2 || ssd1306_queue_drain(&queue, 100) != 4) return "wrong number of commands taken";
+  if(queue.coalesced != 1 || queue.overflows) return "wrong queue counters";
+  if(memcmp(expected, ssd1306_get_buffer(), SCREEN_BUFFER_SIZE)) return "drained picture differs from the direct calls";
+  if(ssd1306_get_text_color() != SSD_COLOR_WHITE || ssd1306_get_cursor_x() != 3 || ssd1306_get_cursor_y() != 2)
+    return "text color or cursor changed";
+
+  //a full ring turns the next post away until it is drained
+  for(int i = 0; i < SSD1306_QUEUE_SIZE; i++)
+    if(ssd1306_queue_pixel(&queue, 0, i, 0, SSD_COLOR_WHITE) != SSD1306_SUCCESS) return "post failed";
+  if(ssd1306_queue_pixel(&queue, 0, 0, 1, SSD_COLOR_WHITE) != SSD1306_ERROR_QUEUE_FULL || queue.overflows != 1) return "full ring not reported";
+  if(ssd1306_queue_drain(&queue, 100) != SSD1306_QUEUE_SIZE) return "full ring not drained";
+  if(ssd1306_queue_pixel(&queue, 0, 0, 1, SSD_COLOR_WHITE) != SSD1306_SUCCESS) return "post after the drain failed";
+  return 0;
+}
+
+//a changed last digit redraws and marks only its cell, the picture is that of a first update
+static const char *check_field_digit(void)
+{
+  static ssd1306_field_t field;
+  static uint8_t expected[SCREEN_BUFFER_SIZE];
+  uint8_t column_start, column_end, page_start, page_end;
+  ssd1306_field_init(&field, 10, 4, 6, Fixedsys8x14, 1, "%d", SSD_ALIGN_RIGHT, SSD_COLOR_WHITE);
+  ssd1306_field_update(&field, 12346);
+  memcpy(expected, ssd1306_get_buffer(), SCREEN_BUFFER_SIZE);
+
+  ssd1306_clear_display();
+  ssd1306_field_invalidate(&field);
+  if(ssd1306_field_update(&field, 12345) != 6) return "first update did not draw every cell";
+  ssd1306_display();
+  if(ssd1306_field_update(&field, 12346) != 1) return "more than one cell redrawn";
+  if(memcmp(expected, ssd1306_get_buffer(), SCREEN_BUFFER_SIZE)) return "picture differs from a first update";
+  if(!ssd1306_take_updated_window(&column_start, &column_end, &page_start, &page_end)) return "nothing marked";
+  if(column_start != 10 + 5 * field.cell_width || column_end != 10 + 6 * field.cell_width - 1) return "marked more than the cell";
+  if(ssd1306_field_update(&field, 12346) != 0) return "unchanged value redrawn";
+  return 0;
+}
+
+//moving, animated sprite over a scene, after every update the screen has to be the scene
+//with the sprite drawn once at its new place, drawn on a second display to compare,
+//with and without a background copy and pre-shifted frames
+static const char *check_sprite_redraw(void)
+{
+  static const uint8_t frames[] = {
+      0x18, 0x3C, 0x7E, 0xFF, 0xFF, 0x7E, 0x3C, 0x18,
+      0x81, 0x42, 0x24, 0x18, 0x18, 0x24, 0x42, 0x81
+  };
+  static uint8_t scene[SCREEN_BUFFER_SIZE], shifted[SSD1306_SPRITE_SHIFTED_SIZE(8, 8, 2)];
+  static uint8_t expected_buffer[SCREEN_BUFFER_SIZE];
+  static ssd1306_host_t expected_host;
+  static ssd1306_display_t expected;
+  static ssd1306_sprite_engine_t engine;
+  ssd1306_transport_t transport = {&ssd1306_host_ops, &expected_host};
+  ssd1306_init_display(&expected, expected_buffer, &transport);
+  ssd1306_fill_rect(0, 12, 128, 6, SSD_COLOR_WHITE);
+  ssd1306_draw_line(0, 0, 127, 31, SSD_COLOR_INVERSE);
+  memcpy(scene, ssd1306_get_buffer(), SCREEN_BUFFER_SIZE);
+  for(int mode = 0; mode < 4; mode++)
+    {
+      ssd1306_sprite_sheet_t sheet = {frames, 0, 8, 8, 2};
+      uint8_t column_start, column_end, page_start, page_end;
+      if(mode & 1) ssd1306_sprite_preshift(&sheet, shifted);
+      ssd1306_restore_rect(scene, 0, 0, 128, 32);
+      ssd1306_sprite_engine_init(&engine, (mode & 2) ? scene : 0);
+      ssd1306_sprite_add(&engine, &sheet, 2, -3);
+      ssd1306_sprite_set_velocity(&engine, 0, 9, 3);
+      ssd1306_sprite_set_animation(&engine, 0, 0, 2);
+      for(int update = 0; update < 10; update++)
+	{
+	  ssd1306_display();
+	  ssd1306_sprite_update(&engine);
+	  const ssd1306_sprite_t *sprite = &engine.sprites[0];
+	  ssd1306_select_display(&expected);
+	  ssd1306_restore_rect(scene, 0, 0, 128, 32);
+	  ssd1306_draw_page_bitmap(frames + sprite->frame * 8, 8, 8, sprite->x, sprite->y, (mode & 2) ? SSD_ROP_OR : SSD_ROP_XOR);
+	  ssd1306_select_display(0);
+	  if(memcmp(expected_buffer, ssd1306_get_buffer(), SCREEN_BUFFER_SIZE)) return "screen is not the scene with the sprite";
+	  //only the old and the new footprint are changed
+	  if(ssd1306_take_updated_window(&column_start, &column_end, &page_start, &page_end)
+	      && (column_start < sprite->x - 9 || column_end > sprite->x + 7)) return "more than the footprints marked";
+	}
+      ssd1306_sprite_show(&engine, 0, 0);
+      ssd1306_sprite_update(&engine);
+      if(memcmp(scene, ssd1306_get_buffer(), SCREEN_BUFFER_SIZE)) return "hidden sprite left pixels behind";
+    }
+  return 0;
+}
+
+static void list_text(void *context, uint16_t index, char *text, uint8_t size)
+{
+  (void)context;
+  snprintf(text, size, "item %u", (unsigned)index);
+}
+
+//a list scrolled step by step inside the caller's clip rectangle ends with the picture
+//of a list drawn at once, the pixels outside the clip rectangle stay as they were
+static const char *check_list_scroll(void)
+{
+  static ssd1306_list_t list;
+  static uint8_t scrolled[SCREEN_BUFFER_SIZE];
+  const ssd1306_clip_rect_t *clip = &ssd1306_get_display()->clip_rect;
+  int updates = 0;
+  ssd1306_fill_rect(0, 0, 128, 32, SSD_COLOR_WHITE);
+  ssd1306_set_clip_rect(0, 4, 60, 24);
+  ssd1306_list_init(&list, 0, 0, 100, 32, Fixedsys8x14, 20, list_text, 0);
+  ssd1306_list_update(&list);
+  ssd1306_list_select(&list, 5);
+  while(ssd1306_list_update(&list) && updates < 200) updates++;
+  if(updates < 2) return "the list did not scroll in steps";
+  if(list.offset != list.target) return "scrolling did not reach the selection";
+  if(clip->x0 != 0 || clip->y0 != 4 || clip->x1 != 59 || clip->y1 != 27) return "clip rectangle changed";
+  memcpy(scrolled, ssd1306_get_buffer(), SCREEN_BUFFER_SIZE);
+
+  ssd1306_reset_clip_rect();
+  ssd1306_fill_rect(0, 0, 128, 32, SSD_COLOR_WHITE);
+  ssd1306_set_clip_rect(0, 4, 60, 24);
+  ssd1306_list_invalidate(&list);
+  ssd1306_list_update(&list);
+  if(memcmp(scrolled, ssd1306_get_buffer(), SCREEN_BUFFER_SIZE)) return "scrolled picture differs from a full redraw";
+  for(int y = 0; y < 32; y++)
+    for(int x = 0; x < 128; x++)
+      if((x >= 60 || y < 4 || y > 27) && !(scrolled[(y >> 3) * SCREEN_WIDTH + x] & (1 << (y & 7))))
+	return "drawn outside the clip rectangle";
+  return 0;
+}
+
+//two panels on one bus, each poll sends only the changed window of both
+static const char *check_manager_flush(void)
+{
+  static ssd1306_host_t hosts[2];
+  static ssd1306_display_t panels[2];
+  static uint8_t buffers[2][SCREEN_BUFFER_SIZE];
+  static ssd1306_manager_t manager;
+  ssd1306_manager_init(&manager);
+  for(int i = 0; i < 2; i++)
+    {
+      ssd1306_transport_t transport = {&ssd1306_host_ops, &hosts[i]};
+      ssd1306_host_reset(&hosts[i]);
+      ssd1306_init_display(&panels[i], buffers[i], &transport);
+      ssd1306_manager_add(&manager, &panels[i], 0, i);
+    }
+  ssd1306_select_display(&panels[0]);
+  ssd1306_fill_rect(10, 8, 20, 8, SSD_COLOR_WHITE);
+  ssd1306_select_display(&panels[1]);
+  ssd1306_fill_circle(100, 16, 6, SSD_COLOR_WHITE);
+  ssd1306_select_display(0);
+  ssd1306_display_t *selected = ssd1306_get_display();
+  if(ssd1306_manager_is_idle(&manager)) return "changes not seen";
+  if(ssd1306_manager_poll(&manager, 10) != SSD1306_SUCCESS) return "poll failed";
+  if(ssd1306_get_display() != selected) return "selected display changed";
+  if(!ssd1306_manager_is_idle(&manager)) return "flush not finished";
+  for(int i = 0; i < 2; i++)
+    if(memcmp(hosts[i].gddram, buffers[i], SCREEN_BUFFER_SIZE)) return "panel memory differs from the screen buffer";
+  const ssd1306_display_stats_t *first = ssd1306_manager_get_stats(&manager, 0);
+  const ssd1306_display_stats_t *second = ssd1306_manager_get_stats(&manager, 1);
+  if(first->frames != 1 || first->bytes != 20 || second->frames != 1 || second->bytes != 13 * 2) return "wrong stats";
+  if(hosts[0].data_bytes != 20 || hosts[1].data_bytes != 13 * 2) return "more than the changed window was sent";
+  if(ssd1306_manager_poll(&manager, 20) != SSD1306_SUCCESS || first->frames != 1 || second->frames != 1) return "unchanged panels sent again";
+  return 0;
+}
+
+static const struct
+{
+  const char *name;
+  const char *(*run)(void);
+} checks[] = {
+    {"bus_error_retried", check_bus_error_retried},
+    {"bus_error_given_up", check_bus_error_given_up},
+    {"bus_error_in_step", check_bus_error_in_step},
+    {"manager_flush", check_manager_flush},
+    {"flush_step_slices", check_flush_step_slices},
+    {"queue_drain", check_queue_drain},
+    {"field_digit", check_field_digit},
+    {"sprite_redraw", check_sprite_redraw},
+    {"list_scroll", check_list_scroll},
+};
+
+int main(int argc, char **argv)
+{
+  if(argc < 2)
+    {
+      fprintf(stderr, "usage: %s golden_dir [--update]\n", argv[0]);
+      return 2;
+    }
+  int update = argc > 2 && !strcmp(argv[2], "--update");
+  int failures = 0;
+  for(unsigned i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++)
+    {
+      static uint8_t image[SCREEN_BUFFER_SIZE], golden[SCREEN_BUFFER_SIZE];
+      char path[512];
+      int width, height;
+      reset_state();
+      scenes[i].draw();
+      ssd1306_display();
+      int size = render_pbm(image, &width, &height);
+      snprintf(path, sizeof(path), "%s/%s.pbm", argv[1], scenes[i].name);
+
+      //the panel has to end up with the same bytes as the screen buffer
+      if(memcmp(host.gddram, ssd1306_get_buffer(), SCREEN_BUFFER_SIZE))
+	{
+	  printf("FAIL %s: panel memory differs from the screen buffer\n", scenes[i].name);
+	  failures++;
+	}
+      if(update)
+	{
+	  if(write_pbm(path, image, size, width, height))
+	    {
+	      printf("FAIL %s: cannot write %s\n", scenes[i].name, path);
+	      failures++;
+	    }
+	  continue;
+	}
+      if(read_pbm(path, golden, size, width, height))
+	{
+	  printf("FAIL %s: cannot read %s as a %dx%d P4 image\n", scenes[i].name, path, width, height);
+	  failures++;
+	  continue;
+	}
+      int wrong = 0, first = -1;
+      for(int y = 0; y < height; y++)
+	for(int x = 0; x < width; x++)
+	  {
+	    uint8_t mask = 0x80 >> (x & 7);
+	    int at = y * ((width + 7) / 8) + x / 8;
+	    if((image[at] ^ golden[at]) & mask)
+	      {
+		if(first < 0) first = y * width + x;
+		wrong++;
+	      }
+	  }
+      if(wrong)
+	{
+	  printf("FAIL %s: %d pixels differ, first at %d,%d\n", scenes[i].name, wrong, first % width, first / width);
+	  failures++;
+	}
+      else printf("ok   %s\n", scenes[i].name);
+    }
+  for(unsigned i = 0; i < sizeof(checks) / sizeof(checks[0]); i++)
+    {
+      reset_state();
+      const char *failure = checks[i].run();
+      if(failure)
+	{
+	  printf("FAIL %s: %s\n", checks[i].name, failure);
+	  failures++;
+	}
+      else printf("ok   %s\n", checks[i].name);
+    }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,362 @@
+/*
+ * raster_fuzz.c
+ *
+ * Differential test of the drawing kernels against the per-pixel reference (USE_REFERENCE_RASTER),
+ * the library is built with SSD1306_RASTER_SWITCH so both run in this program.
+ * An input is a program of drawing calls, it is run once with each raster from the same state
+ * and the screen buffer, the last canvas, the panel memory and the bytes sent to the panel have to be the same.
+ *
+ * Standalone: raster_fuzz [programs [calls]] runs random programs and prints the calls per second of both.
+ * Built with -DSSD1306_LIBFUZZER and -fsanitize=fuzzer the inputs come from libFuzzer instead.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <ssd1306.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "Fonts/Fixedsys8x14.h"
+
+#define CANVAS_MAX_HEIGHT 48
+#define CANVAS_BUFFER_SIZE (SCREEN_WIDTH * ((CANVAS_MAX_HEIGHT + 7) / 8))
+
+typedef struct
+{
+  uint8_t buffer[SCREEN_BUFFER_SIZE];
+  uint8_t gddram[SCREEN_BUFFER_SIZE];
+  uint8_t canvas[CANVAS_BUFFER_SIZE];
+  uint32_t wire_hash; // FNV-1a of every transaction and byte sent
+  uint32_t wire_bytes;
+  uint32_t calls;
+} raster_result_t;
+
+static ssd1306_host_t host;
+static raster_result_t *result;
+static const uint8_t *input;
+static size_t input_left;
+static uint8_t snapshot[CANVAS_BUFFER_SIZE > SCREEN_BUFFER_SIZE ? CANVAS_BUFFER_SIZE : SCREEN_BUFFER_SIZE];
+static uint8_t canvas_buffer[CANVAS_BUFFER_SIZE];
+static ssd1306_canvas_t canvas;
+
+static const uint8_t bitmap[64] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0xFF, 0x00, 0xAA, 0x55, 0xF0, 0x0F, 0x81, 0x42,
+    0x24, 0x18, 0x3C, 0x7E, 0xC3, 0x99, 0x66, 0x33, 0xCC, 0x0F, 0xF0, 0x5A, 0xA5, 0x11, 0x22, 0x44,
+    0x88, 0x77, 0xEE, 0xDD, 0xBB, 0x01, 0x80, 0xFE, 0x7F, 0x10, 0x08, 0x3E, 0x41, 0x41, 0x3E, 0x00,
+    0x7F, 0x49, 0x49, 0x36, 0x00, 0x26, 0x49, 0x49, 0x32, 0x00, 0x01, 0x7F, 0x01, 0x00, 0x63, 0x1C
+};
+
+static void wire_hash(uint8_t value)
+{
+  result->wire_hash = (result->wire_hash ^ value) * 16777619u;
+}
+
+//the host transport, every byte sent is hashed on the way
+static int hashed_begin(void *context, uint8_t type)
+{
+  wire_hash(0xC0 | type);
+  return ssd1306_host_ops.begin(context, type);
+}
+
+static int hashed_write(void *context, const uint8_t *bytes, uint16_t count)
+{
+  for(uint16_t i = 0; i < count; i++) wire_hash(bytes[i]);
+  result->wire_bytes += count;
+  return ssd1306_host_ops.write(context, bytes, count);
+}
+
+static int hashed_end(void *context)
+{
+  wire_hash(0xE0);
+  return ssd1306_host_ops.end(context);
+}
+
+static const ssd1306_transport_ops_t hashed_ops = {hashed_begin, hashed_write, hashed_end, 0, 0};
+
+//the next two input bytes as a value below limit, 0 once the input is used up
+static int32_t take(int32_t limit)
+{
+  uint32_t value = 0;
+  for(int i = 0; i < 2 && input_left; i++, input_left--) value = (value << 8) | *input++;
+  return (int32_t)(value % (uint32_t)limit);
+}
+
+//a coordinate of a screen or canvas of size extent, margin pixels beyond both of its sides
+static int16_t coordinate(int32_t value, int16_t extent, int16_t margin)
+{
+  return value % (extent + 2 * margin) - margin;
+}
+
+static void reset_state(void)
+{
+  static ssd1306_transport_t transport = {&hashed_ops, &host};
+  ssd1306_host_reset(&host);
+  ssd1306_select_display(0);
+  ssd1306_draw_to_canvas(0);
+  ssd1306_set_transport(&transport);
+  ssd1306_set_rotation(SSD_ROTATION_0);
+  ssd1306_init();
+  ssd1306_reset_clip_rect();
+  ssd1306_set_line_pattern(0, 0);
+  ssd1306_set_font(Fixedsys8x14);
+  ssd1306_set_text_scale(1);
+  ssd1306_set_text_color(SSD_COLOR_WHITE);
+  ssd1306_clear_display();
+  ssd1306_display_full();
+}
+
+//one drawing call, its kind and arguments are read from the input,
+//all of them before the call as the order C evaluates arguments in is unspecified
+static void run_call(void)
+{
+  int16_t width = ssd1306_get_screen_width(), height = ssd1306_get_screen_height();
+  ssd1306_display_t *display = ssd1306_get_display();
+  int32_t kind = take(30), v[8];
+  uint8_t color = take(3);
+  for(uint8_t i = 0; i < 8; i++) v[i] = take(0x10000);
+  if(display->canvas)
+    {
+      width = display->canvas->width;
+      height = display->canvas->height;
+    }
+  switch(kind)
+  {
+    case 0:
+      ssd1306_draw_pixel(coordinate(v[0], width, 2), coordinate(v[1], height, 2), color);
+      break;
+    case 1:
+      ssd1306_draw_line(coordinate(v[0], width, 200), coordinate(v[1], height, 200),
+			coordinate(v[2], width, 200), coordinate(v[3], height, 200), color);
+      break;
+    case 2:
+      ssd1306_draw_line_thick(coordinate(v[0], width, 20), coordinate(v[1], height, 20),
+			      coordinate(v[2], width, 20), coordinate(v[3], height, 20), v[4] % 9, color);
+      break;
+    case 3:
+      ssd1306_draw_h_line(coordinate(v[0], width, 20), coordinate(v[1], height, 4), coordinate(v[2], width, 20), color);
+      break;
+    case 4:
+      ssd1306_draw_v_line(coordinate(v[0], width, 4), coordinate(v[1], height, 20), coordinate(v[2], height, 20), color);
+      break;
+    case 5:
+      ssd1306_fill_rect(coordinate(v[0], width, 20), coordinate(v[1], height, 20), v[2] % 80, v[3] % 50, color);
+      break;
+    case 6:
+      ssd1306_draw_rect(v[0] % (width + 8), v[1] % (height + 8), v[2] % 80, v[3] % 50, color);
+      break;
+    case 7:
+      ssd1306_fill_circle(v[0] % (width + 8), v[1] % (height + 8), v[2] % 40, color);
+      break;
+    case 8:
+      ssd1306_draw_circle(v[0] % (width + 8), v[1] % (height + 8), v[2] % 40, color);
+      break;
+    case 9:
+      ssd1306_fill_circle_quarter(v[0] % (width + 8), v[1] % (height + 8), v[2] % 30, v[3] % 5, color);
+      break;
+    case 10:
+      ssd1306_draw_circle_quarter(v[0] % (width + 8), v[1] % (height + 8), v[2] % 30, v[3] % 5, color);
+      break;
+    case 11:
+      ssd1306_fill_rect_round(v[0] % (width + 8), v[1] % (height + 8), v[2] % 80, v[3] % 50, v[4] % 20, color);
+      break;
+    case 12:
+      ssd1306_draw_rect_round(v[0] % (width + 8), v[1] % (height + 8), v[2] % 80, v[3] % 50, v[4] % 20, color);
+      break;
+    case 13:
+      ssd1306_fill_ellipse(coordinate(v[0], width, 30), coordinate(v[1], height, 30), v[2] % 60, v[3] % 40, color);
+      break;
+    case 14:
+      ssd1306_draw_ellipse(coordinate(v[0], width, 30), coordinate(v[1], height, 30), v[2] % 60, v[3] % 40, color);
+      break;
+    case 15:
+      ssd1306_fill_arc(coordinate(v[0], width, 20), coordinate(v[1], height, 20), v[2] % 40, v[3] % 40,
+		       v[4] % 1440 - 720, v[5] % 1440 - 720, color);
+      break;
+    case 16:
+      ssd1306_draw_arc(coordinate(v[0], width, 20), coordinate(v[1], height, 20), v[2] % 40,
+		       v[3] % 1440 - 720, v[4] % 1440 - 720, color);
+      break;
+    case 17:
+      ssd1306_fill_triangle(coordinate(v[0], width, 40), coordinate(v[1], height, 40), coordinate(v[2], width, 40),
+			    coordinate(v[3], height, 40), coordinate(v[4], width, 40), coordinate(v[5], height, 40), color);
+      break;
+    case 18:
+      {
+	ssd1306_point_t points[SSD1306_POLYGON_MAX_POINTS];
+	uint8_t count = 3 + v[0] % (SSD1306_POLYGON_MAX_POINTS - 2);
+	for(uint8_t i = 0; i < count; i++)
+	  {
+	    points[i].x = coordinate(take(0x10000), width, 40);
+	    points[i].y = coordinate(take(0x10000), height, 40);
+	  }
+	ssd1306_fill_polygon(points, count, v[1] % 2, color);
+      }
+      break;
+    case 19:
+      ssd1306_draw_XBM(bitmap, 1 + v[0] % 24, 1 + v[1] % 20, v[2] % (width + 8), v[3] % (height + 8), color);
+      break;
+    case 20:
+      ssd1306_draw_page_bitmap(bitmap, 1 + v[0] % 16, 1 + v[1] % 32, coordinate(v[2], width, 16),
+			       coordinate(v[3], height, 16), v[4] % 4);
+      break;
+    case 21:
+      ssd1306_set_text_scale(1 + v[0] % 3);
+      ssd1306_set_text_color(color);
+      ssd1306_set_cursor_coord(v[1] % width, v[2] % height);
+      ssd1306_printf("%d%c", (int)(v[3] % 1000), 'A' + v[4] % 26);
+      break;
+    case 22:
+      ssd1306_copy_rect(v[0] % width, v[1] % height, 1 + v[2] % 80, 1 + v[3] % 40,
+			coordinate(v[4], width, 10), coordinate(v[5], height, 10));
+      break;
+    case 23:
+      ssd1306_scroll_rect(v[0] % width, v[1] % height, 1 + v[2] % 80, 1 + v[3] % 40, v[4] % 17 - 8, v[5] % 17 - 8, color);
+      break;
+    case 24:
+      //the snapshot has the layout of the drawing target it is taken from
+      if(v[0] & 1) memcpy(snapshot, ssd1306_get_buffer(), display->canvas ? CANVAS_BUFFER_SIZE : SCREEN_BUFFER_SIZE);
+      else ssd1306_restore_rect(snapshot, coordinate(v[1], width, 10), coordinate(v[2], height, 10), v[3] % 80, v[4] % 50);
+      break;
+    case 25:
+      ssd1306_set_clip_rect(coordinate(v[0], width, 10), coordinate(v[1], height, 10), v[2] % (width + 10), v[3] % (height + 10));
+      break;
+    case 26:
+      if(v[0] & 1) ssd1306_reset_clip_rect();
+      else ssd1306_set_line_pattern(v[1] | ((uint32_t)v[2] << 16), v[3] % 34);
+      break;
+    case 27:
+      //canvases are drawn to and copied back, rotation changes wait for the screen target
+      if(display->canvas)
+	{
+	  ssd1306_draw_to_canvas(0);
+	  ssd1306_draw_canvas(&canvas, coordinate(v[0], ssd1306_get_screen_width(), 20),
+			      coordinate(v[1], ssd1306_get_screen_height(), 20), v[2] % 4);
+	}
+      else if(v[0] % 4 == 0) ssd1306_set_rotation(v[1] % 4);
+      else
+	{
+	  ssd1306_canvas_init(&canvas, canvas_buffer, 1 + v[1] % SCREEN_WIDTH, 1 + v[2] % CANVAS_MAX_HEIGHT);
+	  ssd1306_draw_to_canvas(&canvas);
+	}
+      break;
+    default:
+      if(display->canvas) break;
+      if(v[0] & 1) ssd1306_display();
+      else
+	{
+	  ssd1306_flush_begin();
+	  while(ssd1306_flush_step(1 + v[1] % 300) == SSD1306_FLUSH_IN_PROGRESS);
+	}
+      break;
+  }
+  result->calls++;
+}
+
+//runs the program of data with one of the rasters and keeps what it left behind
+static void run_program(const uint8_t *data, size_t size, uint8_t reference, raster_result_t *output)
+{
+  memset(output, 0, sizeof(*output));
+  output->wire_hash = 2166136261u;
+  result = output;
+  ssd1306_reference_raster = reference;
+  input = data;
+  input_left = size;
+  memset(snapshot, 0, sizeof(snapshot));
+  memset(canvas_buffer, 0, sizeof(canvas_buffer));
+  reset_state();
+  while(input_left) run_call();
+  ssd1306_draw_to_canvas(0);
+  ssd1306_display();
+  memcpy(output->buffer, ssd1306_get_buffer(), SCREEN_BUFFER_SIZE);
+  memcpy(output->gddram, host.gddram, SCREEN_BUFFER_SIZE);
+  memcpy(output->canvas, canvas_buffer, CANVAS_BUFFER_SIZE);
+}
+
+//0 when both rasters agree, otherwise prints what differs
+static int compare_rasters(const uint8_t *data, size_t size)
+{
+  static raster_result_t kernels, reference;
+  run_program(data, size, 0, &kernels);
+  run_program(data, size, 1, &reference);
+  int failed = 0;
+  if(memcmp(kernels.buffer, reference.buffer, SCREEN_BUFFER_SIZE))
+    {
+      for(int i = 0; i < SCREEN_BUFFER_SIZE; i++)
+	if(kernels.buffer[i] != reference.buffer[i])
+	  {
+	    printf("screen buffer differs, first at page %d column %d: %02X, reference %02X\n",
+		   i / SCREEN_WIDTH, i % SCREEN_WIDTH, kernels.buffer[i], reference.buffer[i]);
+	    break;
+	  }
+      failed = 1;
+    }
+  if(memcmp(kernels.gddram, reference.gddram, SCREEN_BUFFER_SIZE))
+    {
+      printf("panel memory differs\n");
+      failed = 1;
+    }
+  if(memcmp(kernels.canvas, reference.canvas, CANVAS_BUFFER_SIZE))
+    {
+      printf("canvas differs\n");
+      failed = 1;
+    }
+  if(kernels.wire_hash != reference.wire_hash || kernels.wire_bytes != reference.wire_bytes)
+    {
+      printf("bytes sent differ: %u bytes, reference %u bytes\n", (unsigned)kernels.wire_bytes, (unsigned)reference.wire_bytes);
+      failed = 1;
+    }
+  return failed;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  if(compare_rasters(data, size)) abort();
+  return 0;
+}
+
+#ifndef SSD1306_LIBFUZZER
+static double now_seconds(void)
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+  static uint8_t data[4 * 4096];
+  static raster_result_t timed;
+  uint32_t programs = argc > 1 ? strtoul(argv[1], 0, 0) : 1000, calls = argc > 2 ? strtoul(argv[2], 0, 0) : 200;
+  size_t size = (size_t)calls * 16 < sizeof(data) ? (size_t)calls * 16 : sizeof(data);
+  double seconds[2] = {0, 0};
+  uint32_t calls_run = 0, failures = 0;
+
+  for(uint32_t program = 0; program < programs; program++)
+    {
+      //linear congruential generator seeded with the program number
+      uint32_t state = program * 2654435761u + 1;
+      for(size_t i = 0; i < size; i++)
+	{
+	  state = state * 1103515245u + 12345u;
+	  data[i] = state >> 16;
+	}
+      if(compare_rasters(data, size))
+	{
+	  printf("FAIL program %u\n", (unsigned)program);
+	  failures++;
+	}
+      //each raster timed on its own, the comparison is left out
+      for(uint8_t reference = 0; reference < 2; reference++)
+	{
+	  double start = now_seconds();
+	  run_program(data, size, reference, &timed);
+	  seconds[reference] += now_seconds() - start;
+	}
+      calls_run += timed.calls;
+    }
+  printf("%u programs, %u calls: kernels %.0f calls/s, reference %.0f calls/s\n", (unsigned)programs,
+	 (unsigned)calls_run, calls_run / seconds[0], calls_run / seconds[1]);
+  if(failures) printf("%u of %u programs differ\n", (unsigned)failures, (unsigned)programs);
+  return failures ? 1 : 0;
+}
+#endif
@@ -0,0 +1,238 @@
+/*
+ * trace_test.c
+ *
+ * Records scenes on one set of host displays, replays the dump on a second set
+ * and compares the screen, layer, canvas and panel memory of both. Built with USE_TRACE.
+ */
+
+#include <ssd1306.h>
+#include <ssd1306_trace.h>
+#include <stdio.h>
+#include <string.h>
+
+//everything a scene draws to, once for the recording and once for the replay
+typedef struct
+{
+  ssd1306_host_t host, second_host;
+  ssd1306_display_t display, second;
+  uint8_t buffer[SCREEN_BUFFER_SIZE], second_buffer[SCREEN_BUFFER_SIZE];
+  ssd1306_layer_t layer;
+  uint8_t layer_buffer[SCREEN_BUFFER_SIZE];
+  ssd1306_canvas_t canvas;
+  uint8_t canvas_buffer[40 * 2];
+} side_t;
+
+static side_t device, copy;
+static uint8_t trace_buffer[4096];
+static uint8_t dump[4096];
+static uint32_t dump_length;
+static int resolve_layer;
+
+//stands for a bitmap in flash, the same address on both sides
+static const uint8_t stripes[] = {
+    0xFF, 0x00, 0xFF, 0x00, 0x0F, 0xF0, 0x0F, 0xF0,
+    0x81, 0x42, 0x24, 0x18, 0x18, 0x24, 0x42, 0x81
+};
+
+static void write_dump(const uint8_t *bytes, uint16_t count)
+{
+  if(dump_length + count > sizeof(dump)) return;
+  memcpy(dump + dump_length, bytes, count);
+  dump_length += count;
+}
+
+//addresses of the recording side, also inside an object, map to the replay side
+static const void *resolve(uint32_t address)
+{
+  const struct
+  {
+    const void *device;
+    const void *copy;
+    uint32_t size;
+  } objects[] = {
+      {&device.display, &copy.display, sizeof(copy.display)},
+      {&device.second, &copy.second, sizeof(copy.second)},
+      {device.buffer, copy.buffer, sizeof(copy.buffer)},
+      {device.second_buffer, copy.second_buffer, sizeof(copy.second_buffer)},
+      {resolve_layer ? &device.layer : 0, &copy.layer, sizeof(copy.layer)},
+      {device.layer_buffer, copy.layer_buffer, sizeof(copy.layer_buffer)},
+      {&device.canvas, &copy.canvas, sizeof(copy.canvas)},
+      {device.canvas_buffer, copy.canvas_buffer, sizeof(copy.canvas_buffer)},
+      {stripes, stripes, sizeof(stripes)}
+  };
+  for(unsigned i = 0; i < sizeof(objects) / sizeof(objects[0]); i++)
+    {
+      uint32_t offset = address - (uint32_t)(uintptr_t)objects[i].device;
+      if(objects[i].device && offset < objects[i].size) return (const uint8_t *)objects[i].copy + offset;
+    }
+  return 0;
+}
+
+static void side_reset(side_t *side)
+{
+  ssd1306_transport_t transport = {&ssd1306_host_ops, &side->host};
+  ssd1306_transport_t second_transport = {&ssd1306_host_ops, &side->second_host};
+  ssd1306_host_reset(&side->host);
+  ssd1306_host_reset(&side->second_host);
+  ssd1306_init_display(&side->display, side->buffer, &transport);
+  ssd1306_init_display(&side->second, side->second_buffer, &second_transport);
+  memset(&side->layer, 0, sizeof(side->layer));
+  memset(side->layer_buffer, 0, sizeof(side->layer_buffer));
+  memset(&side->canvas, 0, sizeof(side->canvas));
+  memset(side->canvas_buffer, 0, sizeof(side->canvas_buffer));
+  ssd1306_select_display(&side->second);
+  ssd1306_init();
+  ssd1306_select_display(&side->display);
+  ssd1306_init();
+}
+
+//the rect lands in the layer, the base buffer stays empty
+static void scene_layer_target(void)
+{
+  ssd1306_layer_init(&device.layer, device.layer_buffer, 0, SSD_ROP_OR);
+  ssd1306_add_layer(&device.layer);
+  ssd1306_show_layer(&device.layer, 1);
+  ssd1306_draw_to_layer(&device.layer);
+  ssd1306_fill_rect(40, 0, 8, 8, SSD_COLOR_WHITE);
+  ssd1306_draw_to_layer(0);
+  ssd1306_display();
+}
+
+static void scene_layer_bounds(void)
+{
+  ssd1306_layer_init(&device.layer, device.layer_buffer, 0, SSD_ROP_XOR);
+  ssd1306_fill_rect(0, 0, 64, 16, SSD_COLOR_WHITE);
+  ssd1306_add_layer(&device.layer);
+  ssd1306_set_layer_bounds(&device.layer, 16, 4, 64, 20);
+  ssd1306_show_layer(&device.layer, 1);
+  ssd1306_draw_to_layer(&device.layer);
+  ssd1306_fill_rect(0, 0, 128, 32, SSD_COLOR_WHITE);
+  ssd1306_draw_to_layer(0);
+  ssd1306_display();
+  ssd1306_set_layer_bounds(&device.layer, 32, 8, 16, 8);
+  ssd1306_display();
+  ssd1306_remove_layer(&device.layer);
+  ssd1306_display();
+}
+
+static void scene_contrast_and_windows(void)
+{
+  ssd1306_start_contrast_ramp(200, 60, 10, 0);
+  for(uint32_t now = 0; now < 40; now += 5) ssd1306_contrast_ramp_tick(now);
+  ssd1306_display_full();
+  ssd1306_fill_rect(10, 10, 30, 10, SSD_COLOR_BLACK);
+  ssd1306_display();
+  ssd1306_send_window(stripes, 8, 100, 107, 1, 2);
+  ssd1306_set_window(0, 127, 0, 3);
+  ssd1306_send_window(device.buffer, SCREEN_WIDTH, 0, 127, 0, 3);
+  ssd1306_display_empty();
+}
+
+static void scene_second_display(void)
+{
+  ssd1306_fill_circle(20, 16, 10, SSD_COLOR_WHITE);
+  ssd1306_select_display(&device.second);
+  ssd1306_fill_rect(60, 8, 30, 12, SSD_COLOR_WHITE);
+  ssd1306_display();
+  ssd1306_select_display(&device.display);
+  ssd1306_draw_line(0, 31, 127, 0, SSD_COLOR_WHITE);
+  ssd1306_display();
+}
+
+//the rect lands in the canvas, the screen only gets it with draw_canvas
+static void scene_canvas_target(void)
+{
+  ssd1306_canvas_init(&device.canvas, device.canvas_buffer, 40, 16);
+  ssd1306_draw_to_canvas(&device.canvas);
+  ssd1306_fill_rect(0, 0, 20, 10, SSD_COLOR_WHITE);
+  ssd1306_draw_line(0, 15, 39, 0, SSD_COLOR_INVERSE);
+  ssd1306_draw_to_canvas(0);
+  ssd1306_display();
+  ssd1306_draw_canvas(&device.canvas, 50, 9, SSD_ROP_OR);
+  ssd1306_draw_canvas(&device.canvas, -10, 20, SSD_ROP_XOR);
+  ssd1306_display();
+}
+
+//the second screen buffer serves as the background
+static void scene_restore_rect(void)
+{
+  ssd1306_select_display(&device.second);
+  ssd1306_fill_circle(30, 16, 14, SSD_COLOR_WHITE);
+  ssd1306_select_display(&device.display);
+  ssd1306_fill_rect(0, 0, 128, 32, SSD_COLOR_WHITE);
+  ssd1306_restore_rect(device.second_buffer, 10, 4, 40, 20);
+  ssd1306_display();
+}
+
+static int compare(const char *name, const char *what, const void *recorded, const void *replayed, size_t size)
+{
+  if(!memcmp(recorded, replayed, size)) return 0;
+  printf("FAIL %s: %s differs after the replay\n", name, what);
+  return 1;
+}
+
+static const struct
+{
+  const char *name;
+  void (*draw)(void);
+  uint8_t layer_resolved;
+  uint32_t skipped;  // calls the replay can not run, the sides are compared when 0
+} scenes[] = {
+    {"layer_target", scene_layer_target, 1, 0},
+    {"layer_bounds", scene_layer_bounds, 1, 0},
+    {"contrast_and_windows", scene_contrast_and_windows, 1, 0},
+    {"second_display", scene_second_display, 1, 0},
+    {"canvas_target", scene_canvas_target, 1, 0},
+    {"restore_rect", scene_restore_rect, 1, 0},
+    //init, add, show and draw_to_layer of the layer
+    {"layer_unresolved", scene_layer_target, 0, 4},
+};
+
+int main(void)
+{
+  int failures = 0;
+  for(unsigned i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++)
+    {
+      const char *name = scenes[i].name;
+      ssd1306_trace_replay_t replay = {resolve, 0, 0, 0, 0, 0, 0, 0};
+      side_reset(&device);
+      ssd1306_trace_start(trace_buffer, sizeof(trace_buffer), 0);
+      scenes[i].draw();
+      ssd1306_trace_stop();
+      dump_length = 0;
+      ssd1306_trace_dump(write_dump);
+      side_reset(&copy);
+      resolve_layer = scenes[i].layer_resolved;
+      int result = ssd1306_trace_replay(dump, dump_length, &replay);
+      int failed = 0;
+      if(result != SSD1306_SUCCESS || ssd1306_trace_dropped())
+	{
+	  printf("FAIL %s: replay returned %d, %u records dropped\n", name, result, (unsigned)ssd1306_trace_dropped());
+	  failed = 1;
+	}
+      else if(replay.skipped != scenes[i].skipped)
+	{
+	  printf("FAIL %s: %u calls skipped, expected %u\n", name, (unsigned)replay.skipped, (unsigned)scenes[i].skipped);
+	  failed = 1;
+	}
+      else if(!scenes[i].skipped)
+	{
+	  failed |= compare(name, "screen buffer", device.buffer, copy.buffer, SCREEN_BUFFER_SIZE);
+	  failed |= compare(name, "layer buffer", device.layer_buffer, copy.layer_buffer, SCREEN_BUFFER_SIZE);
+	  failed |= compare(name, "canvas buffer", device.canvas_buffer, copy.canvas_buffer, sizeof(copy.canvas_buffer));
+	  failed |= compare(name, "second screen buffer", device.second_buffer, copy.second_buffer, SCREEN_BUFFER_SIZE);
+	  failed |= compare(name, "panel memory", device.host.gddram, copy.host.gddram, sizeof(copy.host.gddram));
+	  failed |= compare(name, "second panel memory", device.second_host.gddram, copy.second_host.gddram,
+			    sizeof(copy.second_host.gddram));
+	  if(device.host.command_bytes != copy.host.command_bytes || device.host.data_bytes != copy.host.data_bytes
+	      || device.display.contrast.current != copy.display.contrast.current)
+	    {
+	      printf("FAIL %s: bus traffic differs after the replay\n", name);
+	      failed = 1;
+	    }
+	}
+      if(!failed) printf("ok   %s\n", name);
+      failures += failed;
+    }
+  return failures ? 1 : 0;
+}